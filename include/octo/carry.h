@@ -4,15 +4,53 @@
 #define OCTO_CARRY_H
 
 #include "types.h"
+#include "hash.h"
+#include "opt.h"
 
-typedef struct
+// Type of the record count and capacity at the head of each bucket, which
+// limits a bucket to OCTO_CARRY_MAX records. Build with HEADER_WIDTH=16 or 32
+// for larger buckets:
+#if defined(HEADER_WIDTH) && HEADER_WIDTH == 64
+typedef uint64_t octo_carry_hdr_t;
+#elif defined(HEADER_WIDTH) && HEADER_WIDTH == 32
+typedef uint32_t octo_carry_hdr_t;
+#elif defined(HEADER_WIDTH) && HEADER_WIDTH == 16
+typedef uint16_t octo_carry_hdr_t;
+#else
+typedef uint8_t octo_carry_hdr_t;
+#endif
+#define OCTO_CARRY_MAX ((octo_carry_hdr_t)-1)
+
+typedef struct octo_dict_carry_s
 {
 	size_t keylen;
 	size_t vallen;
 	size_t cellen;
+	size_t hashlen;
 	uint64_t bucket_count;
+	// Initial bucket capacity, which buckets never shrink below:
+	uint8_t tolerance;
 	uint8_t master_key[16];
+	octo_hash_fn_t hash;
+	octo_opt_t opt;
 	void **buckets;
+	// Size-classed chunks the buckets are carved from:
+	struct octo_carry_arena_s *arena;
+	// While a rekey is in progress, the table being drained and the number of
+	// its buckets already moved. old is NULL otherwise:
+	struct octo_dict_carry_s *old;
+	uint64_t migrated;
+	// Number of times the dict has detected a flood and rekeyed itself or
+	// switched away from octo_hash_hw:
+	uint64_t flood_events;
+	// With opt.count_hits, the number of lookups that found their key, and
+	// the total number of records ahead of it in its bucket or chain:
+	uint64_t hits;
+	uint64_t hit_depth;
+	// Buckets brought into use since the dict was last cleared, for dicts that
+	// keep track of them(those from an octo_pool_t do). NULL otherwise:
+	uint64_t *touched;
+	uint64_t touched_count;
 } octo_dict_carry_t;
 
 typedef struct
@@ -21,19 +59,38 @@ typedef struct
 	uint64_t empty_buckets;
 	uint64_t optimal_buckets;
 	uint64_t colliding_buckets;
-	uint8_t max_bucket_elements;
+	octo_carry_hdr_t max_bucket_elements;
+	uint64_t flood_events;
+	uint64_t hits;
+	uint64_t hit_depth;
 	long double load;
 } octo_stat_carry_t;
 
 octo_dict_carry_t *octo_carry_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key);
+octo_dict_carry_t *octo_carry_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key, const octo_opt_t *init_opt);
 void octo_carry_free(octo_dict_carry_t *target);
+void octo_carry_clear(octo_dict_carry_t *dict);
 int octo_carry_insert(const void *key, const void *value, const octo_dict_carry_t *dict);
 void *octo_carry_fetch(const void *key, const octo_dict_carry_t *dict);
 void *octo_carry_fetch_safe(const void *key, const octo_dict_carry_t *dict);
 int octo_carry_poke(const void *key, const octo_dict_carry_t *dict);
 int octo_carry_delete(const void *key, const octo_dict_carry_t *dict);
+int octo_carry_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_carry_t *dict);
+void *octo_carry_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict);
+void *octo_carry_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict);
+int octo_carry_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict);
+int octo_carry_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict);
+void octo_carry_key(octo_key_t *handle, const void *key, const octo_dict_carry_t *dict);
+int octo_carry_insert_h(const octo_key_t *key, const void *value, const octo_dict_carry_t *dict);
+void *octo_carry_fetch_h(const octo_key_t *key, const octo_dict_carry_t *dict);
+void *octo_carry_fetch_safe_h(const octo_key_t *key, const octo_dict_carry_t *dict);
+int octo_carry_poke_h(const octo_key_t *key, const octo_dict_carry_t *dict);
+int octo_carry_delete_h(const octo_key_t *key, const octo_dict_carry_t *dict);
+int octo_carry_rekey(octo_dict_carry_t *dict, const uint8_t *new_master_key);
+int octo_carry_migrate(octo_dict_carry_t *dict, const uint64_t buckets);
 octo_dict_carry_t *octo_carry_rehash(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key);
 octo_dict_carry_t *octo_carry_rehash_safe(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key);
+int octo_carry_grow(octo_dict_carry_t *dict);
 octo_dict_carry_t *octo_carry_clone(octo_dict_carry_t *dict);
 octo_stat_carry_t *octo_carry_stats(octo_dict_carry_t *dict);
 void octo_carry_stats_msg(octo_dict_carry_t *dict);
@@ -4,15 +4,40 @@
 #define OCTO_CLL_H
 
 #include "types.h"
+#include "hash.h"
+#include "opt.h"
 
-typedef struct
+typedef struct octo_dict_cll_s
 {
 	size_t keylen;
 	size_t vallen;
 	size_t cellen;
+	size_t hashlen;
+	// Size of the link to the next node that starts each node: a pointer, or
+	// a 32-bit node index with opt.compact_links:
+	size_t linklen;
 	uint64_t bucket_count;
 	uint8_t master_key[16];
+	octo_hash_fn_t hash;
+	octo_opt_t opt;
 	void **buckets;
+	// Slabs the nodes are carved from, shared with the old table during a rekey:
+	struct octo_cll_arena_s *arena;
+	// While a rekey is in progress, the table being drained and the number of
+	// its buckets already moved. old is NULL otherwise:
+	struct octo_dict_cll_s *old;
+	uint64_t migrated;
+	// Number of times the dict has detected a flood and rekeyed itself or
+	// switched away from octo_hash_hw:
+	uint64_t flood_events;
+	// With opt.count_hits, the number of lookups that found their key, and
+	// the total number of records ahead of it in its bucket or chain:
+	uint64_t hits;
+	uint64_t hit_depth;
+	// Buckets brought into use since the dict was last cleared, for dicts that
+	// keep track of them(those from an octo_pool_t do). NULL otherwise:
+	uint64_t *touched;
+	uint64_t touched_count;
 } octo_dict_cll_t;
 
 typedef struct
@@ -22,16 +47,34 @@ typedef struct
 	uint64_t optimal_buckets;
 	uint64_t chained_buckets;
 	uint64_t max_chain_len;
+	uint64_t flood_events;
+	uint64_t hits;
+	uint64_t hit_depth;
 	long double load;
 } octo_stat_cll_t;
 
 octo_dict_cll_t *octo_cll_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key);
+octo_dict_cll_t *octo_cll_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key, const octo_opt_t *init_opt);
 void octo_cll_free(octo_dict_cll_t *target);
+void octo_cll_clear(octo_dict_cll_t *dict);
 int octo_cll_insert(const void *key, const void *value, const octo_dict_cll_t *dict);
 void *octo_cll_fetch(const void *key, const octo_dict_cll_t *dict);
 void *octo_cll_fetch_safe(const void *key, const octo_dict_cll_t *dict);
 int octo_cll_poke(const void *key, const octo_dict_cll_t *dict);
 int octo_cll_delete(const void *key, const octo_dict_cll_t *dict);
+int octo_cll_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_cll_t *dict);
+void *octo_cll_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict);
+void *octo_cll_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict);
+int octo_cll_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict);
+int octo_cll_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict);
+void octo_cll_key(octo_key_t *handle, const void *key, const octo_dict_cll_t *dict);
+int octo_cll_insert_h(const octo_key_t *key, const void *value, const octo_dict_cll_t *dict);
+void *octo_cll_fetch_h(const octo_key_t *key, const octo_dict_cll_t *dict);
+void *octo_cll_fetch_safe_h(const octo_key_t *key, const octo_dict_cll_t *dict);
+int octo_cll_poke_h(const octo_key_t *key, const octo_dict_cll_t *dict);
+int octo_cll_delete_h(const octo_key_t *key, const octo_dict_cll_t *dict);
+int octo_cll_rekey(octo_dict_cll_t *dict, const uint8_t *new_master_key);
+int octo_cll_migrate(octo_dict_cll_t *dict, const uint64_t buckets);
 octo_dict_cll_t *octo_cll_rehash(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key);
 octo_dict_cll_t *octo_cll_rehash_safe(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key);
 octo_dict_cll_t *octo_cll_clone(octo_dict_cll_t *dict);
@@ -5,7 +5,82 @@
 
 #include "types.h"
 
+// Signature shared by every keyed hash function a dict may use:
+typedef void (*octo_hash_fn_t)(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *master_key);
+
+// Instruction set levels for the hash kernels, in increasing order:
+typedef enum
+{
+	OCTO_ISA_BASELINE = 0,
+	OCTO_ISA_SSE42,
+	OCTO_ISA_AES,
+	OCTO_ISA_AVX2,
+	OCTO_ISA_AVX512
+} octo_isa_t;
+
+// One part of a key that is stored in several non-contiguous pieces:
+typedef struct
+{
+	const void *base;
+	size_t len;
+} octo_iov_t;
+
+// A key with its hash precomputed, so it can be used for many operations on
+// dicts sharing a hash function and master key without hashing it again:
+typedef struct
+{
+	const void *key;
+	size_t keylen;
+	uint64_t hash;
+	octo_hash_fn_t fn;
+	uint8_t master_key[16];
+} octo_key_t;
+
+// State of an incremental octo_hash/octo_hash13:
+typedef struct
+{
+	uint64_t stat[4];
+	uint64_t tail;
+	uint64_t length;
+	unsigned int c_rounds;
+	unsigned int d_rounds;
+} octo_hash_ctx_t;
+
 // libocto's dual key hash function:
 void octo_hash(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *master_key);
 
+// SipHash-1-3; faster, for tables never exposed to attacker-chosen keys:
+void octo_hash13(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *master_key);
+
+// AES-NI/CRC32C keyed hash for trusted keys; dicts using it fall back to octo_hash:
+void octo_hash_hw(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *master_key);
+
+// Striped octo_hash for keys of hundreds of bytes or more:
+void octo_hash_long(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *master_key);
+
+// Hash count fixed-length keys laid out back to back, 8 output bytes per key:
+void octo_hash_many(const uint8_t *input, size_t count, size_t input_length, uint8_t *output, const uint8_t *master_key);
+
+// Pick an octo_hash variant unrolled for keys of exactly input_length bytes:
+octo_hash_fn_t octo_hash_fixed(size_t input_length);
+
+// Resolve the function a dict calls for a chosen base hash and key length:
+octo_hash_fn_t octo_hash_select(octo_hash_fn_t base, size_t input_length);
+
+// Incremental hashing; the result matches hashing the concatenated input:
+void octo_hash_init(octo_hash_ctx_t *ctx, const uint8_t *master_key);
+void octo_hash13_init(octo_hash_ctx_t *ctx, const uint8_t *master_key);
+void octo_hash_update(octo_hash_ctx_t *ctx, const uint8_t *input, size_t input_length);
+void octo_hash_final(octo_hash_ctx_t *ctx, uint8_t *output);
+
+// Re-select the hash kernels, using nothing above max_isa. This is done
+// automatically at load time; existing dicts keep their octo_hash_hw kernel:
+octo_isa_t octo_hash_dispatch(octo_isa_t max_isa);
+
+// Fill in a key handle, hashing the key with base(as for octo_hash_select):
+void octo_key_init(octo_key_t *handle, const void *key, size_t keylen, octo_hash_fn_t base, const uint8_t *master_key);
+
+// Hash a key given in parts with a dict's chosen hash function:
+int octo_hash_iov(octo_hash_fn_t base, const octo_iov_t *key, size_t parts, uint8_t *output, const uint8_t *master_key);
+
 #endif
@@ -6,5 +6,6 @@
 #include "types.h"
 
 uint8_t *octo_keygen();
+void octo_keygen_fast(uint8_t *output);
 
 #endif
@@ -4,15 +4,34 @@
 #define OCTO_LOA_H
 
 #include "types.h"
+#include "hash.h"
+#include "opt.h"
 
-typedef struct
+typedef struct octo_dict_loa_s
 {
 	size_t keylen;
 	size_t vallen;
 	size_t cellen;
+	size_t hashlen;
 	uint64_t bucket_count;
 	uint8_t master_key[16];
+	octo_hash_fn_t hash;
+	octo_opt_t opt;
 	void *buckets;
+	// Number of full buckets, so a rekey never lets this table and the old
+	// one hold more records between them than either has buckets:
+	uint64_t records;
+	// While a rekey is in progress, the table being drained and the number of
+	// its buckets already moved. old is NULL otherwise:
+	struct octo_dict_loa_s *old;
+	uint64_t migrated;
+	// Number of times the dict has detected a flood and rekeyed itself or
+	// switched away from octo_hash_hw:
+	uint64_t flood_events;
+	// Buckets brought into use since the dict was last cleared, for dicts that
+	// keep track of them(those from an octo_pool_t do). NULL otherwise:
+	uint64_t *touched;
+	uint64_t touched_count;
 } octo_dict_loa_t;
 
 typedef struct
@@ -22,16 +41,32 @@ typedef struct
 	uint64_t optimal_buckets;
 	uint64_t colliding_buckets;
 	uint64_t garbage_buckets;
+	uint64_t flood_events;
 	long double load;
 } octo_stat_loa_t;
 
 octo_dict_loa_t *octo_loa_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key);
+octo_dict_loa_t *octo_loa_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key, const octo_opt_t *init_opt);
 void octo_loa_free(octo_dict_loa_t *target);
+void octo_loa_clear(octo_dict_loa_t *dict);
 int octo_loa_insert(const void *key, const void *value, const octo_dict_loa_t *dict);
 void *octo_loa_fetch(const void *key, const octo_dict_loa_t *dict);
 void *octo_loa_fetch_safe(const void *key, const octo_dict_loa_t *dict);
 int octo_loa_poke(const void *key, const octo_dict_loa_t *dict);
 int octo_loa_delete(const void *key, const octo_dict_loa_t *dict);
+int octo_loa_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_loa_t *dict);
+void *octo_loa_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict);
+void *octo_loa_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict);
+int octo_loa_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict);
+int octo_loa_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict);
+void octo_loa_key(octo_key_t *handle, const void *key, const octo_dict_loa_t *dict);
+int octo_loa_insert_h(const octo_key_t *key, const void *value, const octo_dict_loa_t *dict);
+void *octo_loa_fetch_h(const octo_key_t *key, const octo_dict_loa_t *dict);
+void *octo_loa_fetch_safe_h(const octo_key_t *key, const octo_dict_loa_t *dict);
+int octo_loa_poke_h(const octo_key_t *key, const octo_dict_loa_t *dict);
+int octo_loa_delete_h(const octo_key_t *key, const octo_dict_loa_t *dict);
+int octo_loa_rekey(octo_dict_loa_t *dict, const uint8_t *new_master_key);
+int octo_loa_migrate(octo_dict_loa_t *dict, const uint64_t buckets);
 octo_dict_loa_t *octo_loa_rehash(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key);
 octo_dict_loa_t *octo_loa_rehash_safe(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key);
 octo_dict_loa_t *octo_loa_clone(octo_dict_loa_t *dict);
@@ -0,0 +1,95 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#ifndef OCTO_OPT_H
+#define OCTO_OPT_H
+
+#include "types.h"
+#include "hash.h"
+
+// Default chain or probe length at which a dict hashing with octo_hash_hw
+// decides it is under a collision attack and switches to octo_hash:
+#define OCTO_FALLBACK_LEN 64
+
+// Default number of old buckets moved by each insertion or deletion while a
+// dict is being rekeyed:
+#define OCTO_REKEY_STEP 8
+
+// Default percentage by which a full carry bucket grows:
+#define OCTO_GROW_PERCENT 50
+
+// Ways of reducing a key hash to a bucket index:
+typedef enum
+{
+	// hash % bucket_count; works with any bucket count:
+	OCTO_INDEX_MOD = 0,
+	// hash & (bucket_count - 1); the bucket count is rounded up to a power of two:
+	OCTO_INDEX_POW2,
+	// (hash * bucket_count) >> 64; works with any bucket count:
+	OCTO_INDEX_FASTRANGE
+} octo_index_t;
+
+// Ways a carry bucket or cll chain is reordered when a lookup finds a key:
+typedef enum
+{
+	// Leave records where they were inserted:
+	OCTO_REORDER_NONE = 0,
+	// Move the record found to the front of its bucket or chain:
+	OCTO_REORDER_MTF,
+	// Swap the record found with the one in front of it:
+	OCTO_REORDER_TRANSPOSE
+} octo_reorder_t;
+
+// Per-dict options accepted by the octo_~_init_opt functions. A zeroed struct
+// (or a NULL pointer) gives the same table as the plain octo_~_init functions.
+// Options are kept in the dict and honored by rehash and clone.
+typedef struct
+{
+	// Keyed hash function; octo_hash, octo_hash13, or your own. NULL selects octo_hash:
+	octo_hash_fn_t hash;
+	// Store each record's 64-bit hash with it, so lookups compare hashes
+	// before keys and rehashing with the same master key skips the hash:
+	int cache_hash;
+	// How hashes are reduced to bucket indices. Defaults to OCTO_INDEX_MOD:
+	octo_index_t index_mode;
+	// Chain or probe length that makes an octo_hash_hw dict fall back to
+	// octo_hash. 0 selects OCTO_FALLBACK_LEN:
+	uint32_t fallback_len;
+	// Bucket fill(carry), chain length(cll), or probe length(loa) at which
+	// the dict assumes it is being flooded and rekeys itself with a fresh
+	// master key. 0 disables automatic rekeying:
+	uint32_t rekey_len;
+	// Old buckets moved per insertion or deletion during a rekey. 0 selects
+	// OCTO_REKEY_STEP:
+	uint32_t rekey_step;
+	// Percentage by which a full carry bucket grows, by at least one record.
+	// 0 selects OCTO_GROW_PERCENT:
+	uint32_t grow_percent;
+	// Fill percentage at or below which a carry bucket shrinks after a
+	// deletion, never below its initial tolerance. 0 disables shrinking:
+	uint32_t shrink_percent;
+	// Lay carry buckets out as an array of one-byte hash fingerprints, then
+	// the keys, then the values. Lookups scan the fingerprints and only
+	// compare the keys that match, never touching the values:
+	int fingerprint;
+	// Fill the slot of a deleted carry record with the bucket's last record,
+	// so deletions move one record instead of every following one. Records
+	// no longer stay in insertion order:
+	int swap_delete;
+	// How carry and cll dicts reorder a bucket or chain when a fetch or poke
+	// finds a key in it. Defaults to OCTO_REORDER_NONE. Lookups then write to
+	// the dict, and may move records a fetch pointer refers to:
+	octo_reorder_t reorder;
+	// Count the lookups that find a key, and how many records were ahead of
+	// it, in the dict's hits and hit_depth. Lookups then write to the dict:
+	int count_hits;
+	// Keep a reference count with each carry bucket, so octo_carry_clone
+	// shares the buckets with the clone instead of copying them. A shared
+	// bucket is copied when either dict modifies it:
+	int cow_clone;
+	// Link cll nodes with 32-bit indices into the dict's slabs instead of
+	// pointers. Saves the other half of a pointer per record on 64-bit
+	// targets, but a dict can hold at most UINT32_MAX - 1 records:
+	int compact_links;
+} octo_opt_t;
+
+#endif
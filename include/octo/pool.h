@@ -0,0 +1,39 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#ifndef OCTO_POOL_H
+#define OCTO_POOL_H
+
+#include "types.h"
+#include "opt.h"
+
+// Implementation strategies a pool can hand out:
+typedef enum
+{
+	OCTO_POOL_CARRY = 0,
+	OCTO_POOL_CLL,
+	OCTO_POOL_LOA,
+	OCTO_POOL_UCLL
+} octo_strategy_t;
+
+// A stack of empty dicts of one shape, ready to be handed out again. Pools
+// aren't locked; give each thread its own.
+typedef struct
+{
+	octo_strategy_t strategy;
+	size_t keylen;
+	size_t vallen;
+	uint64_t bucket_count;
+	uint8_t tolerance;
+	octo_opt_t opt;
+	size_t capacity;
+	size_t count;
+	void **dicts;
+} octo_pool_t;
+
+octo_pool_t *octo_pool_init(const octo_strategy_t strategy, const size_t keylen, const size_t vallen, const uint64_t buckets, const uint8_t tolerance, const size_t capacity, const octo_opt_t *opt);
+void octo_pool_free(octo_pool_t *pool);
+int octo_pool_fill(octo_pool_t *pool, const size_t count);
+void *octo_pool_get(octo_pool_t *pool);
+void octo_pool_put(octo_pool_t *pool, void *dict);
+
+#endif
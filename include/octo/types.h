@@ -5,6 +5,8 @@
 
 #ifdef NO_STDINT
 typedef unsigned char uint8_t;
+typedef unsigned short int uint16_t;
+typedef unsigned int uint32_t;
 typedef unsigned long long int uint64_t;
 #else
 #include <stdint.h>
@@ -0,0 +1,82 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#ifndef OCTO_UCLL_H
+#define OCTO_UCLL_H
+
+#include "types.h"
+#include "hash.h"
+#include "opt.h"
+
+typedef struct octo_dict_ucll_s
+{
+	size_t keylen;
+	size_t vallen;
+	size_t cellen;
+	size_t hashlen;
+	uint64_t bucket_count;
+	// Number of records each node has room for:
+	uint8_t tolerance;
+	uint8_t master_key[16];
+	octo_hash_fn_t hash;
+	octo_opt_t opt;
+	void **buckets;
+	// While a rekey is in progress, the table being drained and the number of
+	// its buckets already moved. old is NULL otherwise:
+	struct octo_dict_ucll_s *old;
+	uint64_t migrated;
+	// Number of times the dict has detected a flood and rekeyed itself or
+	// switched away from octo_hash_hw:
+	uint64_t flood_events;
+	// With opt.count_hits, the number of lookups that found their key, and
+	// the total number of records ahead of it in its chain:
+	uint64_t hits;
+	uint64_t hit_depth;
+	// Buckets brought into use since the dict was last cleared, for dicts that
+	// keep track of them(those from an octo_pool_t do). NULL otherwise:
+	uint64_t *touched;
+	uint64_t touched_count;
+} octo_dict_ucll_t;
+
+typedef struct
+{
+	uint64_t total_entries;
+	uint64_t total_nodes;
+	uint64_t null_buckets;
+	uint64_t optimal_buckets;
+	uint64_t chained_buckets;
+	uint64_t max_chain_len;
+	uint64_t flood_events;
+	uint64_t hits;
+	uint64_t hit_depth;
+	long double load;
+} octo_stat_ucll_t;
+
+octo_dict_ucll_t *octo_ucll_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key);
+octo_dict_ucll_t *octo_ucll_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key, const octo_opt_t *init_opt);
+void octo_ucll_free(octo_dict_ucll_t *target);
+void octo_ucll_clear(octo_dict_ucll_t *dict);
+int octo_ucll_insert(const void *key, const void *value, const octo_dict_ucll_t *dict);
+void *octo_ucll_fetch(const void *key, const octo_dict_ucll_t *dict);
+void *octo_ucll_fetch_safe(const void *key, const octo_dict_ucll_t *dict);
+int octo_ucll_poke(const void *key, const octo_dict_ucll_t *dict);
+int octo_ucll_delete(const void *key, const octo_dict_ucll_t *dict);
+int octo_ucll_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_ucll_t *dict);
+void *octo_ucll_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict);
+void *octo_ucll_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict);
+int octo_ucll_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict);
+int octo_ucll_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict);
+void octo_ucll_key(octo_key_t *handle, const void *key, const octo_dict_ucll_t *dict);
+int octo_ucll_insert_h(const octo_key_t *key, const void *value, const octo_dict_ucll_t *dict);
+void *octo_ucll_fetch_h(const octo_key_t *key, const octo_dict_ucll_t *dict);
+void *octo_ucll_fetch_safe_h(const octo_key_t *key, const octo_dict_ucll_t *dict);
+int octo_ucll_poke_h(const octo_key_t *key, const octo_dict_ucll_t *dict);
+int octo_ucll_delete_h(const octo_key_t *key, const octo_dict_ucll_t *dict);
+int octo_ucll_rekey(octo_dict_ucll_t *dict, const uint8_t *new_master_key);
+int octo_ucll_migrate(octo_dict_ucll_t *dict, const uint64_t buckets);
+octo_dict_ucll_t *octo_ucll_rehash(octo_dict_ucll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key);
+octo_dict_ucll_t *octo_ucll_rehash_safe(octo_dict_ucll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key);
+octo_dict_ucll_t *octo_ucll_clone(octo_dict_ucll_t *dict);
+octo_stat_ucll_t *octo_ucll_stats(octo_dict_ucll_t *dict);
+void octo_ucll_stats_msg(octo_dict_ucll_t *dict);
+
+#endif
@@ -1,6 +1,7 @@
 // libocto Copyright (C) Travis Whitaker 2013-2014
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,8 +12,422 @@
 #include <octo/hash.h>
 #include <octo/carry.h>
 
-// Allocate memory for and initialize a carry_dict.
+#include "internal.h"
+
+#if defined(__SSE2__)
+#include <x86intrin.h>
+#endif
+
+// Bucket accessors. Each bucket is a record count, a capacity, and then an
+// array of cells. Each cell is the record's cached hash(if enabled), its key,
+// and its value. With the fingerprint option, the capacity is instead followed
+// by an array of one-byte hash fingerprints, an array of cached hashes(if
+// enabled) and keys, and an array of values:
+#define CARRY_RECORDS(b) (*((octo_carry_hdr_t *)(b)))
+#define CARRY_SIZE(b) (*((octo_carry_hdr_t *)(b) + 1))
+#define CARRY_HEADER (2 * sizeof(octo_carry_hdr_t))
+#define CARRY_FPS(b) ((uint8_t *)(b) + CARRY_HEADER)
+
+// Fingerprints are the top byte of the hash times an odd constant, which mixes
+// every hash bit in, so records sharing a bucket's low(pow2) or high(fastrange)
+// bits still get independent fingerprints at any bucket count:
+#define CARRY_FP(hash) ((uint8_t)(((hash) * 0x9e3779b97f4a7c15ULL) >> 56))
+
+// Index returned when a key isn't in a bucket:
+#define CARRY_MISS UINT64_MAX
+
+// Return a pointer to the key of record i in a bucket. Its cached hash, if
+// any, is just before it:
+static OCTO_ALWAYS_INLINE uint8_t *carry_key(const octo_dict_carry_t *dict, const void *bucket, const uint64_t i)
+{
+	if(dict->opt.fingerprint)
+	{
+		return CARRY_FPS(bucket) + CARRY_SIZE(bucket) + ((dict->hashlen + dict->keylen) * i) + dict->hashlen;
+	}
+	return (uint8_t *)bucket + CARRY_HEADER + (dict->cellen * i) + dict->hashlen;
+}
+
+// Return a pointer to the value of record i in a bucket:
+static OCTO_ALWAYS_INLINE uint8_t *carry_value(const octo_dict_carry_t *dict, const void *bucket, const uint64_t i)
+{
+	if(dict->opt.fingerprint)
+	{
+		return CARRY_FPS(bucket) + (CARRY_SIZE(bucket) * (1 + dict->hashlen + dict->keylen)) + (dict->vallen * i);
+	}
+	return carry_key(dict, bucket, i) + dict->keylen;
+}
+
+// Return the size of a bucket block holding capacity records:
+static OCTO_ALWAYS_INLINE size_t carry_bucket_size(const octo_dict_carry_t *dict, const uint64_t capacity)
+{
+	return CARRY_HEADER + ((dict->cellen + (dict->opt.fingerprint ? 1 : 0)) * capacity);
+}
+
+// Copy count records starting at index j of one bucket to index i of another,
+// or of the same one:
+static void carry_copy_records(const octo_dict_carry_t *dict, void *to, const uint64_t i, const void *from, const uint64_t j, const uint64_t count)
+{
+	if(dict->opt.fingerprint)
+	{
+		memmove(CARRY_FPS(to) + i, CARRY_FPS(from) + j, count);
+		memmove(carry_key(dict, to, i) - dict->hashlen, carry_key(dict, from, j) - dict->hashlen, (dict->hashlen + dict->keylen) * count);
+		memmove(carry_value(dict, to, i), carry_value(dict, from, j), dict->vallen * count);
+	}
+	else
+	{
+		memmove(carry_key(dict, to, i) - dict->hashlen, carry_key(dict, from, j) - dict->hashlen, dict->cellen * count);
+	}
+	return;
+}
+
+// Exchange two equally long, non-overlapping byte ranges:
+static void carry_swap_bytes(uint8_t *a, uint8_t *b, size_t len)
+{
+	uint8_t tmp[64];
+	while(len > 0)
+	{
+		const size_t chunk = len < sizeof(tmp) ? len : sizeof(tmp);
+		memcpy(tmp, a, chunk);
+		memcpy(a, b, chunk);
+		memcpy(b, tmp, chunk);
+		a += chunk;
+		b += chunk;
+		len -= chunk;
+	}
+	return;
+}
+
+// Exchange records i and j of a bucket:
+static void carry_swap_records(const octo_dict_carry_t *dict, void *bucket, const uint64_t i, const uint64_t j)
+{
+	if(dict->opt.fingerprint)
+	{
+		carry_swap_bytes(CARRY_FPS(bucket) + i, CARRY_FPS(bucket) + j, 1);
+		carry_swap_bytes(carry_key(dict, bucket, i) - dict->hashlen, carry_key(dict, bucket, j) - dict->hashlen, dict->hashlen + dict->keylen);
+		carry_swap_bytes(carry_value(dict, bucket, i), carry_value(dict, bucket, j), dict->vallen);
+	}
+	else
+	{
+		carry_swap_bytes(carry_key(dict, bucket, i) - dict->hashlen, carry_key(dict, bucket, j) - dict->hashlen, dict->cellen);
+	}
+	return;
+}
+
+// Move element i of an array of len-byte elements to the front, shifting
+// elements [0, i) up by one. Elements too long to set aside on the stack are
+// swapped forward one place at a time instead:
+static void carry_front_bytes(uint8_t *array, const uint64_t i, const size_t len)
+{
+	uint8_t tmp[256];
+	if(len > sizeof(tmp))
+	{
+		for(uint64_t j = i; j > 0; j--)
+		{
+			carry_swap_bytes(array + (len * j), array + (len * (j - 1)), len);
+		}
+		return;
+	}
+	memcpy(tmp, array + (len * i), len);
+	memmove(array + len, array, len * i);
+	memcpy(array, tmp, len);
+	return;
+}
+
+// Move record i of a bucket to the front, shifting records [0, i) up by one:
+static void carry_front_record(const octo_dict_carry_t *dict, void *bucket, const uint64_t i)
+{
+	if(dict->opt.fingerprint)
+	{
+		carry_front_bytes(CARRY_FPS(bucket), i, 1);
+		carry_front_bytes(carry_key(dict, bucket, 0) - dict->hashlen, i, dict->hashlen + dict->keylen);
+		carry_front_bytes(carry_value(dict, bucket, 0), i, dict->vallen);
+	}
+	else
+	{
+		carry_front_bytes(carry_key(dict, bucket, 0) - dict->hashlen, i, dict->cellen);
+	}
+	return;
+}
+
+// Blocks are aligned for both the free list links and the header:
+#define CARRY_ALIGN (sizeof(void *) > sizeof(octo_carry_hdr_t) ? sizeof(void *) : sizeof(octo_carry_hdr_t))
+
+// With opt.cow_clone, each block is preceded by the number of buckets, in the
+// dict and its clones, that refer to it. CARRY_ALIGN leaves room for it. Once
+// a block is shared the count is only touched atomically, since a clone may be
+// modified while another is read:
+#define CARRY_REFS(b) (*((uint32_t *)((uint8_t *)(b) - CARRY_ALIGN)))
+#define CARRY_PREFIX(dict) ((dict)->opt.cow_clone ? CARRY_ALIGN : 0)
+
+// Buckets are carved out of large chunks owned by the dict's arena. Buckets of
+// the same capacity share a size class, which hands out blocks from its newest
+// chunk and keeps a free list of the blocks given back by buckets that grew
+// into another class. A class's first chunk holds CARRY_CHUNK_MIN blocks unless
+// reserved otherwise, and each later one is twice the size of the last, up to
+// the bucket count:
+#define CARRY_CHUNK_MIN 64
+
+typedef struct carry_chunk_s
+{
+	struct carry_chunk_s *next;
+	max_align_t blocks[];
+} carry_chunk_t;
+
+typedef struct
+{
+	uint64_t capacity;
+	size_t block_size;
+	void *free_blocks;
+	uint8_t *next_block;
+	uint64_t blocks_left;
+	uint64_t chunk_blocks;
+} carry_class_t;
+
+struct octo_carry_arena_s
+{
+	// Number of dicts carving buckets out of the arena; copy-on-write clones
+	// share their original's:
+	uint64_t refs;
+	carry_chunk_t *chunks;
+	// Size classes, sorted by capacity:
+	carry_class_t *classes;
+	size_t class_count;
+};
+
+// Allocate an empty arena. Return NULL on malloc failure.
+static struct octo_carry_arena_s *carry_arena_init(void)
+{
+	struct octo_carry_arena_s *arena = malloc(sizeof(*arena));
+	if(arena == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating bucket arena");
+		errno = ENOMEM;
+		return NULL;
+	}
+	arena->refs = 1;
+	arena->chunks = NULL;
+	arena->classes = NULL;
+	arena->class_count = 0;
+	return arena;
+}
+
+// Free an arena and every bucket carved out of it.
+static void carry_arena_free(struct octo_carry_arena_s *arena)
+{
+	if(arena == NULL)
+	{
+		return;
+	}
+	while(arena->chunks != NULL)
+	{
+		carry_chunk_t *next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+	free(arena->classes);
+	free(arena);
+	return;
+}
+
+// Find the size class for buckets of the given capacity, adding it if there
+// isn't one yet. Return NULL on malloc failure.
+static carry_class_t *carry_class(const octo_dict_carry_t *dict, const uint64_t capacity)
+{
+	struct octo_carry_arena_s *arena = dict->arena;
+	size_t low = 0;
+	size_t high = arena->class_count;
+	while(low < high)
+	{
+		const size_t mid = low + ((high - low) / 2);
+		if(arena->classes[mid].capacity < capacity)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	if(low < arena->class_count && arena->classes[low].capacity == capacity)
+	{
+		return &arena->classes[low];
+	}
+	carry_class_t *classes = realloc(arena->classes, sizeof(*classes) * (arena->class_count + 1));
+	if(classes == NULL)
+	{
+		DEBUG_MSG("realloc failed adding a bucket size class");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memmove(classes + low + 1, classes + low, sizeof(*classes) * (arena->class_count - low));
+	arena->classes = classes;
+	arena->class_count++;
+	carry_class_t *class = &classes[low];
+	// Round blocks up to CARRY_ALIGN, which also leaves room for the free list link:
+	const size_t block_size = CARRY_PREFIX(dict) + carry_bucket_size(dict, capacity);
+	class->capacity = capacity;
+	class->block_size = (block_size + CARRY_ALIGN - 1) & ~(CARRY_ALIGN - 1);
+	class->free_blocks = NULL;
+	class->next_block = NULL;
+	class->blocks_left = 0;
+	class->chunk_blocks = CARRY_CHUNK_MIN;
+	return class;
+}
+
+// Give a size class a new chunk of the given number of blocks. Any blocks left
+// in its previous chunk are abandoned. Return 0 on success, 1 on malloc failure.
+static int carry_class_reserve(const octo_dict_carry_t *dict, carry_class_t *class, const uint64_t blocks)
+{
+	if(blocks > (SIZE_MAX - sizeof(carry_chunk_t)) / class->block_size)
+	{
+		DEBUG_MSG("size_t overflow, bucket chunk is too large");
+		errno = ENOMEM;
+		return 1;
+	}
+	carry_chunk_t *chunk = malloc(sizeof(carry_chunk_t) + ((size_t)blocks * class->block_size));
+	if(chunk == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating bucket chunk");
+		errno = ENOMEM;
+		return 1;
+	}
+	chunk->next = dict->arena->chunks;
+	dict->arena->chunks = chunk;
+	class->next_block = (uint8_t *)chunk->blocks;
+	class->blocks_left = blocks;
+	return 0;
+}
+
+// Take a block for a bucket of the given capacity from the arena. The header is
+// filled in for an empty bucket. Return NULL on malloc failure.
+static void *carry_block_alloc(const octo_dict_carry_t *dict, const uint64_t capacity)
+{
+	carry_class_t *class = carry_class(dict, capacity);
+	if(class == NULL)
+	{
+		return NULL;
+	}
+	void *block = class->free_blocks;
+	if(block != NULL)
+	{
+		memcpy(&class->free_blocks, block, sizeof(void *));
+	}
+	else
+	{
+		if(class->blocks_left == 0)
+		{
+			if(carry_class_reserve(dict, class, class->chunk_blocks) != 0)
+			{
+				return NULL;
+			}
+			const uint64_t limit = dict->bucket_count > CARRY_CHUNK_MIN ? dict->bucket_count : CARRY_CHUNK_MIN;
+			class->chunk_blocks = class->chunk_blocks < limit / 2 ? class->chunk_blocks * 2 : limit;
+		}
+		block = class->next_block + CARRY_PREFIX(dict);
+		class->next_block += class->block_size;
+		class->blocks_left--;
+	}
+	if(dict->opt.cow_clone)
+	{
+		CARRY_REFS(block) = 1;
+	}
+	CARRY_RECORDS(block) = 0;
+	CARRY_SIZE(block) = (octo_carry_hdr_t)capacity;
+	return block;
+}
+
+// Drop a bucket's reference to its block, and put the block on its size
+// class's free list once no bucket refers to it. The class always exists,
+// since the block was taken from it.
+static void carry_block_release(const octo_dict_carry_t *dict, void *block)
+{
+	if(dict->opt.cow_clone && __atomic_sub_fetch(&CARRY_REFS(block), 1, __ATOMIC_ACQ_REL) != 0)
+	{
+		return;
+	}
+	carry_class_t *class = carry_class(dict, CARRY_SIZE(block));
+	memcpy(block, &class->free_blocks, sizeof(void *));
+	class->free_blocks = block;
+	return;
+}
+
+// Return the capacity a full bucket of the given capacity grows to. Growing
+// from the tolerance always walks the same capacities, so buckets share size
+// classes:
+static OCTO_ALWAYS_INLINE uint64_t carry_grow(const octo_dict_carry_t *dict, const uint64_t capacity)
+{
+	const uint64_t percent = dict->opt.grow_percent != 0 ? dict->opt.grow_percent : OCTO_GROW_PERCENT;
+	const uint64_t step = (capacity * percent) / 100;
+	const uint64_t grown = capacity + (step > 0 ? step : 1);
+	return grown < OCTO_CARRY_MAX ? grown : OCTO_CARRY_MAX;
+}
+
+// Move a bucket's records into a block of another capacity, releasing the old
+// block. Return 0 on success, 1 on malloc failure.
+static int carry_resize(const octo_dict_carry_t *dict, void **slot, const uint64_t capacity)
+{
+	void *bucket = *slot;
+	void *resized = carry_block_alloc(dict, capacity);
+	if(resized == NULL)
+	{
+		return 1;
+	}
+	carry_copy_records(dict, resized, 0, bucket, 0, CARRY_RECORDS(bucket));
+	CARRY_RECORDS(resized) = CARRY_RECORDS(bucket);
+	carry_block_release(dict, bucket);
+	*slot = resized;
+	return 0;
+}
+
+// Shrink a bucket that a deletion left at or below the shrink threshold. It
+// moves to the capacity it had when it grew to hold one more record than it
+// has now, so the next few insertions don't grow it straight back. Failing
+// to allocate the smaller block is harmless, and leaves the bucket as it is.
+static void carry_shrink(const octo_dict_carry_t *dict, void **slot)
+{
+	const void *bucket = *slot;
+	if(dict->opt.shrink_percent == 0 || CARRY_SIZE(bucket) <= dict->tolerance
+		|| (uint64_t)CARRY_RECORDS(bucket) * 100 > (uint64_t)CARRY_SIZE(bucket) * dict->opt.shrink_percent)
+	{
+		return;
+	}
+	uint64_t capacity = dict->tolerance;
+	while(capacity <= CARRY_RECORDS(bucket))
+	{
+		capacity = carry_grow(dict, capacity);
+	}
+	if(capacity < CARRY_SIZE(bucket))
+	{
+		carry_resize(dict, slot, capacity);
+	}
+	return;
+}
+
+// Return non-zero if a bucket is shared with a copy-on-write clone:
+static OCTO_ALWAYS_INLINE int carry_shared(const octo_dict_carry_t *dict, const void *bucket)
+{
+	return dict->opt.cow_clone && __atomic_load_n(&CARRY_REFS(bucket), __ATOMIC_ACQUIRE) > 1;
+}
+
+// Give a bucket shared with a copy-on-write clone a block of its own, so it
+// can be modified. Return 0 on success, 1 on malloc failure.
+static OCTO_ALWAYS_INLINE int carry_own(const octo_dict_carry_t *dict, void **slot)
+{
+	if(*slot == NULL || !carry_shared(dict, *slot))
+	{
+		return 0;
+	}
+	return carry_resize(dict, slot, CARRY_SIZE(*slot));
+}
+
+// Allocate memory for and initialize a carry_dict with the default options.
 octo_dict_carry_t *octo_carry_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key)
+{
+	return octo_carry_init_opt(init_keylen, init_vallen, init_buckets, init_tolerance, init_master_key, NULL);
+}
+
+// Allocate memory for and initialize a carry_dict with the options in *init_opt.
+octo_dict_carry_t *octo_carry_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key, const octo_opt_t *init_opt)
 {
 	// Make sure the arguments are valid:
 	if(init_keylen <= 0)
@@ -36,20 +451,51 @@ octo_dict_carry_t *octo_carry_init(const size_t init_keylen, const size_t init_v
 
 	// Allocate the new dict and populate the trivial fields:
 	octo_dict_carry_t *output = malloc(sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating *output");
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(init_opt != NULL)
+	{
+		output->opt = *init_opt;
+	}
+	else
+	{
+		memset(&output->opt, 0, sizeof(output->opt));
+	}
+	const uint64_t bucket_count = octo_index_buckets(output->opt.index_mode, init_buckets);
+	if(bucket_count == 0)
+	{
+		DEBUG_MSG("unknown index mode, or init_buckets too large for it");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
+	if(output->opt.reorder != OCTO_REORDER_NONE && output->opt.reorder != OCTO_REORDER_MTF && output->opt.reorder != OCTO_REORDER_TRANSPOSE)
+	{
+		DEBUG_MSG("unknown reorder policy");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
 	output->keylen = init_keylen;
 	output->vallen = init_vallen;
-	const size_t cellen_tmp = init_keylen + init_vallen;
-	if(cellen_tmp < init_keylen)
+	output->hashlen = OCTO_HASHLEN(output->opt);
+	if(init_keylen > SIZE_MAX - output->hashlen || init_vallen > SIZE_MAX - output->hashlen - init_keylen)
 	{
 		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
 		errno = EDOM;
 		free(output);
 		return NULL;
 	}
+	const size_t cellen_tmp = output->hashlen + init_keylen + init_vallen;
 	output->cellen = cellen_tmp;
 
-	// Allocate the array of bucket pointers:
-	void **buckets_tmp = malloc(sizeof(*buckets_tmp) * init_buckets);
+	// Allocate the array of bucket pointers. Buckets are only allocated once
+	// something is inserted into them, so they all start out NULL:
+	void **buckets_tmp = calloc(bucket_count, sizeof(*buckets_tmp));
 	if(buckets_tmp == NULL)
 	{
 		DEBUG_MSG("unable to allocate bucket pointer array");
@@ -57,548 +503,1105 @@ octo_dict_carry_t *octo_carry_init(const size_t init_keylen, const size_t init_v
 		free(output);
 		return NULL;
 	}
-	// Pre-allocate each bucket:
-	for(uint64_t i = 0; i < init_buckets; i++)
+	output->bucket_count = bucket_count;
+	output->tolerance = init_tolerance;
+	output->buckets = buckets_tmp;
+	output->arena = carry_arena_init();
+	if(output->arena == NULL)
 	{
-		*(buckets_tmp + i) = malloc((2 * sizeof(uint8_t)) + (cellen_tmp * init_tolerance));
-		if(*(buckets_tmp + i) == NULL)
-		{
-			DEBUG_MSG("unable to pre-allocate bucket");
-			errno = ENOMEM;
-			for(uint64_t j = 0; j < i; j++)
-			{
-				free(*(buckets_tmp + j));
-			}
-			free(buckets_tmp);
-			free(output);
-			return NULL;
-		}
-		*((uint8_t *)*(buckets_tmp + i)) = 0;
-		*((uint8_t *)*(buckets_tmp + i) + 1) = init_tolerance;
+		free(buckets_tmp);
+		free(output);
+		return NULL;
 	}
-	output->bucket_count = init_buckets;
-	output->buckets = buckets_tmp;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = 0;
+	output->hits = 0;
+	output->hit_depth = 0;
+	output->touched = NULL;
+	output->touched_count = 0;
 	memcpy(output->master_key, init_master_key, 16);
+	output->hash = octo_hash_select(output->opt.hash, init_keylen);
 	return output;
 }
 
 // Delete a carry_dict.
 void octo_carry_free(octo_dict_carry_t *target)
 {
-	for(uint64_t i = 0; i < target->bucket_count; i++)
+	if(target->old != NULL)
+	{
+		octo_carry_free(target->old);
+	}
+	if(target->arena != NULL && target->arena->refs > 1)
 	{
-		if(*(target->buckets + i) != NULL)
+		// Copy-on-write clones still use the arena, so only give back the
+		// blocks they don't share:
+		for(uint64_t i = 0; i < target->bucket_count; i++)
 		{
-			free(*(target->buckets + i));
+			if(*(target->buckets + i) != NULL)
+			{
+				carry_block_release(target, *(target->buckets + i));
+			}
 		}
+		target->arena->refs--;
+	}
+	else
+	{
+		carry_arena_free(target->arena);
 	}
 	free(target->buckets);
+	free(target->touched);
 	free(target);
 	return;
 }
 
-// Insert a value into a carry_dict. Return 0 on success, 1 on malloc failure, 2 on unmanageable collision.
-int octo_carry_insert(const void *key, const void *value, const octo_dict_carry_t *dict)
+// Empty a bucket. One shared with a copy-on-write clone is let go instead.
+static void carry_empty(const octo_dict_carry_t *dict, void **slot)
 {
-	uint64_t hash;
-	uint64_t index;
+	if(*slot == NULL)
+	{
+		return;
+	}
+	if(carry_shared(dict, *slot))
+	{
+		carry_block_release(dict, *slot);
+		*slot = NULL;
+		return;
+	}
+	CARRY_RECORDS(*slot) = 0;
+	return;
+}
 
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
+// Remove every record from a carry_dict, keeping its buckets allocated. Only
+// the buckets that have been used are visited if the dict keeps track of them.
+void octo_carry_clear(octo_dict_carry_t *dict)
+{
+	if(dict->old != NULL)
+	{
+		octo_carry_free(dict->old);
+		dict->old = NULL;
+		dict->migrated = 0;
+	}
+	if(dict->touched != NULL && dict->touched_count < dict->bucket_count)
+	{
+		for(uint64_t i = 0; i < dict->touched_count; i++)
+		{
+			carry_empty(dict, dict->buckets + dict->touched[i]);
+		}
+	}
+	else
+	{
+		for(uint64_t i = 0; i < dict->bucket_count; i++)
+		{
+			carry_empty(dict, dict->buckets + i);
+		}
+	}
+	dict->touched_count = 0;
+	return;
+}
+
+// Return non-zero if record i of a bucket has the given key:
+static OCTO_ALWAYS_INLINE int carry_match(const octo_dict_carry_t *dict, const void *bucket, const uint64_t i, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	const uint8_t *record = carry_key(dict, bucket, i);
+	// With cached hashes, only compare keys whose hashes match:
+	if(dict->hashlen != 0 && octo_hash_load(record - dict->hashlen) != hash)
+	{
+		return 0;
+	}
+	return octo_key_equal(record, key, parts);
+}
+
+// Find the record with the given key in a bucket laid out with fingerprints,
+// comparing a vector of fingerprints at a time where the target has them:
+static OCTO_ALWAYS_INLINE uint64_t carry_find_fp(const octo_dict_carry_t *dict, const void *bucket, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	const uint8_t *fps = CARRY_FPS(bucket);
+	const uint8_t fp = CARRY_FP(hash);
+	const uint64_t records = CARRY_RECORDS(bucket);
+	uint64_t i = 0;
+#if defined(__AVX2__)
+	const __m256i want = _mm256_set1_epi8((char)fp);
+	for(; i + 32 <= records; i += 32)
+	{
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(fps + i)), want));
+		for(; mask != 0; mask &= mask - 1)
+		{
+			if(carry_match(dict, bucket, i + (uint64_t)__builtin_ctz(mask), hash, key, parts))
+			{
+				return i + (uint64_t)__builtin_ctz(mask);
+			}
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i want16 = _mm_set1_epi8((char)fp);
+	for(; i + 16 <= records; i += 16)
+	{
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(fps + i)), want16));
+		for(; mask != 0; mask &= mask - 1)
+		{
+			if(carry_match(dict, bucket, i + (uint64_t)__builtin_ctz(mask), hash, key, parts))
+			{
+				return i + (uint64_t)__builtin_ctz(mask);
+			}
+		}
+	}
+#endif
+	for(; i < records; i++)
+	{
+		if(fps[i] == fp && carry_match(dict, bucket, i, hash, key, parts))
+		{
+			return i;
+		}
+	}
+	return CARRY_MISS;
+}
+
+// Find the record with the given key in a bucket. Return its index, or
+// CARRY_MISS if it isn't in the bucket.
+static OCTO_ALWAYS_INLINE uint64_t carry_find(const octo_dict_carry_t *dict, const void *bucket, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(bucket == NULL)
+	{
+		return CARRY_MISS;
+	}
+	if(dict->opt.fingerprint)
+	{
+		return carry_find_fp(dict, bucket, hash, key, parts);
+	}
+	for(uint64_t i = 0; i < CARRY_RECORDS(bucket); i++)
+	{
+		if(carry_match(dict, bucket, i, hash, key, parts))
+		{
+			return i;
+		}
+	}
+	return CARRY_MISS;
+}
 
-	// If there's nothing in the bucket yet, insert the record:
-	if(*((uint8_t *)*(dict->buckets + index)) == 0)
+static int carry_insert_fallback(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+static int carry_insert_rekey(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+
+// Insert a record with the given key hash. Return values are as for octo_carry_insert.
+static OCTO_ALWAYS_INLINE int carry_insert(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	const uint64_t index = octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+	void *bucket = *(dict->buckets + index);
+
+	// If the key is already in the bucket, overwrite the value:
+	const uint64_t found = carry_find(dict, bucket, hash, key, parts);
+	if(found != CARRY_MISS)
 	{
-		memcpy((uint8_t *)*(dict->buckets + index) + 2, key, dict->keylen);
-		memcpy((uint8_t *)*(dict->buckets + index) + 2 + dict->keylen, value, dict->vallen);
-		*((uint8_t *)*(dict->buckets + index)) += 1;
+		if(carry_own(dict, dict->buckets + index) != 0)
+		{
+			DEBUG_MSG("bucket allocation failed during insertion");
+			return 1;
+		}
+		memcpy(carry_value(dict, *(dict->buckets + index), found), value, dict->vallen);
 		return 0;
 	}
 
-	// Check to see if the key is already in the bucket:
-	for(uint8_t i = 0; i < *((uint8_t *)*(dict->buckets + index)); i++)
+	// A long bucket suggests a collision attack. Nothing is done about it while
+	// an earlier rekey is still being migrated:
+	if(dict->old == NULL && bucket != NULL)
 	{
-		if(memcmp(key, (uint8_t *)*(dict->buckets + index) + 2 + (i * dict->cellen), dict->keylen) == 0)
+		if(octo_hw_flooded(&dict->opt, CARRY_RECORDS(bucket)))
+		{
+			return carry_insert_fallback(dict, key, parts, value);
+		}
+		if(octo_rekey_due(&dict->opt, CARRY_RECORDS(bucket)))
 		{
-			memcpy((uint8_t *)*(dict->buckets + index) + 2 + (i * dict->cellen) + dict->keylen, value, dict->vallen);
-			return 0;
+			return carry_insert_rekey(dict, key, parts, value);
 		}
 	}
 
+	// Allocate the bucket on its first insertion:
+	if(bucket == NULL)
+	{
+		bucket = carry_block_alloc(dict, dict->tolerance);
+		if(bucket == NULL)
+		{
+			DEBUG_MSG("bucket allocation failed during insertion");
+			return 1;
+		}
+		*(dict->buckets + index) = bucket;
+	}
 	// If the bucket is at capacity, expand it:
-	if(*((uint8_t *)*(dict->buckets + index) + 1) == *((uint8_t *)*(dict->buckets + index)))
+	else if(CARRY_SIZE(bucket) == CARRY_RECORDS(bucket))
 	{
-		// ...but not if *((uint8_t *)*(dict->buckets + index) + 1) would overflow:
-		if(*((uint8_t *)*(dict->buckets + index) + 1) == 255)
+		// ...but not if the capacity would overflow:
+		if(CARRY_SIZE(bucket) == OCTO_CARRY_MAX)
 		{
 			return 2;
 		}
-		void *bigger_bucket = realloc(*(dict->buckets + index),(2 * sizeof(uint8_t)) + (dict->cellen * (*((uint8_t *)*(dict->buckets + index) + 1) + 1)));
-		if(bigger_bucket == NULL)
+		if(carry_resize(dict, dict->buckets + index, carry_grow(dict, CARRY_SIZE(bucket))) != 0)
 		{
-			DEBUG_MSG("bucket realloc failed during insertion");
-			errno = ENOMEM;
+			DEBUG_MSG("bucket allocation failed during insertion");
 			return 1;
 		}
-		*(dict->buckets + index) = bigger_bucket;
-		*((uint8_t *)*(dict->buckets + index) + 1) += 1;
+		bucket = *(dict->buckets + index);
 	}
+	// A bucket shared with a clone is copied before it's modified:
+	else if(carry_shared(dict, bucket))
+	{
+		if(carry_own(dict, dict->buckets + index) != 0)
+		{
+			DEBUG_MSG("bucket allocation failed during insertion");
+			return 1;
+		}
+		bucket = *(dict->buckets + index);
+	}
+
+	if(CARRY_RECORDS(bucket) == 0)
+	{
+		octo_touch(dict->touched, &((octo_dict_carry_t *)dict)->touched_count, dict->bucket_count, index);
+	}
+
+	// Insert the record at the end of the bucket:
+	const uint64_t end = CARRY_RECORDS(bucket);
+	uint8_t *record = carry_key(dict, bucket, end);
+	if(dict->opt.fingerprint)
+	{
+		CARRY_FPS(bucket)[end] = CARRY_FP(hash);
+	}
+	if(dict->hashlen != 0)
+	{
+		octo_hash_store(record - dict->hashlen, hash);
+	}
+	octo_key_copy(record, key, parts);
+	memcpy(carry_value(dict, bucket, end), value, dict->vallen);
+	CARRY_RECORDS(bucket) += 1;
+	return 0;
+}
+
+// Move up to count buckets of the table being drained by a rekey into the
+// current one, and free it once it's empty. Return 0 on success, or the
+// insertion error if a record couldn't be moved; the dict stays usable.
+static int carry_migrate(octo_dict_carry_t *dict, uint64_t count)
+{
+	octo_dict_carry_t *old = dict->old;
+	if(old == NULL)
+	{
+		return 0;
+	}
+	for(; count > 0 && dict->migrated < old->bucket_count; count--)
+	{
+		if(carry_own(old, old->buckets + dict->migrated) != 0)
+		{
+			DEBUG_MSG("bucket allocation failed while migrating a rekey, will retry");
+			return 1;
+		}
+		void *bucket = *(old->buckets + dict->migrated);
+		// Take records from the end, so each leaves the old bucket once it's placed:
+		while(bucket != NULL && CARRY_RECORDS(bucket) > 0)
+		{
+			const uint64_t last = CARRY_RECORDS(bucket) - 1;
+			const octo_iov_t flat = {carry_key(old, bucket, last), old->keylen};
+			uint64_t hash;
+			dict->hash(flat.base, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+			const int failed = carry_insert(dict, hash, &flat, 1, carry_value(old, bucket, last));
+			if(failed != 0)
+			{
+				DEBUG_MSG("insertion failed while migrating a rekey, will retry");
+				return failed;
+			}
+			CARRY_RECORDS(bucket) -= 1;
+		}
+		dict->migrated++;
+	}
+	if(dict->migrated == old->bucket_count)
+	{
+		octo_carry_free(old);
+		dict->old = NULL;
+		dict->migrated = 0;
+	}
+	return 0;
+}
+
+// Find the slot of the old table's bucket that would hold a key during a
+// rekey. Return NULL if the key parts couldn't be gathered.
+static void **carry_old_bucket(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	const octo_dict_carry_t *old = dict->old;
+	if(octo_hash_parts(old->hash, old->opt.hash, key, parts, old->master_key, hash) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return NULL;
+	}
+	return old->buckets + octo_index(old->opt.index_mode, *hash, old->bucket_count);
+}
+
+// Insert a record while a rekey is in progress. A key that hasn't been moved
+// yet is updated in the old table, so it's never in both.
+static int carry_insert_rekeying(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	uint64_t old_hash;
+	void **old_slot = carry_old_bucket(dict, key, parts, &old_hash);
+	if(old_slot == NULL)
+	{
+		return 1;
+	}
+	int ret = 0;
+	const uint64_t found = carry_find(dict->old, *old_slot, old_hash, key, parts);
+	if(found != CARRY_MISS)
+	{
+		if(carry_own(dict->old, old_slot) != 0)
+		{
+			return 1;
+		}
+		memcpy(carry_value(dict->old, *old_slot, found), value, dict->vallen);
+	}
+	else
+	{
+		ret = carry_insert(dict, hash, key, parts, value);
+	}
+	carry_migrate((octo_dict_carry_t *)dict, octo_rekey_step(&dict->opt));
+	return ret;
+}
+
+// Insert a record with the given key hash, minding a rekey in progress.
+static OCTO_ALWAYS_INLINE int carry_put(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	if(dict->old != NULL)
+	{
+		return carry_insert_rekeying(dict, hash, key, parts, value);
+	}
+	return carry_insert(dict, hash, key, parts, value);
+}
+
+// Count a lookup that found record i of a bucket in table, which is dict or
+// the old table it is draining, and move the record toward the front as the
+// dict's options ask. Return a pointer to the record's value.
+static OCTO_ALWAYS_INLINE uint8_t *carry_hit(const octo_dict_carry_t *dict, const octo_dict_carry_t *table, void *bucket, uint64_t i)
+{
+	if(dict->opt.count_hits)
+	{
+		((octo_dict_carry_t *)dict)->hits++;
+		((octo_dict_carry_t *)dict)->hit_depth += i;
+	}
+	// Buckets shared with a copy-on-write clone are left as they are. Tables
+	// that don't reorder never look at the share count, so lookups stay reads:
+	if(i != 0 && dict->opt.reorder != OCTO_REORDER_NONE && !carry_shared(table, bucket))
+	{
+		switch(dict->opt.reorder)
+		{
+		case OCTO_REORDER_MTF:
+			carry_front_record(table, bucket, i);
+			i = 0;
+			break;
+		case OCTO_REORDER_TRANSPOSE:
+			carry_swap_records(table, bucket, i, i - 1);
+			i--;
+			break;
+		default:
+			break;
+		}
+	}
+	return carry_value(table, bucket, i);
+}
+
+// Look for a key in the old table during a rekey:
+static uint8_t *carry_lookup_old(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts)
+{
+	uint64_t old_hash;
+	void **old_slot = carry_old_bucket(dict, key, parts, &old_hash);
+	if(old_slot == NULL)
+	{
+		return NULL;
+	}
+	const uint64_t found = carry_find(dict->old, *old_slot, old_hash, key, parts);
+	return found == CARRY_MISS ? NULL : carry_hit(dict, dict->old, *old_slot, found);
+}
+
+// Find the record with the given key hash. Return a pointer to the record's
+// value, or NULL if it isn't in the dict.
+static OCTO_ALWAYS_INLINE uint8_t *carry_lookup(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	void *bucket = *(dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count));
+	const uint64_t found = carry_find(dict, bucket, hash, key, parts);
+	if(found != CARRY_MISS)
+	{
+		return carry_hit(dict, dict, bucket, found);
+	}
+	return dict->old != NULL ? carry_lookup_old(dict, key, parts) : NULL;
+}
+
+// Give the bucket holding a key, in whichever table holds it, a block of its
+// own. Return 0 on success or if the key isn't in the dict, 1 on malloc failure.
+static int carry_own_key(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	void **slot = dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+	if(carry_find(dict, *slot, hash, key, parts) != CARRY_MISS)
+	{
+		return carry_own(dict, slot);
+	}
+	if(dict->old == NULL)
+	{
+		return 0;
+	}
+	uint64_t old_hash;
+	void **old_slot = carry_old_bucket(dict, key, parts, &old_hash);
+	if(old_slot == NULL)
+	{
+		return 1;
+	}
+	if(carry_find(dict->old, *old_slot, old_hash, key, parts) != CARRY_MISS)
+	{
+		return carry_own(dict->old, old_slot);
+	}
+	return 0;
+}
+
+// Find the record with the given key hash for one of the fetch functions.
+// Their callers may write through the pointer, so with cow_clone a bucket
+// shared with a clone is copied first. Return values are as for octo_carry_fetch.
+static OCTO_ALWAYS_INLINE void *carry_fetch(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->opt.cow_clone && carry_own_key(dict, hash, key, parts) != 0)
+	{
+		DEBUG_MSG("bucket allocation failed during fetch");
+		return NULL;
+	}
+	uint8_t *value = carry_lookup(dict, hash, key, parts);
+	return value == NULL ? (void *)dict : value;
+}
+
+// Copy the value of a found record into a dedicated heap block.
+static void *carry_copy_value(const octo_dict_carry_t *dict, const uint8_t *value)
+{
+	void *output = malloc(dict->vallen);
+	if(output == NULL)
+	{
+		DEBUG_MSG("lookup successful but malloc failed");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(output, value, dict->vallen);
+	return output;
+}
+
+// Delete the record with the given key from *bucket. Return values are as for octo_carry_delete.
+static OCTO_ALWAYS_INLINE int carry_remove(const octo_dict_carry_t *dict, void **slot, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	const uint64_t found = carry_find(dict, *slot, hash, key, parts);
+	if(found == CARRY_MISS)
+	{
+		return 0;
+	}
+	if(carry_own(dict, slot) != 0)
+	{
+		DEBUG_MSG("bucket allocation failed during deletion");
+		return -1;
+	}
+	void *bucket = *slot;
+	const uint64_t last = CARRY_RECORDS(bucket) - 1;
+	if(dict->opt.swap_delete)
+	{
+		// Move the last record into the deleted one's place:
+		if(found != last)
+		{
+			carry_copy_records(dict, bucket, found, bucket, last, 1);
+		}
+	}
+	else
+	{
+		// Copy each following record up to the preceeding cell space:
+		carry_copy_records(dict, bucket, found, bucket, found + 1, last - found);
+	}
+	// Decrement the bucket record count.
+	CARRY_RECORDS(bucket) -= 1;
+	carry_shrink(dict, slot);
+	return 1;
+}
+
+// Delete a record while a rekey is in progress, from whichever table holds it.
+static int carry_delete_rekeying(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	int deleted = carry_remove(dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+	if(deleted == 0)
+	{
+		uint64_t old_hash;
+		void **old_slot = carry_old_bucket(dict, key, parts, &old_hash);
+		deleted = old_slot != NULL ? carry_remove(dict->old, old_slot, old_hash, key, parts) : -1;
+	}
+	carry_migrate((octo_dict_carry_t *)dict, octo_rekey_step(&dict->opt));
+	return deleted;
+}
+
+// Delete the record with the given key hash. Return values are as for octo_carry_delete.
+static OCTO_ALWAYS_INLINE int carry_delete(const octo_dict_carry_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->old != NULL)
+	{
+		return carry_delete_rekeying(dict, hash, key, parts);
+	}
+	return carry_remove(dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+}
+
+// Hash a flat key for a carry_dict:
+static OCTO_ALWAYS_INLINE uint64_t carry_hash(const octo_dict_carry_t *dict, const void *key)
+{
+	uint64_t hash;
+	dict->hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+	return hash;
+}
+
+// Hash a key given in parts for a carry_dict. Return 0 on success, 1 if the
+// parts don't add up to the dict's key length or hashing them failed.
+static int carry_hash_iov(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	if(octo_key_length(key, parts) != dict->keylen)
+	{
+		DEBUG_MSG("key parts don't add up to the key length");
+		errno = EINVAL;
+		return 1;
+	}
+	if(octo_hash_iov(octo_iov_base(dict->hash, dict->opt.hash), key, parts, (uint8_t *)hash, (const uint8_t *)dict->master_key) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return 1;
+	}
+	return 0;
+}
+
+// Insert a value into a carry_dict. Return 0 on success, 1 on malloc failure, 2 on unmanageable collision.
+int octo_carry_insert(const void *key, const void *value, const octo_dict_carry_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return carry_put(dict, carry_hash(dict, key), &flat, 1, value);
+}
+
+// Fetch a value from a carry_dict. Return NULL on error, return a pointer to
+// the carry_dict itself if the value is not found. The pointer refers to the
+// literal location of the record. If you don't want that, use *fetch_safe.
+void *octo_carry_fetch(const void *key, const octo_dict_carry_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return carry_fetch(dict, carry_hash(dict, key), &flat, 1);
+}
+
+// Fetch a value from a carry_dict. Return NULL on error, return a pointer to
+// the carry_dict itself if the value is not found.
+void *octo_carry_fetch_safe(const void *key, const octo_dict_carry_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *value = carry_lookup(dict, carry_hash(dict, key), &flat, 1);
+	return value == NULL ? (void *)dict : carry_copy_value(dict, value);
+}
+
+// Like octo_carry_fetch, but don't malloc/memcpy the value.
+// Return 1 if found, 0 if not.
+int octo_carry_poke(const void *key, const octo_dict_carry_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return carry_lookup(dict, carry_hash(dict, key), &flat, 1) != NULL;
+}
 
-	// Insert the record at the end of the bucket:
-	memcpy((uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * (*((uint8_t *)*(dict->buckets + index)))), key, dict->keylen);
-	memcpy((uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * (*((uint8_t *)*(dict->buckets + index)))) + dict->keylen, value, dict->vallen);
-	*((uint8_t *)*(dict->buckets + index)) += 1;
-	return 0;
+// Delete the record with the given key. Return 1 on successful delete,
+// 0 if the record isn't found, -1 on malloc failure.
+int octo_carry_delete(const void *key, const octo_dict_carry_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return carry_delete(dict, carry_hash(dict, key), &flat, 1);
 }
 
-// Fetch a value from a carry_dict. Return NULL on error, return a pointer to
-// the carry_dict itself if the value is not found. The pointer refers to the
-// literal location of the record. If you don't want that, use *fetch_safe.
-void *octo_carry_fetch(const void *key, const octo_dict_carry_t *dict)
+// Like octo_carry_insert, but the key is given in parts that add up to keylen.
+int octo_carry_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_carry_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*((uint8_t *)*(dict->buckets + index)) == 0)
+	if(carry_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		return (void *)dict;
+		return 1;
 	}
-	for(uint8_t i = 0; i < *((uint8_t *)*(dict->buckets + index)); i++)
+	return carry_put(dict, hash, key, parts, value);
+}
+
+// Like octo_carry_fetch, but the key is given in parts that add up to keylen.
+void *octo_carry_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict)
+{
+	uint64_t hash;
+	if(carry_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		if(memcmp(key, (uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i), dict->keylen) == 0)
-		{
-			return (uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i) + dict->keylen;
-		}
+		return NULL;
 	}
-	return (void *)dict;
+	return carry_fetch(dict, hash, key, parts);
 }
 
-// Fetch a value from a carry_dict. Return NULL on error, return a pointer to
-// the carry_dict itself if the value is not found.
-void *octo_carry_fetch_safe(const void *key, const octo_dict_carry_t *dict)
+// Like octo_carry_fetch_safe, but the key is given in parts that add up to keylen.
+void *octo_carry_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*((uint8_t *)*(dict->buckets + index)) == 0)
+	if(carry_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		return (void *)dict;
+		return NULL;
 	}
-	for(uint8_t i = 0; i < *((uint8_t *)*(dict->buckets + index)); i++)
+	uint8_t *value = carry_lookup(dict, hash, key, parts);
+	return value == NULL ? (void *)dict : carry_copy_value(dict, value);
+}
+
+// Like octo_carry_poke, but the key is given in parts that add up to keylen.
+int octo_carry_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict)
+{
+	uint64_t hash;
+	if(carry_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		if(memcmp(key, (uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i), dict->keylen) == 0)
-		{
-			void *output = malloc(dict->vallen);
-			if(output == NULL)
-			{
-				DEBUG_MSG("lookup successful but malloc failed");
-				errno = ENOMEM;
-				return NULL;
-			}
-			memcpy(output, (uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i) + dict->keylen, dict->vallen);
-			return output;
-		}
+		return 0;
 	}
-	return (void *)dict;
+	return carry_lookup(dict, hash, key, parts) != NULL;
 }
 
-// Like octo_carry_fetch, but don't malloc/memcpy the value.
-// Return 1 if found, 0 if not.
-int octo_carry_poke(const void *key, const octo_dict_carry_t *dict)
+// Like octo_carry_delete, but the key is given in parts that add up to keylen.
+int octo_carry_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_carry_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*((uint8_t *)*(dict->buckets + index)) == 0)
+	if(carry_hash_iov(dict, key, parts, &hash) != 0)
 	{
 		return 0;
 	}
-	for(uint8_t i = 0; i < *((uint8_t *)*(dict->buckets + index)); i++)
+	return carry_delete(dict, hash, key, parts);
+}
+
+// Hash a key handle for a carry_dict. Return 0 on success, 1 if the handle's
+// key length doesn't match the dict's.
+static OCTO_ALWAYS_INLINE int carry_hash_h(const octo_dict_carry_t *dict, const octo_key_t *key, uint64_t *hash)
+{
+	if(octo_key_hash(key, dict->keylen, dict->hash, dict->master_key, hash) != 0)
 	{
-		if(memcmp(key, (uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i), dict->keylen) == 0)
-		{
-			return 1;
-		}
+		DEBUG_MSG("key handle length doesn't match the key length");
+		errno = EINVAL;
+		return 1;
 	}
 	return 0;
 }
 
-// Delete the record with the given key. Return 1 on successful delete,
-// 0 if the record isn't found.
-int octo_carry_delete(const void *key, const octo_dict_carry_t *dict)
+// Fill in a key handle for use with this dict, or any other dict sharing its
+// key length, hash function and master key.
+void octo_carry_key(octo_key_t *handle, const void *key, const octo_dict_carry_t *dict)
+{
+	octo_key_init(handle, key, dict->keylen, dict->opt.hash, dict->master_key);
+	return;
+}
+
+// Like octo_carry_insert, but take a key handle.
+int octo_carry_insert_h(const octo_key_t *key, const void *value, const octo_dict_carry_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-	// If there's nothing in the bucket, the key isn't in the dict:
-	if(*((uint8_t *)*(dict->buckets + index)) == 0)
+	if(carry_hash_h(dict, key, &hash) != 0)
 	{
-		return 0;
+		return 1;
 	}
-	for(uint8_t i = 0; i < *((uint8_t *)*(dict->buckets + index)); i++)
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return carry_put(dict, hash, &flat, 1, value);
+}
+
+// Like octo_carry_fetch, but take a key handle.
+void *octo_carry_fetch_h(const octo_key_t *key, const octo_dict_carry_t *dict)
+{
+	uint64_t hash;
+	if(carry_hash_h(dict, key, &hash) != 0)
 	{
-		if(memcmp(key, (uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i), dict->keylen) == 0)
-		{
-			// Copy each following record up to the preceeding cell space:
-			for(uint8_t j = 0; j < ((*((uint8_t *)*(dict->buckets + index))) - (i + 1)); j++)
-			{
-				memcpy((uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i) + (dict->cellen * j),
-				(uint8_t *)*(dict->buckets + index) + 2 + (dict->cellen * i) + (dict->cellen * (j + 1)), dict->cellen);
-			}
-			// Decrement the bucket record count.
-			(*((uint8_t *)*(dict->buckets + index)))--;
-			return 1;
-		}
+		return NULL;
 	}
-	return 0;
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return carry_fetch(dict, hash, &flat, 1);
 }
 
-// Re-create the carry_dict with a new key length, value length(both will be truncated), number of buckets,
-// tolerance value, and/or new master_key. Return pointer to new carry_dict on success, NULL on failure.
-octo_dict_carry_t *octo_carry_rehash(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key)
+// Like octo_carry_fetch_safe, but take a key handle.
+void *octo_carry_fetch_safe_h(const octo_key_t *key, const octo_dict_carry_t *dict)
 {
-	// Make sure the arguments are valid:
-	if(new_keylen <= 0)
+	uint64_t hash;
+	if(carry_hash_h(dict, key, &hash) != 0)
 	{
-		DEBUG_MSG("key length must not be zero");
-		errno = EINVAL;
 		return NULL;
 	}
-	if(new_buckets <= 0)
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *value = carry_lookup(dict, hash, &flat, 1);
+	return value == NULL ? (void *)dict : carry_copy_value(dict, value);
+}
+
+// Like octo_carry_poke, but take a key handle.
+int octo_carry_poke_h(const octo_key_t *key, const octo_dict_carry_t *dict)
+{
+	uint64_t hash;
+	if(carry_hash_h(dict, key, &hash) != 0)
 	{
-		DEBUG_MSG("init_buckets must not be zero");
-		errno = EINVAL;
-		return NULL;
+		return 0;
 	}
-	if(new_tolerance <= 0)
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return carry_lookup(dict, hash, &flat, 1) != NULL;
+}
+
+// Like octo_carry_delete, but take a key handle.
+int octo_carry_delete_h(const octo_key_t *key, const octo_dict_carry_t *dict)
+{
+	uint64_t hash;
+	if(carry_hash_h(dict, key, &hash) != 0)
 	{
-		DEBUG_MSG("init_tolerance must not be zero");
-		errno = EINVAL;
-		return NULL;
+		return 0;
 	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return carry_delete(dict, hash, &flat, 1);
+}
 
-	// Allocate the new dict and populate trivial fields:
-	octo_dict_carry_t *output = malloc(sizeof(*output));
-	if(output == NULL)
+// Build a new carry_dict from the records in *dict. If keep is zero, the old
+// dict is freed once its records are moved.
+static octo_dict_carry_t *carry_rehash(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key, const int keep)
+{
+	// Finish any rekey in progress, so every record is in the current table:
+	if(carry_migrate(dict, UINT64_MAX) != 0)
 	{
-		DEBUG_MSG("malloc failed allocating *output");
-		errno = ENOMEM;
 		return NULL;
 	}
-	output->keylen = new_keylen;
-	output->vallen = new_vallen;
-	const size_t new_cellen = new_keylen + new_vallen;
-	if(new_cellen < new_keylen)
+	// Allocate the new dict with the same options; this validates the arguments:
+	octo_dict_carry_t *output = octo_carry_init_opt(new_keylen, new_vallen, new_buckets, new_tolerance, new_master_key, &dict->opt);
+	if(output == NULL)
 	{
-		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
-		errno = EDOM;
-		free(output);
 		return NULL;
 	}
-	output->cellen = new_cellen;
-	output->bucket_count = new_buckets;
-	memcpy(output->master_key, new_master_key, 16);
 	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
 	void *key_buffer = calloc(1, output->keylen);
-	void *val_buffer = calloc(1, output->vallen);
+	void *val_buffer = calloc(1, output->vallen + 1);
 	if(key_buffer == NULL || val_buffer == NULL)
 	{
 		DEBUG_MSG("malloc failed while allocating key/val buffer");
 		errno = ENOMEM;
+		free(key_buffer);
+		free(val_buffer);
 		octo_carry_free(output);
 		return NULL;
 	}
-	size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
-	size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
-
-	// Allocate the new array of bucket pointers, initializing them to NULL:
-	void **buckets_tmp = calloc(new_buckets, sizeof(*buckets_tmp));
-	if(buckets_tmp == NULL)
-	{
-		DEBUG_MSG("unable to malloc for **buckets_tmp");
-		errno = ENOMEM;
-		free(output);
-		return NULL;
-	}
-	output->buckets = buckets_tmp;
+	const size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
+	const size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
+	// Cached hashes are still valid if the key, hash function, and master key are unchanged:
+	const int reuse_hash = dict->hashlen != 0 && dict->keylen == output->keylen && dict->hash == output->hash
+		&& memcmp(dict->master_key, output->master_key, 16) == 0;
+	const octo_iov_t flat = {key_buffer, output->keylen};
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
 	uint64_t hash;
-	uint64_t index;
-	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	int failed = 0;
+	for(uint64_t i = 0; i < dict->bucket_count && failed == 0; i++)
 	{
-		for(uint8_t j = 0; j < *((uint8_t *)*(dict->buckets + i)); j++)
+		void *bucket = *(dict->buckets + i);
+		for(octo_carry_hdr_t j = 0; bucket != NULL && j < CARRY_RECORDS(bucket) && failed == 0; j++)
 		{
-			memcpy(key_buffer, ((uint8_t *)*(dict->buckets + i) + 2 + (dict->cellen * j)), buffer_keylen);
-			memcpy(val_buffer, ((uint8_t *)*(dict->buckets + i) + 2 + (dict->cellen * j) + dict->keylen), buffer_vallen);
-			octo_hash((const uint8_t *)key_buffer, (size_t)output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
-			index = hash % output->bucket_count;
-			// If there isn't a bucket at this position yet, alloc and insert:
-			if(*(output->buckets + index) == NULL)
+			const uint8_t *record = carry_key(dict, bucket, j);
+			memcpy(key_buffer, record, buffer_keylen);
+			memcpy(val_buffer, carry_value(dict, bucket, j), buffer_vallen);
+			if(reuse_hash)
 			{
-				*(output->buckets + index) = malloc((2 * sizeof(uint8_t)) + (output->cellen * new_tolerance));
-				if(*(output->buckets + index) == NULL)
-				{
-					DEBUG_MSG("malloc failed while allocating new bucket");
-					errno = ENOMEM;
-					octo_carry_free(output);
-					return NULL;
-				}
-				*((uint8_t *)*(output->buckets + index)) = 1;
-				*((uint8_t *)*(output->buckets + index) + 1) = new_tolerance;
-				memcpy(((uint8_t *)*(output->buckets + index) + 2), key_buffer, output->keylen);
-				memcpy(((uint8_t *)*(output->buckets + index) + 2 + output->keylen), val_buffer, output->vallen);
+				hash = octo_hash_load(record - dict->hashlen);
 			}
-			// Collision:
 			else
 			{
-				int found = 0;
-				// Search for the key(considering new key length) in the bucket:
-				for(uint8_t k = 0; k < *((uint8_t *)*(output->buckets + index)); k++)
-				{
-					if(memcmp(key_buffer, ((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * k)), output->keylen) == 0)
-					{
-						memcpy(((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * k) + output->keylen), val_buffer, output->vallen);
-						*((uint8_t *)*(output->buckets + index)) += 1;
-						found = 1;
-						break;
-					}
-				}
-				if(found == 0)
-				{
-					// If the bucket is at capacity, expand it:
-					if(*((uint8_t *)*(output->buckets + index)) == *((uint8_t *)*(output->buckets + index) + 1))
-					{
-						if(*((uint8_t *)*(output->buckets + index)) == 255)
-						{
-							DEBUG_MSG("unmanageable collision");
-							octo_carry_free(output);
-							free(key_buffer);
-							free(val_buffer);
-							return NULL;
-						}
-						void *bigger_bucket = realloc(*(output->buckets + index), (2 * sizeof(uint8_t)) + (*((uint8_t *)*(output->buckets + index) + 1) + 1) * output->cellen);
-						if(bigger_bucket == NULL)
-						{
-							DEBUG_MSG("realloc failed during rehash");
-							errno = ENOMEM;
-							octo_carry_free(output);
-							free(key_buffer);
-							free(val_buffer);
-							return NULL;
-						}
-						*(output->buckets + index) = bigger_bucket;
-						*((uint8_t *)*(output->buckets + index) + 1) += 1;
-					}
-					// Insert at the end of the bucket:
-					memcpy(((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * (*((uint8_t *)*(output->buckets + index))))), key_buffer, output->keylen);
-					memcpy(((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * (*((uint8_t *)*(output->buckets + index)))) + output->keylen), val_buffer, output->vallen);
-					*((uint8_t *)*(output->buckets + index)) += 1;
-				}
+				output->hash((const uint8_t *)key_buffer, output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
 			}
+			failed = carry_insert(output, hash, &flat, 1, val_buffer);
 		}
-		free(*(dict->buckets + i));
 	}
-	// At this point we're finished with the old dict, free it:
-	free(dict->buckets);
-	free(dict);
 	free(key_buffer);
 	free(val_buffer);
-	// Now allocate buckets for the remaining NULL pointers:
-	for(uint64_t i = 0; i < output->bucket_count; i++)
+	if(!keep)
 	{
-		if(*(output->buckets + i) == NULL)
-		{
-			*(output->buckets + i) = malloc((2 * sizeof(uint8_t)) + (output->cellen * new_tolerance));
-			if(*(output->buckets + i) == NULL)
-			{
-				DEBUG_MSG("malloc failed while finalizing new carry_dict; lazy rehash was used, data is unrecoverable");
-				errno = ENOMEM;
-				octo_carry_free(output);
-				return NULL;
-			}
-			*((uint8_t *)*(output->buckets + i)) = 0;
-			*((uint8_t *)*(output->buckets + i) + 1) = new_tolerance;
-		}
+		// At this point we're finished with the old dict, free it:
+		octo_carry_free(dict);
+	}
+	if(failed != 0)
+	{
+		DEBUG_MSG(keep ? "insertion failed during rehash, original carry_dict in known-good state" : "insertion failed during rehash, lazy rehash was used, data is unrecoverable");
+		octo_carry_free(output);
+		return NULL;
 	}
 	return output;
 }
 
-// Like octo_carry_rehash, but retain the original dict. It is up to the caller
-// to free the old dict.
-octo_dict_carry_t *octo_carry_rehash_safe(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key)
+// Give the dict an empty table keyed with new_master_key, keeping the current
+// one as the old table to be drained. The struct itself stays put, so the
+// caller's dict pointer remains valid.
+static int carry_rekey(octo_dict_carry_t *dict, const uint8_t *new_master_key)
 {
-	// Make sure the arguments are valid:
-	if(new_keylen <= 0)
+	// Only one old table is kept, so finish any earlier rekey first:
+	if(carry_migrate(dict, UINT64_MAX) != 0)
 	{
-		DEBUG_MSG("key length must not be zero");
-		errno = EINVAL;
-		return NULL;
+		return 1;
 	}
-	if(new_buckets <= 0)
+	octo_dict_carry_t *output = octo_carry_init_opt(dict->keylen, dict->vallen, dict->bucket_count, dict->tolerance, new_master_key, &dict->opt);
+	if(output == NULL)
 	{
-		DEBUG_MSG("init_buckets must not be zero");
-		errno = EINVAL;
-		return NULL;
+		return 1;
 	}
-	if(new_tolerance <= 0)
+	octo_dict_carry_t old = *dict;
+	*dict = *output;
+	*output = old;
+	dict->old = output;
+	// A pooled dict's log of used buckets stays with the live table, which
+	// starts out with none:
+	dict->touched = output->touched;
+	dict->touched_count = 0;
+	output->touched = NULL;
+	dict->flood_events = output->flood_events;
+	dict->hits = output->hits;
+	dict->hit_depth = output->hit_depth;
+	return 0;
+}
+
+// Switch a flooded octo_hash_hw dict over to octo_hash, then retry the insertion.
+// The records move to an octo_hash table through an ordinary rekey, a few
+// buckets at a time, while the old table keeps hashing with octo_hash_hw.
+static int carry_insert_fallback(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long bucket in octo_hash_hw carry_dict, falling back to octo_hash");
+	octo_dict_carry_t *target = (octo_dict_carry_t *)dict;
+	// The new table takes the dict's options:
+	target->opt.hash = octo_hash;
+	if(carry_rekey(target, target->master_key) != 0)
 	{
-		DEBUG_MSG("init_tolerance must not be zero");
-		errno = EINVAL;
-		return NULL;
+		target->opt.hash = octo_hash_hw;
+		return 1;
 	}
-
-	// Allocate the new dict and populate trivial fields:
-	octo_dict_carry_t *output = malloc(sizeof(*output));
-	if(output == NULL)
+	target->old->opt.hash = octo_hash_hw;
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
 	{
-		DEBUG_MSG("malloc failed allocating *output");
 		errno = ENOMEM;
-		return NULL;
+		return 1;
 	}
-	output->keylen = new_keylen;
-	output->vallen = new_vallen;
-	const size_t new_cellen = new_keylen + new_vallen;
-	if(new_cellen < new_keylen)
+	return carry_insert(target, hash, key, parts, value);
+}
+
+// Start rekeying a dict with a suspiciously long bucket, then retry the
+// insertion in the new table.
+static int carry_insert_rekey(const octo_dict_carry_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long bucket in carry_dict, rekeying");
+	octo_dict_carry_t *target = (octo_dict_carry_t *)dict;
+	uint8_t new_master_key[16];
+	octo_rekey_master(target->master_key, target->flood_events, new_master_key);
+	if(carry_rekey(target, new_master_key) != 0)
 	{
-		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
-		errno = EDOM;
-		free(output);
-		return NULL;
+		return 1;
 	}
-	output->cellen = new_cellen;
-	output->bucket_count = new_buckets;
-	memcpy(output->master_key, new_master_key, 16);
-	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
-	void *key_buffer = calloc(1, output->keylen);
-	void *val_buffer = calloc(1, output->vallen);
-	if(key_buffer == NULL || val_buffer == NULL)
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
 	{
-		DEBUG_MSG("malloc failed while allocating key/val buffer");
 		errno = ENOMEM;
-		octo_carry_free(output);
-		return NULL;
+		return 1;
+	}
+	return carry_insert(target, hash, key, parts, value);
+}
+
+// Start moving the records of a carry_dict to a table keyed with new_master_key,
+// or with a freshly derived key if new_master_key is NULL. Records are moved a
+// few buckets at a time by later insertions and deletions, or by
+// octo_carry_migrate, and can be found throughout. Return 0 on success, 1 on failure.
+int octo_carry_rekey(octo_dict_carry_t *dict, const uint8_t *new_master_key)
+{
+	uint8_t derived_key[16];
+	if(new_master_key == NULL)
+	{
+		octo_rekey_master(dict->master_key, dict->flood_events, derived_key);
+		new_master_key = derived_key;
+	}
+	return carry_rekey(dict, new_master_key);
+}
+
+// Move up to the given number of old buckets during a rekey. The rekey is
+// finished once dict->old is NULL. Return 0 on success, or the insertion error
+// if a record couldn't be moved.
+int octo_carry_migrate(octo_dict_carry_t *dict, const uint64_t buckets)
+{
+	return carry_migrate(dict, buckets);
+}
+
+// Re-create the carry_dict with a new key length, value length(both will be truncated), number of buckets,
+// tolerance value, and/or new master_key. Return pointer to new carry_dict on success, NULL on failure.
+octo_dict_carry_t *octo_carry_rehash(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key)
+{
+	return carry_rehash(dict, new_keylen, new_vallen, new_buckets, new_tolerance, new_master_key, 0);
+}
+
+// Like octo_carry_rehash, but retain the original dict. It is up to the caller
+// to free the old dict.
+octo_dict_carry_t *octo_carry_rehash_safe(octo_dict_carry_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key)
+{
+	return carry_rehash(dict, new_keylen, new_vallen, new_buckets, new_tolerance, new_master_key, 1);
+}
+
+// Return the hash of record i in a bucket, using the cached one if there is one:
+static OCTO_ALWAYS_INLINE uint64_t carry_record_hash(const octo_dict_carry_t *dict, const void *bucket, const uint64_t i)
+{
+	const uint8_t *record = carry_key(dict, bucket, i);
+	if(dict->hashlen != 0)
+	{
+		return octo_hash_load(record - dict->hashlen);
 	}
-	size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
-	size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
+	uint64_t hash;
+	dict->hash(record, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+	return hash;
+}
 
-	// Allocate the new array of bucket pointers, initializing them to NULL:
-	void **buckets_tmp = calloc(new_buckets, sizeof(*buckets_tmp));
+// Double the number of buckets of an OCTO_INDEX_POW2 carry_dict in place. Each
+// bucket i is split between itself and the new bucket i + bucket_count, so the
+// records stay where they are or move once, and no other table is built.
+// Return 0 on success, 1 on failure, in which case the dict is unchanged.
+int octo_carry_grow(octo_dict_carry_t *dict)
+{
+	if(dict->opt.index_mode != OCTO_INDEX_POW2)
+	{
+		DEBUG_MSG("only OCTO_INDEX_POW2 carry_dicts can grow in place");
+		errno = EINVAL;
+		return 1;
+	}
+	const uint64_t count = dict->bucket_count;
+	if(count > (SIZE_MAX / 2) / sizeof(*dict->buckets))
+	{
+		DEBUG_MSG("bucket count too large to double");
+		errno = EINVAL;
+		return 1;
+	}
+	// Finish any rekey in progress, so every record is in the current table:
+	if(carry_migrate(dict, UINT64_MAX) != 0)
+	{
+		return 1;
+	}
+	void **buckets_tmp = realloc(dict->buckets, sizeof(*buckets_tmp) * count * 2);
 	if(buckets_tmp == NULL)
 	{
-		DEBUG_MSG("unable to malloc for **buckets_tmp");
+		DEBUG_MSG("unable to grow bucket pointer array");
 		errno = ENOMEM;
-		free(output);
-		return NULL;
+		return 1;
 	}
-	output->buckets = buckets_tmp;
-	uint64_t hash;
-	uint64_t index;
-	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	dict->buckets = buckets_tmp;
+	memset(dict->buckets + count, 0, sizeof(*dict->buckets) * count);
+	// Allocate the new buckets first, sized for the records moving into them,
+	// so a failed allocation can still be undone:
+	for(uint64_t i = 0; i < count; i++)
 	{
-		for(uint8_t j = 0; j < *((uint8_t *)*(dict->buckets + i)); j++)
+		const void *bucket = *(dict->buckets + i);
+		uint64_t moving = 0;
+		for(uint64_t j = 0; bucket != NULL && j < CARRY_RECORDS(bucket); j++)
+		{
+			moving += (carry_record_hash(dict, bucket, j) & count) != 0;
+		}
+		if(moving == 0)
 		{
-			memcpy(key_buffer, ((uint8_t *)*(dict->buckets + i) + 2 + (dict->cellen * j)), buffer_keylen);
-			memcpy(val_buffer, ((uint8_t *)*(dict->buckets + i) + 2 + (dict->cellen * j) + dict->keylen), buffer_vallen);
-			octo_hash((const uint8_t *)key_buffer, (size_t)output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
-			index = hash % output->bucket_count;
-			// If there isn't a bucket at this position yet, alloc and insert:
-			if(*(output->buckets + index) == NULL)
+			continue;
+		}
+		uint64_t capacity = dict->tolerance;
+		while(capacity < moving)
+		{
+			capacity = carry_grow(dict, capacity);
+		}
+		// A bucket shared with a clone is about to be split, so it gets a block
+		// of its own too:
+		*(dict->buckets + count + i) = carry_own(dict, dict->buckets + i) == 0 ? carry_block_alloc(dict, capacity) : NULL;
+		if(*(dict->buckets + count + i) == NULL)
+		{
+			DEBUG_MSG("bucket allocation failed while growing carry_dict");
+			for(uint64_t j = 0; j < i; j++)
 			{
-				*(output->buckets + index) = malloc((2 * sizeof(uint8_t)) + (output->cellen * new_tolerance));
-				if(*(output->buckets + index) == NULL)
+				if(*(dict->buckets + count + j) != NULL)
 				{
-					DEBUG_MSG("malloc failed while allocating new bucket");
-					errno = ENOMEM;
-					octo_carry_free(output);
-					return NULL;
+					carry_block_release(dict, *(dict->buckets + count + j));
 				}
-				*((uint8_t *)*(output->buckets + index)) = 1;
-				*((uint8_t *)*(output->buckets + index) + 1) = new_tolerance;
-				memcpy(((uint8_t *)*(output->buckets + index) + 2), key_buffer, output->keylen);
-				memcpy(((uint8_t *)*(output->buckets + index) + 2 + output->keylen), val_buffer, output->vallen);
 			}
-			// Collision:
+			return 1;
+		}
+	}
+	// Split each bucket, keeping the order of the records in both halves:
+	for(uint64_t i = 0; i < count; i++)
+	{
+		void *bucket = *(dict->buckets + i);
+		void *high = *(dict->buckets + count + i);
+		if(high == NULL)
+		{
+			continue;
+		}
+		uint64_t low_records = 0;
+		for(uint64_t j = 0; j < CARRY_RECORDS(bucket); j++)
+		{
+			if((carry_record_hash(dict, bucket, j) & count) != 0)
+			{
+				carry_copy_records(dict, high, CARRY_RECORDS(high), bucket, j, 1);
+				CARRY_RECORDS(high) += 1;
+			}
 			else
 			{
-				int found = 0;
-				// Search for the key(considering new key length) in the bucket:
-				for(uint8_t k = 0; k < *((uint8_t *)*(output->buckets + index)); k++)
-				{
-					if(memcmp(key_buffer, ((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * k)), output->keylen) == 0)
-					{
-						memcpy(((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * k) + output->keylen), val_buffer, output->vallen);
-						*((uint8_t *)*(output->buckets + index)) += 1;
-						found = 1;
-						break;
-					}
-				}
-				if(found == 0)
+				if(low_records != j)
 				{
-					// If the bucket is at capacity, expand it:
-					if(*((uint8_t *)*(output->buckets + index)) == *((uint8_t *)*(output->buckets + index) + 1))
-					{
-						if(*((uint8_t *)*(output->buckets + index)) == 255)
-						{
-							DEBUG_MSG("unmanageable collision");
-							octo_carry_free(output);
-							free(key_buffer);
-							free(val_buffer);
-							return NULL;
-						}
-						void *bigger_bucket = realloc(*(output->buckets + index), (2 * sizeof(uint8_t)) + (*((uint8_t *)*(output->buckets + index) + 1) + 1) * output->cellen);
-						if(bigger_bucket == NULL)
-						{
-							DEBUG_MSG("realloc failed during rehash");
-							errno = ENOMEM;
-							octo_carry_free(output);
-							free(key_buffer);
-							free(val_buffer);
-							return NULL;
-						}
-						*(output->buckets + index) = bigger_bucket;
-						*((uint8_t *)*(output->buckets + index) + 1) += 1;
-					}
-					// Insert at the end of the bucket:
-					memcpy(((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * (*((uint8_t *)*(output->buckets + index))))), key_buffer, output->keylen);
-					memcpy(((uint8_t *)*(output->buckets + index) + 2 + (output->cellen * (*((uint8_t *)*(output->buckets + index)))) + output->keylen), val_buffer, output->vallen);
-					*((uint8_t *)*(output->buckets + index)) += 1;
+					carry_copy_records(dict, bucket, low_records, bucket, j, 1);
 				}
+				low_records++;
 			}
 		}
+		CARRY_RECORDS(bucket) = (octo_carry_hdr_t)low_records;
+		carry_shrink(dict, dict->buckets + i);
 	}
-	// At this point we're finished with our buffers:
-	free(key_buffer);
-	free(val_buffer);
-	// Now allocate buckets for the remaining NULL pointers:
-	for(uint64_t i = 0; i < output->bucket_count; i++)
+	dict->bucket_count = count * 2;
+	// The log of buckets in use is sized for the old bucket count:
+	free(dict->touched);
+	dict->touched = NULL;
+	dict->touched_count = 0;
+	return 0;
+}
+
+// Finish a copy-on-write clone of a dict, whose trivial fields are already
+// in *output. The clone shares the dict's arena, and refers to the same blocks
+// for every bucket in use. Return NULL on error, output on success.
+static octo_dict_carry_t *carry_clone_cow(octo_dict_carry_t *dict, octo_dict_carry_t *output)
+{
+	output->buckets = calloc(output->bucket_count, sizeof(*output->buckets));
+	if(output->buckets == NULL)
+	{
+		DEBUG_MSG("unable to malloc for bucket pointers");
+		errno = ENOMEM;
+		free(output);
+		return NULL;
+	}
+	output->arena = dict->arena;
+	output->arena->refs++;
+	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		if(*(output->buckets + i) == NULL)
+		void *bucket = *(dict->buckets + i);
+		if(bucket == NULL || CARRY_RECORDS(bucket) == 0)
 		{
-			*(output->buckets + i) = malloc((2 * sizeof(uint8_t)) + (output->cellen * new_tolerance));
-			if(*(output->buckets + i) == NULL)
+			continue;
+		}
+		// A block's reference count could overflow, so copy it instead:
+		if(__atomic_load_n(&CARRY_REFS(bucket), __ATOMIC_ACQUIRE) == UINT32_MAX)
+		{
+			void *copy = carry_block_alloc(output, CARRY_SIZE(bucket));
+			if(copy == NULL)
 			{
-				DEBUG_MSG("malloc failed while finalizing new carry_dict; lazy rehash was used, data is unrecoverable");
-				errno = ENOMEM;
+				DEBUG_MSG("unable to allocate bucket for clone");
 				octo_carry_free(output);
 				return NULL;
 			}
-			*((uint8_t *)*(output->buckets + i)) = 0;
-			*((uint8_t *)*(output->buckets + i) + 1) = new_tolerance;
+			memcpy(copy, bucket, carry_bucket_size(output, CARRY_SIZE(bucket)));
+			*(output->buckets + i) = copy;
+			continue;
 		}
+		__atomic_add_fetch(&CARRY_REFS(bucket), 1, __ATOMIC_ACQ_REL);
+		*(output->buckets + i) = bucket;
 	}
 	return output;
 }
 
-// Make a deep copy of a carry_dict. Return NULL on error, pointer to the new
-// dict on success.
+// Make a deep copy of a carry_dict, or a copy-on-write one if the dict has the
+// cow_clone option. Return NULL on error, pointer to the new dict on success.
 octo_dict_carry_t *octo_carry_clone(octo_dict_carry_t *dict)
 {
+	// Finish any rekey in progress, so only one table has to be copied:
+	if(carry_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
 	// Allocate the new dict and populate trivial fields:
 	octo_dict_carry_t *output = malloc(sizeof(*output));
 	if(output == NULL)
@@ -610,32 +1613,72 @@ octo_dict_carry_t *octo_carry_clone(octo_dict_carry_t *dict)
 	output->keylen = dict->keylen;
 	output->vallen = dict->vallen;
 	output->cellen = dict->cellen;
+	output->hashlen = dict->hashlen;
 	output->bucket_count = dict->bucket_count;
+	output->tolerance = dict->tolerance;
 	memcpy(output->master_key, dict->master_key, 16);
+	output->hash = dict->hash;
+	output->opt = dict->opt;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	output->touched = NULL;
+	output->touched_count = 0;
+	if(dict->opt.cow_clone)
+	{
+		return carry_clone_cow(dict, output);
+	}
 
-	// Allocate the new array of bucket pointers, initializing them to NULL:
-	void **buckets_tmp = calloc(output->bucket_count, sizeof(*buckets_tmp));
-	if(buckets_tmp == NULL)
+	// Allocate the new array of bucket pointers and an empty arena. Empty
+	// buckets aren't copied, so their pointers are left NULL:
+	output->buckets = calloc(output->bucket_count, sizeof(*output->buckets));
+	output->arena = carry_arena_init();
+	// Count the buckets of each size class, so every class gets a single chunk:
+	uint64_t *counts = calloc(dict->arena->class_count + 1, sizeof(*counts));
+	if(output->buckets == NULL || output->arena == NULL || counts == NULL)
 	{
-		DEBUG_MSG("unable to malloc for **buckets_tmp");
+		DEBUG_MSG("unable to malloc for bucket pointers or arena");
 		errno = ENOMEM;
-		free(output);
+		free(counts);
+		octo_carry_free(output);
 		return NULL;
 	}
-	output->buckets = buckets_tmp;
 	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		// Allocate the new bucket clone:
-		*(output->buckets + i) = malloc((2 * sizeof(uint8_t)) + (output->cellen * (*((uint8_t *)*(dict->buckets + i) + 1))));
-		if(*(output->buckets + i) == NULL)
+		const void *bucket = *(dict->buckets + i);
+		if(bucket != NULL && CARRY_RECORDS(bucket) != 0)
+		{
+			counts[carry_class(dict, CARRY_SIZE(bucket)) - dict->arena->classes]++;
+		}
+	}
+	for(size_t c = 0; c < dict->arena->class_count; c++)
+	{
+		if(counts[c] == 0)
+		{
+			continue;
+		}
+		carry_class_t *class = carry_class(output, dict->arena->classes[c].capacity);
+		if(class == NULL || carry_class_reserve(output, class, counts[c]) != 0)
 		{
-			DEBUG_MSG("unable to malloc for *(output->buckets + i)");
-			errno = ENOMEM;
+			DEBUG_MSG("unable to allocate bucket chunk for clone");
+			free(counts);
 			octo_carry_free(output);
 			return NULL;
 		}
-		// Copy the old bucket's contents:
-		memcpy(*(output->buckets + i), *(dict->buckets + i), (2 * sizeof(uint8_t)) + (output->cellen * (*((uint8_t *)*(dict->buckets + i) + 1))));
+	}
+	free(counts);
+	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	{
+		// Allocate the new bucket clone and copy the old bucket's contents:
+		const void *bucket = *(dict->buckets + i);
+		if(bucket == NULL || CARRY_RECORDS(bucket) == 0)
+		{
+			continue;
+		}
+		*(output->buckets + i) = carry_block_alloc(output, CARRY_SIZE(bucket));
+		memcpy(*(output->buckets + i), bucket, carry_bucket_size(output, CARRY_SIZE(bucket)));
 	}
 	return output;
 }
@@ -643,6 +1686,11 @@ octo_dict_carry_t *octo_carry_clone(octo_dict_carry_t *dict)
 // Populate and return a pointer to a octo_stat_carry_t on success, NULL on error.
 octo_stat_carry_t *octo_carry_stats(octo_dict_carry_t *dict)
 {
+	// Finish any rekey in progress, so only one table has to be counted:
+	if(carry_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
 	octo_stat_carry_t *output = calloc(1, sizeof(*output));
 	if(output == NULL)
 	{
@@ -652,7 +1700,7 @@ octo_stat_carry_t *octo_carry_stats(octo_dict_carry_t *dict)
 	}
 	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		switch(*((uint8_t *)*(dict->buckets + i)))
+		switch(*(dict->buckets + i) == NULL ? 0 : CARRY_RECORDS(*(dict->buckets + i)))
 		{
 		case 0:
 			output->empty_buckets++;
@@ -662,11 +1710,11 @@ octo_stat_carry_t *octo_carry_stats(octo_dict_carry_t *dict)
 			output->total_entries++;
 			break;
 		default:
-			output->total_entries += *((uint8_t *)*(dict->buckets + i));
+			output->total_entries += CARRY_RECORDS(*(dict->buckets + i));
 			output->colliding_buckets++;
-			if(*((uint8_t *)*(dict->buckets + i)) > output->max_bucket_elements)
+			if(CARRY_RECORDS(*(dict->buckets + i)) > output->max_bucket_elements)
 			{
-				output->max_bucket_elements = *((uint8_t *)*(dict->buckets + i));
+				output->max_bucket_elements = CARRY_RECORDS(*(dict->buckets + i));
 			}
 			break;
 		}
@@ -681,6 +1729,9 @@ octo_stat_carry_t *octo_carry_stats(octo_dict_carry_t *dict)
 		free(output);
 		return NULL;
 	}
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
 	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
 	return output;
 }
@@ -688,6 +1739,10 @@ octo_stat_carry_t *octo_carry_stats(octo_dict_carry_t *dict)
 // Print out a summary of octo_stat_carry_t for debugging purposes.
 void octo_carry_stats_msg(octo_dict_carry_t *dict)
 {
+	if(carry_migrate(dict, UINT64_MAX) != 0)
+	{
+		return;
+	}
 	octo_stat_carry_t *output = calloc(1, sizeof(*output));
 	if(output == NULL)
 	{
@@ -697,7 +1752,7 @@ void octo_carry_stats_msg(octo_dict_carry_t *dict)
 	}
 	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		switch(*((uint8_t *)*(dict->buckets + i)))
+		switch(*(dict->buckets + i) == NULL ? 0 : CARRY_RECORDS(*(dict->buckets + i)))
 		{
 		case 0:
 			output->empty_buckets++;
@@ -707,11 +1762,11 @@ void octo_carry_stats_msg(octo_dict_carry_t *dict)
 			output->total_entries++;
 			break;
 		default:
-			output->total_entries += *((uint8_t *)*(dict->buckets + i));
+			output->total_entries += CARRY_RECORDS(*(dict->buckets + i));
 			output->colliding_buckets++;
-			if(*((uint8_t *)*(dict->buckets + i)) > output->max_bucket_elements)
+			if(CARRY_RECORDS(*(dict->buckets + i)) > output->max_bucket_elements)
 			{
-				output->max_bucket_elements = *((uint8_t *)*(dict->buckets + i));
+				output->max_bucket_elements = CARRY_RECORDS(*(dict->buckets + i));
 			}
 			break;
 		}
@@ -726,6 +1781,9 @@ void octo_carry_stats_msg(octo_dict_carry_t *dict)
 		free(output);
 		return;
 	}
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
 	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
 	printf("######## libocto octo_dict_carry_t statistics summary ########\n");
 	printf("virtual address:%46llu\n", (unsigned long long)dict);
@@ -733,7 +1791,10 @@ void octo_carry_stats_msg(octo_dict_carry_t *dict)
 	printf("empty buckets:%48llu\n", (unsigned long long)output->empty_buckets);
 	printf("optimal buckets:%46llu\n", (unsigned long long)output->optimal_buckets);
 	printf("colliding buckets:%44llu\n", (unsigned long long)output->colliding_buckets);
-	printf("largest bucket:%47u\n", output->max_bucket_elements);
+	printf("largest bucket:%47llu\n", (unsigned long long)output->max_bucket_elements);
+	printf("flood events:%49llu\n", (unsigned long long)output->flood_events);
+	printf("fetch hits:%51llu\n", (unsigned long long)output->hits);
+	printf("hit depth:%52llu\n", (unsigned long long)output->hit_depth);
 	printf("load factor:%50Lf\n", output->load);
 	printf("##############################################################\n");
 	free(output);
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -12,8 +13,248 @@
 #include <octo/hash.h>
 #include <octo/cll.h>
 
-// Allocate memory for and initialize a cll_dict.
+#include "internal.h"
+
+// Node layout. Each node starts with the link to the next node in its chain,
+// or on the free list, followed by the record's cached hash(if enabled), and
+// then the record:
+#define CLL_CELL(n, dict) ((uint8_t *)(n) + (dict)->linklen)
+#define CLL_RECORD(n, dict) (CLL_CELL(n, dict) + (dict)->hashlen)
+
+// Nodes are carved out of slabs owned by the dict's arena, and deleted nodes
+// go on the arena's free list. A slab holds CLL_SLAB_NODES nodes, or fewer of
+// them(always a power of two) if that would make it larger than
+// CLL_SLAB_BYTES. With compact links, slabs are aligned to their size, which
+// is rounded up to a power of two, so the slab holding a node, and with it the
+// node's index, can be found from the node's address. Index 0 stands for no
+// node:
+#define CLL_SLAB_NODES 256
+#define CLL_SLAB_BYTES 65536
+
+typedef struct
+{
+	uint64_t number;
+	max_align_t nodes[];
+} cll_slab_t;
+
+struct octo_cll_arena_s
+{
+	// Number of tables linking nodes from the arena. A rekeying dict shares
+	// its arena with the old table, so nodes can move between them:
+	uint64_t refs;
+	size_t node_size;
+	size_t slab_size;
+	unsigned slab_shift;
+	cll_slab_t **slabs;
+	uint64_t slab_count;
+	uint64_t slab_capacity;
+	// Slabs handed out since the arena was last reset, and the nodes left in
+	// the last of them:
+	uint64_t slabs_used;
+	uint64_t nodes_left;
+	void *free_nodes;
+};
+
+// Allocate an empty arena for the nodes of a dict whose linklen and cellen are
+// set. Return NULL on failure.
+static struct octo_cll_arena_s *cll_arena_init(const octo_dict_cll_t *dict)
+{
+	if(dict->cellen > SIZE_MAX / 4)
+	{
+		DEBUG_MSG("size_t overflow, nodes are too large");
+		errno = EDOM;
+		return NULL;
+	}
+	struct octo_cll_arena_s *arena = malloc(sizeof(*arena));
+	if(arena == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating node arena");
+		errno = ENOMEM;
+		return NULL;
+	}
+	arena->refs = 1;
+	// Round nodes up so their links stay aligned:
+	arena->node_size = (dict->linklen + dict->cellen + dict->linklen - 1) & ~(dict->linklen - 1);
+	arena->slab_shift = 0;
+	while(((uint64_t)2 << arena->slab_shift) <= CLL_SLAB_NODES
+		&& offsetof(cll_slab_t, nodes) + (arena->node_size << (arena->slab_shift + 1)) <= CLL_SLAB_BYTES)
+	{
+		arena->slab_shift++;
+	}
+	arena->slab_size = offsetof(cll_slab_t, nodes) + (arena->node_size << arena->slab_shift);
+	if(dict->opt.compact_links)
+	{
+		size_t aligned = sizeof(max_align_t);
+		while(aligned < arena->slab_size)
+		{
+			aligned <<= 1;
+		}
+		arena->slab_size = aligned;
+	}
+	arena->slabs = NULL;
+	arena->slab_count = 0;
+	arena->slab_capacity = 0;
+	arena->slabs_used = 0;
+	arena->nodes_left = 0;
+	arena->free_nodes = NULL;
+	return arena;
+}
+
+// Free an arena and every node carved out of it.
+static void cll_arena_free(struct octo_cll_arena_s *arena)
+{
+	if(arena == NULL)
+	{
+		return;
+	}
+	for(uint64_t i = 0; i < arena->slab_count; i++)
+	{
+		free(arena->slabs[i]);
+	}
+	free(arena->slabs);
+	free(arena);
+	return;
+}
+
+// Give back every node of an arena at once, keeping its slabs for reuse.
+static void cll_arena_reset(struct octo_cll_arena_s *arena)
+{
+	arena->slabs_used = 0;
+	arena->nodes_left = 0;
+	arena->free_nodes = NULL;
+	return;
+}
+
+// Return the node with the given index, which must not be 0:
+static OCTO_ALWAYS_INLINE void *cll_node_at(const struct octo_cll_arena_s *arena, const uint32_t index)
+{
+	const uint64_t i = (uint64_t)index - 1;
+	const uint64_t slot = i & (((uint64_t)1 << arena->slab_shift) - 1);
+	return (uint8_t *)arena->slabs[i >> arena->slab_shift]->nodes + (slot * arena->node_size);
+}
+
+// Return the index of a node in an arena with compact links:
+static OCTO_ALWAYS_INLINE uint32_t cll_node_index(const struct octo_cll_arena_s *arena, const void *node)
+{
+	const cll_slab_t *slab = (const cll_slab_t *)((uintptr_t)node & ~(uintptr_t)(arena->slab_size - 1));
+	const uint64_t slot = (uint64_t)((const uint8_t *)node - (const uint8_t *)slab->nodes) / arena->node_size;
+	return (uint32_t)((slab->number << arena->slab_shift) + slot + 1);
+}
+
+// Return the node linked after a node, or NULL at the end of the chain:
+static OCTO_ALWAYS_INLINE void *cll_next(const octo_dict_cll_t *dict, const void *node)
+{
+	if(dict->opt.compact_links)
+	{
+		const uint32_t index = *((const uint32_t *)node);
+		return index == 0 ? NULL : cll_node_at(dict->arena, index);
+	}
+	return *((void *const *)node);
+}
+
+// Link next, which may be NULL, after a node:
+static OCTO_ALWAYS_INLINE void cll_set_next(const octo_dict_cll_t *dict, void *node, const void *next)
+{
+	if(dict->opt.compact_links)
+	{
+		*((uint32_t *)node) = next == NULL ? 0 : cll_node_index(dict->arena, next);
+		return;
+	}
+	*((const void **)node) = next;
+	return;
+}
+
+// Point whatever links to a node, the bucket head if prev is NULL and prev's
+// link otherwise, at next:
+static OCTO_ALWAYS_INLINE void cll_relink(const octo_dict_cll_t *dict, void **head, void *prev, void *next)
+{
+	if(prev == NULL)
+	{
+		*head = next;
+		return;
+	}
+	cll_set_next(dict, prev, next);
+	return;
+}
+
+// Add a slab to the arena. Return 0 on success, 1 on malloc failure or if
+// compact links can't index the slab's nodes.
+static int cll_slab_add(const octo_dict_cll_t *dict)
+{
+	struct octo_cll_arena_s *arena = dict->arena;
+	if(dict->opt.compact_links && ((arena->slab_count + 1) << arena->slab_shift) > UINT32_MAX)
+	{
+		DEBUG_MSG("compact links can't index any more nodes");
+		errno = ENOMEM;
+		return 1;
+	}
+	if(arena->slab_count == arena->slab_capacity)
+	{
+		const uint64_t capacity = arena->slab_capacity != 0 ? arena->slab_capacity * 2 : 8;
+		cll_slab_t **slabs = realloc(arena->slabs, sizeof(*slabs) * capacity);
+		if(slabs == NULL)
+		{
+			DEBUG_MSG("realloc failed growing slab array");
+			errno = ENOMEM;
+			return 1;
+		}
+		arena->slabs = slabs;
+		arena->slab_capacity = capacity;
+	}
+	cll_slab_t *slab = dict->opt.compact_links ? aligned_alloc(arena->slab_size, arena->slab_size) : malloc(arena->slab_size);
+	if(slab == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating node slab");
+		errno = ENOMEM;
+		return 1;
+	}
+	slab->number = arena->slab_count;
+	arena->slabs[arena->slab_count] = slab;
+	arena->slab_count++;
+	return 0;
+}
+
+// Take a node from the arena, reusing a deleted one if there is one. Return
+// NULL on failure.
+static void *cll_node_alloc(const octo_dict_cll_t *dict)
+{
+	struct octo_cll_arena_s *arena = dict->arena;
+	void *node = arena->free_nodes;
+	if(node != NULL)
+	{
+		arena->free_nodes = cll_next(dict, node);
+		return node;
+	}
+	if(arena->nodes_left == 0)
+	{
+		if(arena->slabs_used == arena->slab_count && cll_slab_add(dict) != 0)
+		{
+			return NULL;
+		}
+		arena->slabs_used++;
+		arena->nodes_left = (uint64_t)1 << arena->slab_shift;
+	}
+	const uint64_t slot = ((uint64_t)1 << arena->slab_shift) - arena->nodes_left;
+	arena->nodes_left--;
+	return (uint8_t *)arena->slabs[arena->slabs_used - 1]->nodes + (slot * arena->node_size);
+}
+
+// Put a deleted node on the arena's free list.
+static void cll_node_release(const octo_dict_cll_t *dict, void *node)
+{
+	cll_set_next(dict, node, dict->arena->free_nodes);
+	dict->arena->free_nodes = node;
+	return;
+}
+
+// Allocate memory for and initialize a cll_dict with the default options.
 octo_dict_cll_t *octo_cll_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key)
+{
+	return octo_cll_init_opt(init_keylen, init_vallen, init_buckets, init_master_key, NULL);
+}
+
+// Allocate memory for and initialize a cll_dict with the options in *init_opt.
+octo_dict_cll_t *octo_cll_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key, const octo_opt_t *init_opt)
 {
 	// Make sure the arguments are valid:
 	if(init_keylen <= 0)
@@ -31,21 +272,51 @@ octo_dict_cll_t *octo_cll_init(const size_t init_keylen, const size_t init_valle
 
 	// Allocate the new dict and populate the trivial fields:
 	octo_dict_cll_t *output = malloc(sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating *output");
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(init_opt != NULL)
+	{
+		output->opt = *init_opt;
+	}
+	else
+	{
+		memset(&output->opt, 0, sizeof(output->opt));
+	}
+	const uint64_t bucket_count = octo_index_buckets(output->opt.index_mode, init_buckets);
+	if(bucket_count == 0)
+	{
+		DEBUG_MSG("unknown index mode, or init_buckets too large for it");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
+	if(output->opt.reorder != OCTO_REORDER_NONE && output->opt.reorder != OCTO_REORDER_MTF && output->opt.reorder != OCTO_REORDER_TRANSPOSE)
+	{
+		DEBUG_MSG("unknown reorder policy");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
 	output->keylen = init_keylen;
 	output->vallen = init_vallen;
-	const size_t cellen_tmp = init_keylen + init_vallen;
-	if(cellen_tmp < init_keylen)
+	output->hashlen = OCTO_HASHLEN(output->opt);
+	if(init_keylen > SIZE_MAX - output->hashlen || init_vallen > SIZE_MAX - output->hashlen - init_keylen)
 	{
 		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
 		errno = EDOM;
 		free(output);
 		return NULL;
 	}
-	output->cellen = cellen_tmp;
+	output->cellen = output->hashlen + init_keylen + init_vallen;
+	output->linklen = output->opt.compact_links ? sizeof(uint32_t) : sizeof(void *);
 
 	// Allocate the array of bucket pointers. Bucket slots are left
 	// unalloc'd in cll_dicts, so use calloc here:
-	void **buckets_tmp = calloc(init_buckets, sizeof(*buckets_tmp));
+	void **buckets_tmp = calloc(bucket_count, sizeof(*buckets_tmp));
 	if(buckets_tmp == NULL)
 	{
 		DEBUG_MSG("unable to allocate bucket pointer array");
@@ -53,427 +324,827 @@ octo_dict_cll_t *octo_cll_init(const size_t init_keylen, const size_t init_valle
 		free(output);
 		return NULL;
 	}
-	output->bucket_count = init_buckets;
+	output->arena = cll_arena_init(output);
+	if(output->arena == NULL)
+	{
+		free(buckets_tmp);
+		free(output);
+		return NULL;
+	}
+	output->bucket_count = bucket_count;
 	output->buckets = buckets_tmp;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = 0;
+	output->hits = 0;
+	output->hit_depth = 0;
+	output->touched = NULL;
+	output->touched_count = 0;
 	memcpy(output->master_key, init_master_key, 16);
+	output->hash = octo_hash_select(output->opt.hash, init_keylen);
 	return output;
 }
 
-// Delete a cll_dict.
+// Give the nodes of one chain of a cll_dict back to the arena, leaving the
+// bucket empty.
+static void cll_clear_bucket(octo_dict_cll_t *dict, const uint64_t index)
+{
+	void *this = *(dict->buckets + index);
+	while(this != NULL)
+	{
+		void *next = cll_next(dict, this);
+		cll_node_release(dict, this);
+		this = next;
+	}
+	*(dict->buckets + index) = NULL;
+	return;
+}
+
+// Delete a cll_dict. Its nodes are freed a slab at a time.
 void octo_cll_free(octo_dict_cll_t *target)
 {
-	void *this = NULL;
-	void *next = NULL;
-	for(uint64_t i = 0; i < target->bucket_count; i++)
+	if(target->old != NULL)
+	{
+		octo_cll_free(target->old);
+	}
+	if(target->arena->refs > 1)
+	{
+		// The table sharing the arena still links nodes from it, so only
+		// give back this table's nodes:
+		for(uint64_t i = 0; i < target->bucket_count; i++)
+		{
+			cll_clear_bucket(target, i);
+		}
+		target->arena->refs--;
+	}
+	else
+	{
+		cll_arena_free(target->arena);
+	}
+	free(target->buckets);
+	free(target->touched);
+	free(target);
+	return;
+}
+
+// Remove every record from a cll_dict. Only the buckets that have been used
+// are visited if the dict keeps track of them.
+void octo_cll_clear(octo_dict_cll_t *dict)
+{
+	if(dict->old != NULL)
+	{
+		octo_cll_free(dict->old);
+		dict->old = NULL;
+		dict->migrated = 0;
+	}
+	if(dict->touched != NULL && dict->touched_count < dict->bucket_count)
+	{
+		for(uint64_t i = 0; i < dict->touched_count; i++)
+		{
+			*(dict->buckets + dict->touched[i]) = NULL;
+		}
+	}
+	else
+	{
+		memset(dict->buckets, 0, sizeof(*dict->buckets) * dict->bucket_count);
+	}
+	// No other table links nodes from the arena any more, so they can all be
+	// given back at once:
+	cll_arena_reset(dict->arena);
+	dict->touched_count = 0;
+	return;
+}
+
+// Check whether the node holds the given key. With cached hashes, only compare
+// keys whose hashes match:
+static OCTO_ALWAYS_INLINE bool cll_match(const octo_dict_cll_t *dict, const void *node, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->hashlen != 0 && octo_hash_load(CLL_CELL(node, dict)) != hash)
+	{
+		return false;
+	}
+	return octo_key_equal(CLL_RECORD(node, dict), key, parts);
+}
+
+static int cll_insert_fallback(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+static int cll_insert_rekey(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+
+// Insert a record with the given key hash. Return values are as for octo_cll_insert.
+static OCTO_ALWAYS_INLINE int cll_insert(const octo_dict_cll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	const uint64_t index = octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+
+	// Check to see if the key is already in the bucket:
+	uint64_t chain_len = 0;
+	for(void *this = *(dict->buckets + index); this != NULL; this = cll_next(dict, this))
+	{
+		if(cll_match(dict, this, hash, key, parts))
+		{
+			memcpy(CLL_RECORD(this, dict) + dict->keylen, value, dict->vallen);
+			return 0;
+		}
+		chain_len++;
+	}
+
+	// A long chain suggests a collision attack. Nothing is done about it while
+	// an earlier rekey is still being migrated:
+	if(dict->old == NULL)
+	{
+		if(octo_hw_flooded(&dict->opt, chain_len))
+		{
+			return cll_insert_fallback(dict, key, parts, value);
+		}
+		if(octo_rekey_due(&dict->opt, chain_len))
+		{
+			return cll_insert_rekey(dict, key, parts, value);
+		}
+	}
+
+	// Nope, insert at the head of the chain:
+	void *tmp = cll_node_alloc(dict);
+	if(tmp == NULL)
+	{
+		DEBUG_MSG("unable to allocate new node");
+		return 1;
+	}
+	if(*(dict->buckets + index) == NULL)
+	{
+		octo_touch(dict->touched, &((octo_dict_cll_t *)dict)->touched_count, dict->bucket_count, index);
+	}
+	cll_set_next(dict, tmp, *(dict->buckets + index));
+	if(dict->hashlen != 0)
+	{
+		octo_hash_store(CLL_CELL(tmp, dict), hash);
+	}
+	octo_key_copy(CLL_RECORD(tmp, dict), key, parts);
+	memcpy(CLL_RECORD(tmp, dict) + dict->keylen, value, dict->vallen);
+	*(dict->buckets + index) = tmp;
+	return 0;
+}
+
+// Find the record with the given key in the chain starting at *head. Return a
+// pointer to the record, or NULL if it isn't in the chain.
+static OCTO_ALWAYS_INLINE uint8_t *cll_find(const octo_dict_cll_t *dict, void *head, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	for(void *this = head; this != NULL; this = cll_next(dict, this))
+	{
+		if(cll_match(dict, this, hash, key, parts))
+		{
+			return CLL_RECORD(this, dict);
+		}
+	}
+	return NULL;
+}
+
+// Move up to count buckets of the table being drained by a rekey into the
+// current one, and free it once it's empty. Both tables share an arena, so
+// nodes are relinked rather than copied, and this can't fail; 0 is returned to
+// match the other strategies.
+static int cll_migrate(octo_dict_cll_t *dict, uint64_t count)
+{
+	octo_dict_cll_t *old = dict->old;
+	if(old == NULL)
+	{
+		return 0;
+	}
+	for(; count > 0 && dict->migrated < old->bucket_count; count--)
+	{
+		void **link = old->buckets + dict->migrated;
+		while(*link != NULL)
+		{
+			void *this = *link;
+			*link = cll_next(old, this);
+			uint64_t hash;
+			dict->hash(CLL_RECORD(this, dict), dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+			if(dict->hashlen != 0)
+			{
+				octo_hash_store(CLL_CELL(this, dict), hash);
+			}
+			const uint64_t index = octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+			void **head = dict->buckets + index;
+			if(*head == NULL)
+			{
+				octo_touch(dict->touched, &dict->touched_count, dict->bucket_count, index);
+			}
+			cll_set_next(dict, this, *head);
+			*head = this;
+		}
+		dict->migrated++;
+	}
+	if(dict->migrated == old->bucket_count)
+	{
+		octo_cll_free(old);
+		dict->old = NULL;
+		dict->migrated = 0;
+	}
+	return 0;
+}
+
+// Find the chain of the old table that would hold a key during a rekey.
+// Return NULL if the key parts couldn't be gathered.
+static void **cll_old_link(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	const octo_dict_cll_t *old = dict->old;
+	if(octo_hash_parts(old->hash, old->opt.hash, key, parts, old->master_key, hash) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return NULL;
+	}
+	return old->buckets + octo_index(old->opt.index_mode, *hash, old->bucket_count);
+}
+
+// Insert a record while a rekey is in progress. A key that hasn't been moved
+// yet is updated in the old table, so it's never in both.
+static int cll_insert_rekeying(const octo_dict_cll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	uint64_t old_hash;
+	void **old_link = cll_old_link(dict, key, parts, &old_hash);
+	if(old_link == NULL)
+	{
+		return 1;
+	}
+	int ret = 0;
+	uint8_t *record = cll_find(dict->old, *old_link, old_hash, key, parts);
+	if(record != NULL)
+	{
+		memcpy(record + dict->keylen, value, dict->vallen);
+	}
+	else
+	{
+		ret = cll_insert(dict, hash, key, parts, value);
+	}
+	cll_migrate((octo_dict_cll_t *)dict, octo_rekey_step(&dict->opt));
+	return ret;
+}
+
+// Insert a record with the given key hash, minding a rekey in progress.
+static OCTO_ALWAYS_INLINE int cll_put(const octo_dict_cll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	if(dict->old != NULL)
+	{
+		return cll_insert_rekeying(dict, hash, key, parts, value);
+	}
+	return cll_insert(dict, hash, key, parts, value);
+}
+
+// Find the record with the given key in the chain starting at *head, in table,
+// which is dict or the old table it is draining. Count the hit and move its
+// node toward the head as the dict's options ask. Return values are as for
+// cll_find.
+static OCTO_ALWAYS_INLINE uint8_t *cll_find_hit(const octo_dict_cll_t *dict, const octo_dict_cll_t *table, void **head, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	// The node before this one, and the one before that:
+	void *prev = NULL;
+	void *prev2 = NULL;
+	uint64_t depth = 0;
+	for(void *this = *head; this != NULL; prev2 = prev, prev = this, this = cll_next(table, this), depth++)
+	{
+		if(!cll_match(table, this, hash, key, parts))
+		{
+			continue;
+		}
+		if(dict->opt.count_hits)
+		{
+			((octo_dict_cll_t *)dict)->hits++;
+			((octo_dict_cll_t *)dict)->hit_depth += depth;
+		}
+		if(depth != 0 && dict->opt.reorder != OCTO_REORDER_NONE)
+		{
+			// Unlink the node, then relink it at the head or ahead of its predecessor:
+			cll_set_next(table, prev, cll_next(table, this));
+			if(dict->opt.reorder == OCTO_REORDER_MTF)
+			{
+				cll_set_next(table, this, *head);
+				*head = this;
+			}
+			else
+			{
+				cll_set_next(table, this, prev);
+				cll_relink(table, head, prev2, this);
+			}
+		}
+		return CLL_RECORD(this, table);
+	}
+	return NULL;
+}
+
+// Look for a key in the old table during a rekey:
+static uint8_t *cll_lookup_old(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts)
+{
+	uint64_t old_hash;
+	void **old_link = cll_old_link(dict, key, parts, &old_hash);
+	return old_link == NULL ? NULL : cll_find_hit(dict, dict->old, old_link, old_hash, key, parts);
+}
+
+// Find the record with the given key hash. Return a pointer to the record, or
+// NULL if it isn't in the dict.
+static OCTO_ALWAYS_INLINE uint8_t *cll_lookup(const octo_dict_cll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	uint8_t *record = cll_find_hit(dict, dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+	if(record == NULL && dict->old != NULL)
+	{
+		record = cll_lookup_old(dict, key, parts);
+	}
+	return record;
+}
+
+// Copy the value of a found record into a dedicated heap block.
+static void *cll_copy_value(const octo_dict_cll_t *dict, const uint8_t *record)
+{
+	void *output = malloc(dict->vallen);
+	if(output == NULL)
+	{
+		DEBUG_MSG("lookup successful but malloc failed");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(output, record + dict->keylen, dict->vallen);
+	return output;
+}
+
+// Delete the record with the given key from the chain starting at *head.
+// Return values are as for octo_cll_delete.
+static OCTO_ALWAYS_INLINE int cll_remove(const octo_dict_cll_t *dict, void **head, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	void *prev = NULL;
+	for(void *this = *head; this != NULL; prev = this, this = cll_next(dict, this))
+	{
+		if(cll_match(dict, this, hash, key, parts))
+		{
+			cll_relink(dict, head, prev, cll_next(dict, this));
+			cll_node_release(dict, this);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Delete a record while a rekey is in progress, from whichever table holds it.
+static int cll_delete_rekeying(const octo_dict_cll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	int deleted = cll_remove(dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+	if(!deleted)
+	{
+		uint64_t old_hash;
+		void **old_link = cll_old_link(dict, key, parts, &old_hash);
+		deleted = old_link != NULL && cll_remove(dict->old, old_link, old_hash, key, parts);
+	}
+	cll_migrate((octo_dict_cll_t *)dict, octo_rekey_step(&dict->opt));
+	return deleted;
+}
+
+// Delete the record with the given key hash. Return values are as for octo_cll_delete.
+static OCTO_ALWAYS_INLINE int cll_delete(const octo_dict_cll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->old != NULL)
+	{
+		return cll_delete_rekeying(dict, hash, key, parts);
+	}
+	return cll_remove(dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+}
+
+// Hash a flat key for a cll_dict:
+static OCTO_ALWAYS_INLINE uint64_t cll_hash(const octo_dict_cll_t *dict, const void *key)
+{
+	uint64_t hash;
+	dict->hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+	return hash;
+}
+
+// Hash a key given in parts for a cll_dict. Return 0 on success, 1 if the
+// parts don't add up to the dict's key length or hashing them failed.
+static int cll_hash_iov(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	if(octo_key_length(key, parts) != dict->keylen)
+	{
+		DEBUG_MSG("key parts don't add up to the key length");
+		errno = EINVAL;
+		return 1;
+	}
+	if(octo_hash_iov(octo_iov_base(dict->hash, dict->opt.hash), key, parts, (uint8_t *)hash, (const uint8_t *)dict->master_key) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return 1;
+	}
+	return 0;
+}
+
+// Insert a value into a cll_dict. Return 0 on success, 1 on malloc failure.
+int octo_cll_insert(const void *key, const void *value, const octo_dict_cll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return cll_put(dict, cll_hash(dict, key), &flat, 1, value);
+}
+
+// Fetch a value from a cll_dict. Return NULL on error, return a pointer to
+// the cll_dict itself if the value is not found. The pointer refers to the
+// literal location of the value; if you don't want that, use *fetch_safe.
+void *octo_cll_fetch(const void *key, const octo_dict_cll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *record = cll_lookup(dict, cll_hash(dict, key), &flat, 1);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Fetch a value from a cll_dict. Return NULL on error, return a pointer to
+// the cll_dict itself if the value is not found.
+void *octo_cll_fetch_safe(const void *key, const octo_dict_cll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *record = cll_lookup(dict, cll_hash(dict, key), &flat, 1);
+	return record == NULL ? (void *)dict : cll_copy_value(dict, record);
+}
+
+// Like octo_cll_fetch, but don't malloc/memcpy the value.
+// Return 1 if found, 0 if not.
+int octo_cll_poke(const void *key, const octo_dict_cll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return cll_lookup(dict, cll_hash(dict, key), &flat, 1) != NULL;
+}
+
+// Delete the record with the given key. Return 1 on successful delete,
+// 0 if the record isn't found.
+int octo_cll_delete(const void *key, const octo_dict_cll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return cll_delete(dict, cll_hash(dict, key), &flat, 1);
+}
+
+// Like octo_cll_insert, but the key is given in parts that add up to keylen.
+int octo_cll_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_cll_t *dict)
+{
+	uint64_t hash;
+	if(cll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return 1;
+	}
+	return cll_put(dict, hash, key, parts, value);
+}
+
+// Like octo_cll_fetch, but the key is given in parts that add up to keylen.
+void *octo_cll_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict)
+{
+	uint64_t hash;
+	if(cll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return NULL;
+	}
+	uint8_t *record = cll_lookup(dict, hash, key, parts);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Like octo_cll_fetch_safe, but the key is given in parts that add up to keylen.
+void *octo_cll_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict)
+{
+	uint64_t hash;
+	if(cll_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		if(*(target->buckets + i) == NULL)
-		{
-			continue;
-		}
-		this = *(target->buckets + i);
-		while(this != NULL)
-		{
-			next = *((void **)this);
-			free(this);
-			this = next;
-		}
+		return NULL;
 	}
-	free(target->buckets);
-	free(target);
-	return;
+	uint8_t *record = cll_lookup(dict, hash, key, parts);
+	return record == NULL ? (void *)dict : cll_copy_value(dict, record);
 }
 
-// Insert a value into a cll_dict. Return 0 on success, 1 on malloc failure.
-int octo_cll_insert(const void *key, const void *value, const octo_dict_cll_t *dict)
+// Like octo_cll_poke, but the key is given in parts that add up to keylen.
+int octo_cll_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	void *tmp;
-
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-
-	// If there's nothing in the bucket yet, insert the record:
-	if(*(dict->buckets + index) == NULL)
+	if(cll_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		tmp = malloc(sizeof(void *) + dict->cellen);
-		if(tmp == NULL)
-		{
-			DEBUG_MSG("unable to malloc new bucket");
-			errno = ENOMEM;
-			return 1;
-		}
-		*((void **)tmp) = NULL;
-		memcpy((uint8_t *)tmp + sizeof(void *), key, dict->keylen);
-		memcpy((uint8_t *)tmp + sizeof(void *) + dict->keylen, value, dict->vallen);
-		*(dict->buckets + index) = tmp;
 		return 0;
 	}
+	return cll_lookup(dict, hash, key, parts) != NULL;
+}
 
-	// Check to see if the key is already in the bucket:
-	void *this = *(dict->buckets + index);
-	void *next = NULL;
-	void *old_head = this;
-	while(this != NULL)
+// Like octo_cll_delete, but the key is given in parts that add up to keylen.
+int octo_cll_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_cll_t *dict)
+{
+	uint64_t hash;
+	if(cll_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		next = *((void **)this);
-		if(memcmp(key, (uint8_t *)this + sizeof(void *), dict->keylen) == 0)
-		{
-			memcpy((uint8_t *)this + sizeof(void *) + dict->keylen, value, dict->vallen);
-			return 0;
-		}
-		this = next;
+		return 0;
 	}
+	return cll_delete(dict, hash, key, parts);
+}
 
-	// Nope, insert at the head of the chain:
-	tmp = malloc(sizeof(void *) + dict->cellen);
-	if(tmp == NULL)
+// Hash a key handle for a cll_dict. Return 0 on success, 1 if the handle's
+// key length doesn't match the dict's.
+static OCTO_ALWAYS_INLINE int cll_hash_h(const octo_dict_cll_t *dict, const octo_key_t *key, uint64_t *hash)
+{
+	if(octo_key_hash(key, dict->keylen, dict->hash, dict->master_key, hash) != 0)
 	{
-		DEBUG_MSG("unable to malloc new bucket");
-		errno = ENOMEM;
+		DEBUG_MSG("key handle length doesn't match the key length");
+		errno = EINVAL;
 		return 1;
 	}
-	*((void **)tmp) = old_head;
-	memcpy((uint8_t *)tmp + sizeof(void *), key, dict->keylen);
-	memcpy((uint8_t *)tmp + sizeof(void *) + dict->keylen, value, dict->vallen);
-	*(dict->buckets + index) = tmp;
 	return 0;
 }
 
-// Fetch a value from a cll_dict. Return NULL on error, return a pointer to
-// the cll_dict itself if the value is not found. The pointer referes to the
-// literal location of the record. If you don't want that, use *fetch_safe.
-void *octo_cll_fetch(const void *key, const octo_dict_cll_t *dict)
+// Fill in a key handle for use with this dict, or any other dict sharing its
+// key length, hash function and master key.
+void octo_cll_key(octo_key_t *handle, const void *key, const octo_dict_cll_t *dict)
 {
-	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*(dict->buckets + index) == NULL)
-	{
-		return (void *)dict;
-	}
+	octo_key_init(handle, key, dict->keylen, dict->opt.hash, dict->master_key);
+	return;
+}
 
-	void *this = *(dict->buckets + index);
-	void *next = NULL;
-	while(this != NULL)
+// Like octo_cll_insert, but take a key handle.
+int octo_cll_insert_h(const octo_key_t *key, const void *value, const octo_dict_cll_t *dict)
+{
+	uint64_t hash;
+	if(cll_hash_h(dict, key, &hash) != 0)
 	{
-		next = *((void **)this);
-		if(memcmp(key, (uint8_t *)this + sizeof(void *), dict->keylen) == 0)
-		{
-			return (uint8_t *)this + sizeof(void *) + dict->keylen;
-		}
-		this = next;
+		return 1;
 	}
-	return (void *)dict;
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return cll_put(dict, hash, &flat, 1, value);
 }
 
-// Fetch a value from a cll_dict. Return NULL on error, return a pointer to
-// the cll_dict itself if the value is not found.
-void *octo_cll_fetch_safe(const void *key, const octo_dict_cll_t *dict)
+// Like octo_cll_fetch, but take a key handle.
+void *octo_cll_fetch_h(const octo_key_t *key, const octo_dict_cll_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*(dict->buckets + index) == NULL)
+	if(cll_hash_h(dict, key, &hash) != 0)
 	{
-		return (void *)dict;
+		return NULL;
 	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *record = cll_lookup(dict, hash, &flat, 1);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
 
-	void *this = *(dict->buckets + index);
-	void *next = NULL;
-	while(this != NULL)
+// Like octo_cll_fetch_safe, but take a key handle.
+void *octo_cll_fetch_safe_h(const octo_key_t *key, const octo_dict_cll_t *dict)
+{
+	uint64_t hash;
+	if(cll_hash_h(dict, key, &hash) != 0)
 	{
-		next = *((void **)this);
-		if(memcmp(key, (uint8_t *)this + sizeof(void *), dict->keylen) == 0)
-		{
-			void *output = malloc(dict->vallen);
-			if(output == NULL)
-			{
-				DEBUG_MSG("lookup successful but malloc failed");
-				errno = ENOMEM;
-				return NULL;
-			}
-			memcpy(output, (uint8_t *)this + sizeof(void *) + dict->keylen, dict->vallen);
-			return output;
-		}
-		this = next;
+		return NULL;
 	}
-	return (void *)dict;
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *record = cll_lookup(dict, hash, &flat, 1);
+	return record == NULL ? (void *)dict : cll_copy_value(dict, record);
 }
 
-// Like octo_cll_fetch, but don't malloc/memcpy the value.
-// Return 1 if found, 0 if not.
-int octo_cll_poke(const void *key, const octo_dict_cll_t *dict)
+// Like octo_cll_poke, but take a key handle.
+int octo_cll_poke_h(const octo_key_t *key, const octo_dict_cll_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*(dict->buckets + index) == NULL)
+	if(cll_hash_h(dict, key, &hash) != 0)
 	{
 		return 0;
 	}
-
-	void *this = *(dict->buckets + index);
-	void *next = NULL;
-	while(this != NULL)
-	{
-		next = *((void **)this);
-		if(memcmp(key, (uint8_t *)this + sizeof(void *), dict->keylen) == 0)
-		{
-			return 1;
-		}
-		this = next;
-	}
-	return 0;
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return cll_lookup(dict, hash, &flat, 1) != NULL;
 }
 
-// Delete the record with the given key. Return 1 on successful delete,
-// 0 if the record isn't found.
-int octo_cll_delete(const void *key, const octo_dict_cll_t *dict)
+// Like octo_cll_delete, but take a key handle.
+int octo_cll_delete_h(const octo_key_t *key, const octo_dict_cll_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-
-	// If there's nothing in the bucket, the value isn't in the dict:
-	if(*(dict->buckets + index) == NULL)
+	if(cll_hash_h(dict, key, &hash) != 0)
 	{
 		return 0;
 	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return cll_delete(dict, hash, &flat, 1);
+}
 
-	void *this = *(dict->buckets + index);
-	void *next = NULL;
-	void *prev = NULL;
-	while (this != NULL)
+// Move every node of *dict onto its chain in *output, which must have the same
+// record layout, then free the old dict. output takes over the old arena, so
+// nothing is allocated or copied and this can't fail.
+static octo_dict_cll_t *cll_rehash_relink(octo_dict_cll_t *dict, octo_dict_cll_t *output)
+{
+	// Cached hashes are still valid if the hash function and master key are unchanged:
+	const int reuse_hash = dict->hashlen != 0 && dict->hash == output->hash && memcmp(dict->master_key, output->master_key, 16) == 0;
+	cll_arena_free(output->arena);
+	output->arena = dict->arena;
+	output->arena->refs++;
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		next = *((void **)this);
-		if(memcmp(key, (uint8_t *)this + sizeof(void *), dict->keylen) == 0)
+		void **link = dict->buckets + i;
+		while(*link != NULL)
 		{
-			free(this);
-			if(next == NULL)
+			void *this = *link;
+			*link = cll_next(dict, this);
+			uint64_t hash;
+			if(reuse_hash)
 			{
-				if(prev == NULL)
-				{
-					*(dict->buckets + index) = NULL;
-				}
-				else
-				{
-					*((void **)prev) = NULL;
-				}
+				hash = octo_hash_load(CLL_CELL(this, dict));
 			}
 			else
 			{
-				if(prev == NULL)
-				{
-					*(dict->buckets + index) = next;
-				}
-				else
+				output->hash(CLL_RECORD(this, output), output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
+				if(output->hashlen != 0)
 				{
-					*((void **)prev) = next;
+					octo_hash_store(CLL_CELL(this, output), hash);
 				}
 			}
-			return 1;
+			void **head = output->buckets + octo_index(output->opt.index_mode, hash, output->bucket_count);
+			cll_set_next(output, this, *head);
+			*head = this;
 		}
-		prev = this;
-		this = next;
 	}
-	return 0;
+	// Every chain of the old dict is empty, so this only drops its reference to the arena:
+	octo_cll_free(dict);
+	return output;
 }
 
-// Re-create the cll_dict with a new key length, value length(both will be truncated), number of buckets,
-// and/or new master_key. Return pointer to new cll_dict on success, NULL on failure.
-octo_dict_cll_t *octo_cll_rehash(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+// Build a new cll_dict from the records in *dict. If keep is zero, the old
+// dict is freed once its records are moved.
+static octo_dict_cll_t *cll_rehash(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key, const int keep)
 {
-	// Make sure the arguments are valid:
-	if(new_keylen <= 0)
-	{
-		DEBUG_MSG("key length must not be zero");
-		errno = EINVAL;
-		return NULL;
-	}
-	if(new_buckets <= 0)
-	{
-		DEBUG_MSG("init_buckets must not be zero");
-		errno = EINVAL;
-		return NULL;
-	}
-
-	// Allocate the new dict and populate trivial fields:
-	octo_dict_cll_t *output = malloc(sizeof(*output));
+	// Finish any rekey in progress, so every record is in the current table:
+	cll_migrate(dict, UINT64_MAX);
+	// Allocate the new dict with the same options; this validates the arguments:
+	octo_dict_cll_t *output = octo_cll_init_opt(new_keylen, new_vallen, new_buckets, new_master_key, &dict->opt);
 	if(output == NULL)
 	{
-		DEBUG_MSG("malloc failed allocating *output");
-		errno = ENOMEM;
 		return NULL;
 	}
-	output->keylen = new_keylen;
-	output->vallen = new_vallen;
-	const size_t new_cellen = new_keylen + new_vallen;
-	if(new_cellen < new_keylen)
+	// Nodes keep their layout if the key and value lengths are unchanged, so
+	// they can be relinked instead of copied when the old dict isn't kept:
+	if(!keep && output->keylen == dict->keylen && output->vallen == dict->vallen)
 	{
-		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
-		errno = EDOM;
-		free(output);
-		return NULL;
+		return cll_rehash_relink(dict, output);
 	}
-	output->cellen = new_cellen;
-	output->bucket_count = new_buckets;
-	memcpy(output->master_key, new_master_key, 16);
 	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
 	void *key_buffer = calloc(1, output->keylen);
-	void *val_buffer = calloc(1, output->vallen);
+	void *val_buffer = calloc(1, output->vallen + 1);
 	if(key_buffer == NULL || val_buffer == NULL)
 	{
 		DEBUG_MSG("malloc failed while allocating key/val buffer");
 		errno = ENOMEM;
+		free(key_buffer);
+		free(val_buffer);
 		octo_cll_free(output);
 		return NULL;
 	}
-	size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
-	size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
-
-	// Allocate the new array of bucket pointers, initializing them to NULL:
-	void **buckets_tmp = calloc(new_buckets, sizeof(*buckets_tmp));
-	if(buckets_tmp == NULL)
-	{
-		DEBUG_MSG("unable to malloc for **buckets_tmp");
-		errno = ENOMEM;
-		free(output);
-		return NULL;
-	}
-	output->buckets = buckets_tmp;
-	void *this = NULL;
-	void *next = NULL;
+	const size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
+	const size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
+	// Cached hashes are still valid if the key, hash function, and master key are unchanged:
+	const int reuse_hash = dict->hashlen != 0 && dict->keylen == output->keylen && dict->hash == output->hash
+		&& memcmp(dict->master_key, output->master_key, 16) == 0;
+	const octo_iov_t flat = {key_buffer, output->keylen};
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	uint64_t hash;
+	int failed = 0;
 	// There's no pre-allocation to do, so simply find every key/val
 	// in the dict and insert:
-	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	for(uint64_t i = 0; i < dict->bucket_count && failed == 0; i++)
 	{
-		if(*(dict->buckets + i) == NULL)
+		for(void *this = *(dict->buckets + i); this != NULL && failed == 0; this = cll_next(dict, this))
 		{
-			continue;
-		}
-		this = *(dict->buckets + i);
-		while(this != NULL)
-		{
-			next = *((void **)this);
-			memcpy(key_buffer, (uint8_t *)this + sizeof(void *), buffer_keylen);
-			memcpy(val_buffer, (uint8_t *)this + sizeof(void *) + dict->keylen, buffer_vallen);
-			if(octo_cll_insert(key_buffer, val_buffer, output) == 1)
+			memcpy(key_buffer, CLL_RECORD(this, dict), buffer_keylen);
+			memcpy(val_buffer, CLL_RECORD(this, dict) + dict->keylen, buffer_vallen);
+			if(reuse_hash)
 			{
-				DEBUG_MSG("octo_cll_insert() failed during rehash, lazy rehash used, data is unrecoverable");
-				return NULL;
+				hash = octo_hash_load(CLL_CELL(this, dict));
 			}
-			free(this);
-			this = next;
+			else
+			{
+				output->hash((const uint8_t *)key_buffer, output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
+			}
+			failed = cll_insert(output, hash, &flat, 1, val_buffer);
 		}
 	}
-	// At this point we're finished with the old dict, free it:
-	free(dict->buckets);
-	free(dict);
 	free(key_buffer);
 	free(val_buffer);
-	return output;
-}
-
-// Like octo_cll_rehash, but retain the original dict. It is up to the caller
-// to free the old dict.
-octo_dict_cll_t *octo_cll_rehash_safe(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
-{
-	// Make sure the arguments are valid:
-	if(new_keylen <= 0)
+	if(!keep)
 	{
-		DEBUG_MSG("key length must not be zero");
-		errno = EINVAL;
-		return NULL;
+		// At this point we're finished with the old dict, free it:
+		octo_cll_free(dict);
 	}
-	if(new_buckets <= 0)
+	if(failed != 0)
 	{
-		DEBUG_MSG("init_buckets must not be zero");
-		errno = EINVAL;
+		DEBUG_MSG(keep ? "insertion failed during rehash, original cll_dict in known-good state" : "insertion failed during rehash, lazy rehash was used, data is unrecoverable");
+		octo_cll_free(output);
 		return NULL;
 	}
+	return output;
+}
 
-	// Allocate the new dict and populate trivial fields:
-	octo_dict_cll_t *output = malloc(sizeof(*output));
+// Give the dict an empty table keyed with new_master_key, keeping the current
+// one as the old table to be drained. The struct itself stays put, so the
+// caller's dict pointer remains valid.
+static int cll_rekey(octo_dict_cll_t *dict, const uint8_t *new_master_key)
+{
+	// Only one old table is kept, so finish any earlier rekey first:
+	cll_migrate(dict, UINT64_MAX);
+	octo_dict_cll_t *output = octo_cll_init_opt(dict->keylen, dict->vallen, dict->bucket_count, new_master_key, &dict->opt);
 	if(output == NULL)
 	{
-		DEBUG_MSG("malloc failed allocating *output");
-		errno = ENOMEM;
-		return NULL;
+		return 1;
 	}
-	output->keylen = new_keylen;
-	output->vallen = new_vallen;
-	const size_t new_cellen = new_keylen + new_vallen;
-	if(new_cellen < new_keylen)
+	// The new table takes its nodes from the current one's arena, so they can
+	// be relinked into it:
+	cll_arena_free(output->arena);
+	output->arena = dict->arena;
+	output->arena->refs++;
+	octo_dict_cll_t old = *dict;
+	*dict = *output;
+	*output = old;
+	dict->old = output;
+	// A pooled dict's log of used buckets stays with the live table, which
+	// starts out with none:
+	dict->touched = output->touched;
+	dict->touched_count = 0;
+	output->touched = NULL;
+	dict->flood_events = output->flood_events;
+	dict->hits = output->hits;
+	dict->hit_depth = output->hit_depth;
+	return 0;
+}
+
+// Switch a flooded octo_hash_hw dict over to octo_hash, then retry the insertion.
+// The records move to an octo_hash table through an ordinary rekey, a few
+// buckets at a time, while the old table keeps hashing with octo_hash_hw.
+static int cll_insert_fallback(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long chain in octo_hash_hw cll_dict, falling back to octo_hash");
+	octo_dict_cll_t *target = (octo_dict_cll_t *)dict;
+	// The new table takes the dict's options:
+	target->opt.hash = octo_hash;
+	if(cll_rekey(target, target->master_key) != 0)
 	{
-		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
-		errno = EDOM;
-		free(output);
-		return NULL;
+		target->opt.hash = octo_hash_hw;
+		return 1;
 	}
-	output->cellen = new_cellen;
-	output->bucket_count = new_buckets;
-	memcpy(output->master_key, new_master_key, 16);
-	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
-	void *key_buffer = calloc(1, output->keylen);
-	void *val_buffer = calloc(1, output->vallen);
-	if(key_buffer == NULL || val_buffer == NULL)
+	target->old->opt.hash = octo_hash_hw;
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
 	{
-		DEBUG_MSG("malloc failed while allocating key/val buffer");
 		errno = ENOMEM;
-		octo_cll_free(output);
-		return NULL;
+		return 1;
 	}
-	size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
-	size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
+	return cll_insert(target, hash, key, parts, value);
+}
 
-	// Allocate the new array of bucket pointers, initializing them to NULL:
-	void **buckets_tmp = calloc(new_buckets, sizeof(*buckets_tmp));
-	if(buckets_tmp == NULL)
+// Start rekeying a dict with a suspiciously long chain, then retry the
+// insertion in the new table.
+static int cll_insert_rekey(const octo_dict_cll_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long chain in cll_dict, rekeying");
+	octo_dict_cll_t *target = (octo_dict_cll_t *)dict;
+	uint8_t new_master_key[16];
+	octo_rekey_master(target->master_key, target->flood_events, new_master_key);
+	if(cll_rekey(target, new_master_key) != 0)
+	{
+		return 1;
+	}
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
 	{
-		DEBUG_MSG("unable to malloc for **buckets_tmp");
 		errno = ENOMEM;
-		free(output);
-		return NULL;
+		return 1;
 	}
-	output->buckets = buckets_tmp;
-	void *this = NULL;
-	void *next = NULL;
-	// There's no pre-allocation to do, so simply find every key/val
-	// in the dict and insert:
-	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	return cll_insert(target, hash, key, parts, value);
+}
+
+// Start moving the records of a cll_dict to a table keyed with new_master_key,
+// or with a freshly derived key if new_master_key is NULL. Records are moved a
+// few buckets at a time by later insertions and deletions, or by
+// octo_cll_migrate, and can be found throughout. Return 0 on success, 1 on failure.
+int octo_cll_rekey(octo_dict_cll_t *dict, const uint8_t *new_master_key)
+{
+	uint8_t derived_key[16];
+	if(new_master_key == NULL)
 	{
-		if(*(dict->buckets + i) == NULL)
-		{
-			continue;
-		}
-		this = *(dict->buckets + i);
-		while(this != NULL)
-		{
-			next = *((void **)this);
-			memcpy(key_buffer, (uint8_t *)this + sizeof(void *), buffer_keylen);
-			memcpy(val_buffer, (uint8_t *)this + sizeof(void *) + dict->keylen, buffer_vallen);
-			if(octo_cll_insert(key_buffer, val_buffer, output) == 1)
-			{
-				DEBUG_MSG("octo_cll_insert() failed during rehash, original cll_dict in known-good state");
-				return NULL;
-			}
-			this = next;
-		}
+		octo_rekey_master(dict->master_key, dict->flood_events, derived_key);
+		new_master_key = derived_key;
 	}
-	free(key_buffer);
-	free(val_buffer);
-	return output;
+	return cll_rekey(dict, new_master_key);
+}
+
+// Move up to the given number of old buckets during a rekey. The rekey is
+// finished once dict->old is NULL. Return 0; moving nodes can't fail.
+int octo_cll_migrate(octo_dict_cll_t *dict, const uint64_t buckets)
+{
+	return cll_migrate(dict, buckets);
+}
+
+// Re-create the cll_dict with a new key length, value length(both will be truncated), number of buckets,
+// and/or new master_key. Return pointer to new cll_dict on success, NULL on failure.
+octo_dict_cll_t *octo_cll_rehash(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+{
+	return cll_rehash(dict, new_keylen, new_vallen, new_buckets, new_master_key, 0);
+}
+
+// Like octo_cll_rehash, but retain the original dict. It is up to the caller
+// to free the old dict.
+octo_dict_cll_t *octo_cll_rehash_safe(octo_dict_cll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+{
+	return cll_rehash(dict, new_keylen, new_vallen, new_buckets, new_master_key, 1);
 }
 
 // Make a deep copy of a cll_dict. Return NULL on error, pointer to the new
@@ -481,6 +1152,8 @@ octo_dict_cll_t *octo_cll_rehash_safe(octo_dict_cll_t *dict, const size_t new_ke
 // other dict types.
 octo_dict_cll_t *octo_cll_clone(octo_dict_cll_t *dict)
 {
+	// Finish any rekey in progress, so only one table has to be copied:
+	cll_migrate(dict, UINT64_MAX);
 	// Allocate the new dict and populate trivial fields:
 	octo_dict_cll_t *output = malloc(sizeof(*output));
 	if(output == NULL)
@@ -492,10 +1165,22 @@ octo_dict_cll_t *octo_cll_clone(octo_dict_cll_t *dict)
 	output->keylen = dict->keylen;
 	output->vallen = dict->vallen;
 	output->cellen = dict->cellen;
+	output->hashlen = dict->hashlen;
+	output->linklen = dict->linklen;
 	output->bucket_count = dict->bucket_count;
 	memcpy(output->master_key, dict->master_key, 16);
+	output->hash = dict->hash;
+	output->opt = dict->opt;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	output->touched = NULL;
+	output->touched_count = 0;
 
-	// Allocate the new array of bucket pointers, initializing them to NULL:
+	// Allocate the new array of bucket pointers, initializing them to NULL,
+	// and an empty arena:
 	void **buckets_tmp = calloc(output->bucket_count, sizeof(*buckets_tmp));
 	if(buckets_tmp == NULL)
 	{
@@ -505,42 +1190,30 @@ octo_dict_cll_t *octo_cll_clone(octo_dict_cll_t *dict)
 		return NULL;
 	}
 	output->buckets = buckets_tmp;
-	void *src_this = NULL;
-	void *src_next = NULL;
-	void *new_this = NULL;
-	void *new_next = NULL;
-	void *tmp;
+	output->arena = cll_arena_init(output);
+	if(output->arena == NULL)
+	{
+		free(buckets_tmp);
+		free(output);
+		return NULL;
+	}
 	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		if(*(dict->buckets + i) == NULL)
-		{
-			continue;
-		}
-		src_this = *(dict->buckets + i);
-		while(src_this != NULL)
+		// Append each copied node at the tail, keeping the chain order:
+		void *tail = NULL;
+		for(void *src_this = *(dict->buckets + i); src_this != NULL; src_this = cll_next(dict, src_this))
 		{
-			src_next = *((void **)src_this);
-			tmp = malloc(sizeof(void *) + output->cellen);
-			*((void **)tmp) = NULL;
-			// Is this the first node in this bucket?
-			if(*(output->buckets + i) == NULL)
-			{
-				memcpy((uint8_t *)tmp + sizeof(void *), (uint8_t *)src_this + sizeof(void *), output->cellen);
-				*(output->buckets + i) = tmp;
-			}
-			else
+			void *tmp = cll_node_alloc(output);
+			if(tmp == NULL)
 			{
-				new_this = *(output->buckets + i);
-				new_next = *((void **)new_this);
-				while(new_next != NULL)
-				{
-					new_next = *((void **)new_this);
-					new_this = new_next;
-				}
-				memcpy((uint8_t *)tmp + sizeof(void *), (uint8_t *)src_this + sizeof(void *), output->cellen);
-				*((void **)new_this) = tmp;
+				DEBUG_MSG("allocation failed while copying nodes");
+				octo_cll_free(output);
+				return NULL;
 			}
-			src_this = src_next;
+			cll_set_next(output, tmp, NULL);
+			memcpy(CLL_CELL(tmp, output), CLL_CELL(src_this, dict), output->cellen);
+			cll_relink(output, output->buckets + i, tail, tmp);
+			tail = tmp;
 		}
 	}
 	return output;
@@ -549,6 +1222,8 @@ octo_dict_cll_t *octo_cll_clone(octo_dict_cll_t *dict)
 // Populate and return a pointer to a octo_stat_cll_t on success, NULL on error.
 octo_stat_cll_t *octo_cll_stats(octo_dict_cll_t *dict)
 {
+	// Finish any rekey in progress, so only one table has to be counted:
+	cll_migrate(dict, UINT64_MAX);
 	octo_stat_cll_t *output = calloc(1, sizeof(*output));
 	void *this;
 	void *next;
@@ -566,7 +1241,7 @@ octo_stat_cll_t *octo_cll_stats(octo_dict_cll_t *dict)
 			output->null_buckets++;
 			continue;
 		}
-		else if(*(void **)*(dict->buckets + i) == NULL)
+		else if(cll_next(dict, *(dict->buckets + i)) == NULL)
 		{
 			output->optimal_buckets++;
 			output->total_entries++;
@@ -577,7 +1252,7 @@ octo_stat_cll_t *octo_cll_stats(octo_dict_cll_t *dict)
 		current_chain_len = 0;
 		while(this != NULL)
 		{
-			next = *((void **)this);
+			next = cll_next(dict, this);
 			current_chain_len++;
 			output->total_entries++;
 			this = next;
@@ -597,6 +1272,9 @@ octo_stat_cll_t *octo_cll_stats(octo_dict_cll_t *dict)
 		free(output);
 		return NULL;
 	}
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
 	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
 	return output;
 }
@@ -604,6 +1282,7 @@ octo_stat_cll_t *octo_cll_stats(octo_dict_cll_t *dict)
 // Print out a summary of octo_stat_cll_t for debugging purposes.
 void octo_cll_stats_msg(octo_dict_cll_t *dict)
 {
+	cll_migrate(dict, UINT64_MAX);
 	octo_stat_cll_t *output = calloc(1, sizeof(*output));
 	void *this;
 	void *next;
@@ -621,7 +1300,7 @@ void octo_cll_stats_msg(octo_dict_cll_t *dict)
 			output->null_buckets++;
 			continue;
 		}
-		else if(*((void **)*(dict->buckets + i)) == NULL)
+		else if(cll_next(dict, *(dict->buckets + i)) == NULL)
 		{
 			output->optimal_buckets++;
 			output->total_entries++;
@@ -632,7 +1311,7 @@ void octo_cll_stats_msg(octo_dict_cll_t *dict)
 		current_chain_len = 0;
 		while(this != NULL)
 		{
-			next = *((void **)this);
+			next = cll_next(dict, this);
 			current_chain_len++;
 			output->total_entries++;
 			this = next;
@@ -652,6 +1331,9 @@ void octo_cll_stats_msg(octo_dict_cll_t *dict)
 		free(output);
 		return;
 	}
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
 	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
 	printf("######## libocto octo_dict_cll_t statistics summary ########\n");
 	printf("virtual address:%44llu\n", (unsigned long long)dict);
@@ -660,6 +1342,9 @@ void octo_cll_stats_msg(octo_dict_cll_t *dict)
 	printf("optimal buckets:%44llu\n", (unsigned long long)output->optimal_buckets);
 	printf("chained buckets:%44llu\n", (unsigned long long)output->chained_buckets);
 	printf("longest chain:%46llu\n", (unsigned long long)output->max_chain_len);
+	printf("flood events:%47llu\n", (unsigned long long)output->flood_events);
+	printf("fetch hits:%49llu\n", (unsigned long long)output->hits);
+	printf("hit depth:%50llu\n", (unsigned long long)output->hit_depth);
 	printf("load factor:%48Lf\n", output->load);
 	printf("############################################################\n");
 	free(output);
@@ -3,9 +3,21 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <stdlib.h>
+
 #include <octo/types.h>
 #include <octo/hash.h>
 
+#include "internal.h"
+
+// On x86-64 the vector and AES/CRC32C kernels are all built, each for its own
+// target ISA, and octo_hash_dispatch picks the best ones the CPU supports:
+#if defined(__x86_64__) && defined(__GNUC__)
+#define OCTO_HASH_X86
+#define OCTO_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
 #define rotate_left(x, y) (uint64_t)(((x) << (y)) | ((x) >> (64 - (y))))
 
 #define uint32_to_uint8(a, b) (a)[0] = (uint8_t)((b)); (a)[1] = (uint8_t)((b) >> 8); (a)[2] = (uint8_t)((b) >> 16); (a)[3] = (uint8_t)((b) >> 24);
@@ -22,6 +34,16 @@
 ((uint64_t)((a)[6]) << 48) | \
 ((uint64_t)((a)[7]) << 56))
 
+// Keys at least this long are hashed by octo_hash_long in four stripes:
+#define OCTO_HASH_LONG_MIN 128
+
+// Multi-part keys up to this long are gathered on the stack, longer ones in a
+// malloc'd buffer:
+#define OCTO_IOV_STACK 256
+
+// The AES or CRC32C kernel behind octo_hash_hw, chosen by octo_hash_dispatch:
+static octo_hash_fn_t octo_hash_hw_kernel = octo_hash;
+
 #define OCTOTHORPE \
 do { \
 	stat_0 += stat_1; stat_1=rotate_left(stat_1, 13); stat_1 ^= stat_0; stat_0=rotate_left(stat_0, 32); \
@@ -30,8 +52,10 @@ do { \
 	stat_2 += stat_1; stat_1=rotate_left(stat_1, 17); stat_1 ^= stat_2; stat_2=rotate_left(stat_2, 32); \
 } while(0)
 
-// Given an arbitrary number input_length of bytes *input, give a 64-bit hash *output:
-void octo_hash(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+// The body of octo_hash and octo_hash13, with c_rounds compression and
+// d_rounds finalization rounds. When input_length is a compile time constant
+// the word loop and the tail switch are resolved entirely by the compiler:
+static OCTO_ALWAYS_INLINE void octo_hash_body(const uint8_t *input, const size_t input_length, uint8_t *output, const uint8_t *key, const int c_rounds, const int d_rounds)
 {
 	uint64_t stat_0 = 0x736f6d6570736575ULL;
 	uint64_t stat_1 = 0x646f72616e646f6dULL;
@@ -48,12 +72,17 @@ void octo_hash(const uint8_t *input, size_t input_length, uint8_t *output, const
 	stat_2 ^= k0;
 	stat_1 ^= k1;
 	stat_0 ^= k0;
+#ifdef __GNUC__
+#pragma GCC unroll 4
+#endif
 	for (;input != end; input += 8)
 	{
 		m = uint8_to_uint64(input);
 		stat_3 ^= m;
-		OCTOTHORPE;
-		OCTOTHORPE;
+		for(int r = 0; r < c_rounds; r++)
+		{
+			OCTOTHORPE;
+		}
 		stat_0 ^= m;
 	}
 	switch(left)
@@ -77,15 +106,692 @@ void octo_hash(const uint8_t *input, size_t input_length, uint8_t *output, const
 		break;
 	}
 	stat_3 ^= b;
-	OCTOTHORPE;
-	OCTOTHORPE;
+	for(int r = 0; r < c_rounds; r++)
+	{
+		OCTOTHORPE;
+	}
 	stat_0 ^= b;
 	stat_2 ^= 0xff;
-	OCTOTHORPE;
-	OCTOTHORPE;
-	OCTOTHORPE;
-	OCTOTHORPE;
+	for(int r = 0; r < d_rounds; r++)
+	{
+		OCTOTHORPE;
+	}
 	b = stat_0 ^ stat_1 ^ stat_2  ^ stat_3;
 	uint64_to_uint8(output, b);
 	return;
 }
+
+// Given an arbitrary number input_length of bytes *input, give a 64-bit hash *output:
+void octo_hash(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	octo_hash_body(input, input_length, output, key, 2, 4);
+	return;
+}
+
+// Like octo_hash, but with the reduced SipHash-1-3 round counts:
+void octo_hash13(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	octo_hash_body(input, input_length, output, key, 1, 3);
+	return;
+}
+
+// octo_hash and octo_hash13 unrolled for a fixed key length; input_length is ignored:
+#define OCTO_HASH_FIXED(n) \
+static void octo_hash_##n(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key) \
+{ \
+	(void)input_length; \
+	octo_hash_body(input, n, output, key, 2, 4); \
+	return; \
+} \
+static void octo_hash13_##n(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key) \
+{ \
+	(void)input_length; \
+	octo_hash_body(input, n, output, key, 1, 3); \
+	return; \
+}
+
+OCTO_HASH_FIXED(4)
+OCTO_HASH_FIXED(8)
+OCTO_HASH_FIXED(16)
+OCTO_HASH_FIXED(24)
+OCTO_HASH_FIXED(32)
+
+// Return a function equivalent to octo_hash for keys of exactly input_length
+// bytes. Common key widths get a fully unrolled variant, anything else gets
+// octo_hash itself.
+octo_hash_fn_t octo_hash_fixed(size_t input_length)
+{
+	switch(input_length)
+	{
+	case 4:
+		return octo_hash_4;
+	case 8:
+		return octo_hash_8;
+	case 16:
+		return octo_hash_16;
+	case 24:
+		return octo_hash_24;
+	case 32:
+		return octo_hash_32;
+	default:
+		return octo_hash;
+	}
+}
+
+// Like octo_hash_fixed, for octo_hash13:
+static octo_hash_fn_t octo_hash13_fixed(size_t input_length)
+{
+	switch(input_length)
+	{
+	case 4:
+		return octo_hash13_4;
+	case 8:
+		return octo_hash13_8;
+	case 16:
+		return octo_hash13_16;
+	case 24:
+		return octo_hash13_24;
+	case 32:
+		return octo_hash13_32;
+	default:
+		return octo_hash13;
+	}
+}
+
+// Resolve the hash function a dict should call for keys of input_length bytes.
+// NULL selects octo_hash. libocto's own hashes are swapped for their unrolled
+// variants, and octo_hash_hw for the kernel currently behind it, so a later
+// octo_hash_dispatch doesn't change how an existing dict hashes. Any other
+// function is used as-is.
+octo_hash_fn_t octo_hash_select(octo_hash_fn_t base, size_t input_length)
+{
+	if(base == octo_hash_hw)
+	{
+		return octo_hash_hw_kernel;
+	}
+	// octo_hash_long is octo_hash for keys too short to stripe:
+	if(base == NULL || base == octo_hash || (base == octo_hash_long && input_length < OCTO_HASH_LONG_MIN))
+	{
+		return octo_hash_fixed(input_length);
+	}
+	if(base == octo_hash13)
+	{
+		return octo_hash13_fixed(input_length);
+	}
+	return base;
+}
+
+// Run rounds compression rounds over the state in *ctx:
+static inline void octo_hash_ctx_rounds(octo_hash_ctx_t *ctx, const unsigned int rounds)
+{
+	uint64_t stat_0 = ctx->stat[0];
+	uint64_t stat_1 = ctx->stat[1];
+	uint64_t stat_2 = ctx->stat[2];
+	uint64_t stat_3 = ctx->stat[3];
+	for(unsigned int r = 0; r < rounds; r++)
+	{
+		OCTOTHORPE;
+	}
+	ctx->stat[0] = stat_0;
+	ctx->stat[1] = stat_1;
+	ctx->stat[2] = stat_2;
+	ctx->stat[3] = stat_3;
+	return;
+}
+
+// Absorb one 8-byte word into *ctx:
+static inline void octo_hash_ctx_word(octo_hash_ctx_t *ctx, const uint64_t m)
+{
+	ctx->stat[3] ^= m;
+	octo_hash_ctx_rounds(ctx, ctx->c_rounds);
+	ctx->stat[0] ^= m;
+	return;
+}
+
+// Begin an incremental octo_hash of the input given to octo_hash_update:
+void octo_hash_init(octo_hash_ctx_t *ctx, const uint8_t *key)
+{
+	const uint64_t k0 = uint8_to_uint64(key);
+	const uint64_t k1 = uint8_to_uint64(key + 8);
+	ctx->stat[0] = 0x736f6d6570736575ULL ^ k0;
+	ctx->stat[1] = 0x646f72616e646f6dULL ^ k1;
+	ctx->stat[2] = 0x6c7967656e657261ULL ^ k0;
+	ctx->stat[3] = 0x7465646279746573ULL ^ k1;
+	ctx->tail = 0;
+	ctx->length = 0;
+	ctx->c_rounds = 2;
+	ctx->d_rounds = 4;
+	return;
+}
+
+// Like octo_hash_init, but the result will match octo_hash13:
+void octo_hash13_init(octo_hash_ctx_t *ctx, const uint8_t *key)
+{
+	octo_hash_init(ctx, key);
+	ctx->c_rounds = 1;
+	ctx->d_rounds = 3;
+	return;
+}
+
+// Feed input_length more bytes of input to an incremental hash:
+void octo_hash_update(octo_hash_ctx_t *ctx, const uint8_t *input, size_t input_length)
+{
+	unsigned int pending = (unsigned int)(ctx->length & 7);
+	ctx->length += input_length;
+	// Top up a partial word left over from the last update:
+	if(pending != 0)
+	{
+		while(pending < 8 && input_length > 0)
+		{
+			ctx->tail |= ((uint64_t)*input) << (8 * pending);
+			pending++;
+			input++;
+			input_length--;
+		}
+		if(pending < 8)
+		{
+			return;
+		}
+		octo_hash_ctx_word(ctx, ctx->tail);
+		ctx->tail = 0;
+	}
+	for(; input_length >= 8; input += 8, input_length -= 8)
+	{
+		octo_hash_ctx_word(ctx, uint8_to_uint64(input));
+	}
+	for(unsigned int i = 0; i < input_length; i++)
+	{
+		ctx->tail |= ((uint64_t)input[i]) << (8 * i);
+	}
+	return;
+}
+
+// Finish an incremental hash, writing the 64-bit result to *output. The
+// result is identical to hashing all of the input in a single call:
+void octo_hash_final(octo_hash_ctx_t *ctx, uint8_t *output)
+{
+	const uint64_t b = (ctx->length << 56) | ctx->tail;
+	octo_hash_ctx_word(ctx, b);
+	ctx->stat[2] ^= 0xff;
+	octo_hash_ctx_rounds(ctx, ctx->d_rounds);
+	const uint64_t out = ctx->stat[0] ^ ctx->stat[1] ^ ctx->stat[2] ^ ctx->stat[3];
+	uint64_to_uint8(output, out);
+	return;
+}
+
+// Hash a key given in parts with the function base (as chosen for a dict).
+// octo_hash and octo_hash13 consume the parts in place; any other function
+// is handed a gathered copy. Return 0 on success, 1 on malloc failure.
+// Only keys longer than OCTO_IOV_STACK bytes need malloc.
+int octo_hash_iov(octo_hash_fn_t base, const octo_iov_t *key, size_t parts, uint8_t *output, const uint8_t *master_key)
+{
+	if(base == octo_hash_long && octo_key_length(key, parts) < OCTO_HASH_LONG_MIN)
+	{
+		base = octo_hash;
+	}
+	if(base == NULL || base == octo_hash || base == octo_hash13)
+	{
+		octo_hash_ctx_t ctx;
+		if(base == octo_hash13)
+		{
+			octo_hash13_init(&ctx, master_key);
+		}
+		else
+		{
+			octo_hash_init(&ctx, master_key);
+		}
+		for(size_t i = 0; i < parts; i++)
+		{
+			octo_hash_update(&ctx, key[i].base, key[i].len);
+		}
+		octo_hash_final(&ctx, output);
+		return 0;
+	}
+	if(parts == 1)
+	{
+		base(key[0].base, key[0].len, output, master_key);
+		return 0;
+	}
+	const size_t length = octo_key_length(key, parts);
+	if(length <= OCTO_IOV_STACK)
+	{
+		uint8_t stack[OCTO_IOV_STACK];
+		octo_key_copy(stack, key, parts);
+		base(stack, length, output, master_key);
+		return 0;
+	}
+	uint8_t *buffer = malloc(length);
+	if(buffer == NULL)
+	{
+		return 1;
+	}
+	octo_key_copy(buffer, key, parts);
+	base(buffer, length, output, master_key);
+	free(buffer);
+	return 0;
+}
+
+// Fill in a key handle. The key itself isn't copied, so it must outlive the handle.
+void octo_key_init(octo_key_t *handle, const void *key, size_t keylen, octo_hash_fn_t base, const uint8_t *master_key)
+{
+	handle->key = key;
+	handle->keylen = keylen;
+	handle->fn = octo_hash_select(base, keylen);
+	memcpy(handle->master_key, master_key, 16);
+	handle->fn(key, keylen, (uint8_t *)&handle->hash, master_key);
+	return;
+}
+
+// Gather the final (partial) word of an input, tagged with the input length:
+static inline uint64_t octo_hash_tail(const uint8_t *input, size_t input_length)
+{
+	uint64_t b = ((uint64_t)input_length) << 56;
+	input += input_length - (input_length % sizeof(uint64_t));
+	switch(input_length & 7)
+	{
+	case 7:
+		b |= ((uint64_t)input[6]) << 48;
+	case 6:
+		b |= ((uint64_t)input[5]) << 40;
+	case 5:
+		b |= ((uint64_t)input[4]) << 32;
+	case 4:
+		b |= ((uint64_t)input[3]) << 24;
+	case 3:
+		b |= ((uint64_t)input[2]) << 16;
+	case 2:
+		b |= ((uint64_t)input[1]) <<  8;
+	case 1:
+		b |= ((uint64_t)input[0]);
+		break;
+	case 0:
+		break;
+	}
+	return b;
+}
+
+#ifdef OCTO_HASH_X86
+
+#define OCTOTHORPE_X8 \
+do { \
+	stat_0 = _mm512_add_epi64(stat_0, stat_1); stat_1 = _mm512_rol_epi64(stat_1, 13); stat_1 = _mm512_xor_si512(stat_1, stat_0); stat_0 = _mm512_rol_epi64(stat_0, 32); \
+	stat_2 = _mm512_add_epi64(stat_2, stat_3); stat_3 = _mm512_rol_epi64(stat_3, 16); stat_3 = _mm512_xor_si512(stat_3, stat_2); \
+	stat_0 = _mm512_add_epi64(stat_0, stat_3); stat_3 = _mm512_rol_epi64(stat_3, 21); stat_3 = _mm512_xor_si512(stat_3, stat_0); \
+	stat_2 = _mm512_add_epi64(stat_2, stat_1); stat_1 = _mm512_rol_epi64(stat_1, 17); stat_1 = _mm512_xor_si512(stat_1, stat_2); stat_2 = _mm512_rol_epi64(stat_2, 32); \
+} while(0)
+
+#define octo_lanes_x8(f, k, l) _mm512_set_epi64((long long)f((k) + 7 * (l)), (long long)f((k) + 6 * (l)), (long long)f((k) + 5 * (l)), (long long)f((k) + 4 * (l)), \
+	(long long)f((k) + 3 * (l)), (long long)f((k) + 2 * (l)), (long long)f((k) + (l)), (long long)f((k)))
+
+#define octo_tail_x8(k, l) _mm512_set_epi64((long long)octo_hash_tail((k) + 7 * (l), (l)), (long long)octo_hash_tail((k) + 6 * (l), (l)), \
+	(long long)octo_hash_tail((k) + 5 * (l), (l)), (long long)octo_hash_tail((k) + 4 * (l), (l)), (long long)octo_hash_tail((k) + 3 * (l), (l)), \
+	(long long)octo_hash_tail((k) + 2 * (l), (l)), (long long)octo_hash_tail((k) + (l), (l)), (long long)octo_hash_tail((k), (l)))
+
+// Hash eight consecutive keys of input_length bytes each, one per vector lane:
+OCTO_TARGET("avx512f") static void octo_hash_x8(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	const __m512i k0 = _mm512_set1_epi64((long long)uint8_to_uint64(key));
+	const __m512i k1 = _mm512_set1_epi64((long long)uint8_to_uint64(key + 8));
+	__m512i stat_0 = _mm512_xor_si512(_mm512_set1_epi64(0x736f6d6570736575LL), k0);
+	__m512i stat_1 = _mm512_xor_si512(_mm512_set1_epi64(0x646f72616e646f6dLL), k1);
+	__m512i stat_2 = _mm512_xor_si512(_mm512_set1_epi64(0x6c7967656e657261LL), k0);
+	__m512i stat_3 = _mm512_xor_si512(_mm512_set1_epi64(0x7465646279746573LL), k1);
+	__m512i m;
+	uint64_t b[8];
+	for(size_t i = 0; i + 8 <= input_length; i += 8)
+	{
+		m = octo_lanes_x8(uint8_to_uint64, input + i, input_length);
+		stat_3 = _mm512_xor_si512(stat_3, m);
+		OCTOTHORPE_X8;
+		OCTOTHORPE_X8;
+		stat_0 = _mm512_xor_si512(stat_0, m);
+	}
+	m = octo_tail_x8(input, input_length);
+	stat_3 = _mm512_xor_si512(stat_3, m);
+	OCTOTHORPE_X8;
+	OCTOTHORPE_X8;
+	stat_0 = _mm512_xor_si512(stat_0, m);
+	stat_2 = _mm512_xor_si512(stat_2, _mm512_set1_epi64(0xff));
+	OCTOTHORPE_X8;
+	OCTOTHORPE_X8;
+	OCTOTHORPE_X8;
+	OCTOTHORPE_X8;
+	m = _mm512_xor_si512(_mm512_xor_si512(stat_0, stat_1), _mm512_xor_si512(stat_2, stat_3));
+	_mm512_storeu_si512((void *)b, m);
+	for(unsigned int i = 0; i < 8; i++)
+	{
+		uint64_to_uint8(output + (8 * i), b[i]);
+	}
+	return;
+}
+
+
+#define rotate_left_x4(x, y) _mm256_or_si256(_mm256_slli_epi64((x), (y)), _mm256_srli_epi64((x), 64 - (y)))
+
+#define OCTOTHORPE_X4 \
+do { \
+	stat_0 = _mm256_add_epi64(stat_0, stat_1); stat_1 = rotate_left_x4(stat_1, 13); stat_1 = _mm256_xor_si256(stat_1, stat_0); stat_0 = _mm256_shuffle_epi32(stat_0, 0xb1); \
+	stat_2 = _mm256_add_epi64(stat_2, stat_3); stat_3 = rotate_left_x4(stat_3, 16); stat_3 = _mm256_xor_si256(stat_3, stat_2); \
+	stat_0 = _mm256_add_epi64(stat_0, stat_3); stat_3 = rotate_left_x4(stat_3, 21); stat_3 = _mm256_xor_si256(stat_3, stat_0); \
+	stat_2 = _mm256_add_epi64(stat_2, stat_1); stat_1 = rotate_left_x4(stat_1, 17); stat_1 = _mm256_xor_si256(stat_1, stat_2); stat_2 = _mm256_shuffle_epi32(stat_2, 0xb1); \
+} while(0)
+
+#define octo_lanes_x4(f, k, l) _mm256_set_epi64x((long long)f((k) + 3 * (l)), (long long)f((k) + 2 * (l)), (long long)f((k) + (l)), (long long)f((k)))
+
+#define octo_tail_x4(k, l) _mm256_set_epi64x((long long)octo_hash_tail((k) + 3 * (l), (l)), (long long)octo_hash_tail((k) + 2 * (l), (l)), \
+	(long long)octo_hash_tail((k) + (l), (l)), (long long)octo_hash_tail((k), (l)))
+
+// Hash four consecutive keys of input_length bytes each, one per vector lane:
+OCTO_TARGET("avx2") static void octo_hash_x4(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	const __m256i k0 = _mm256_set1_epi64x((long long)uint8_to_uint64(key));
+	const __m256i k1 = _mm256_set1_epi64x((long long)uint8_to_uint64(key + 8));
+	__m256i stat_0 = _mm256_xor_si256(_mm256_set1_epi64x(0x736f6d6570736575LL), k0);
+	__m256i stat_1 = _mm256_xor_si256(_mm256_set1_epi64x(0x646f72616e646f6dLL), k1);
+	__m256i stat_2 = _mm256_xor_si256(_mm256_set1_epi64x(0x6c7967656e657261LL), k0);
+	__m256i stat_3 = _mm256_xor_si256(_mm256_set1_epi64x(0x7465646279746573LL), k1);
+	__m256i m;
+	uint64_t b[4];
+	for(size_t i = 0; i + 8 <= input_length; i += 8)
+	{
+		m = octo_lanes_x4(uint8_to_uint64, input + i, input_length);
+		stat_3 = _mm256_xor_si256(stat_3, m);
+		OCTOTHORPE_X4;
+		OCTOTHORPE_X4;
+		stat_0 = _mm256_xor_si256(stat_0, m);
+	}
+	m = octo_tail_x4(input, input_length);
+	stat_3 = _mm256_xor_si256(stat_3, m);
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	stat_0 = _mm256_xor_si256(stat_0, m);
+	stat_2 = _mm256_xor_si256(stat_2, _mm256_set1_epi64x(0xff));
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	m = _mm256_xor_si256(_mm256_xor_si256(stat_0, stat_1), _mm256_xor_si256(stat_2, stat_3));
+	_mm256_storeu_si256((__m256i *)b, m);
+	for(unsigned int i = 0; i < 4; i++)
+	{
+		uint64_to_uint8(output + (8 * i), b[i]);
+	}
+	return;
+}
+
+#endif
+
+// Hash the four stripes of blocks 32-byte blocks; word j of each block belongs
+// to stripe j. Each stripe gets the octo_hash of its words, in order:
+#ifdef OCTO_HASH_X86
+OCTO_TARGET("avx2") static void octo_hash_stripes_avx2(const uint8_t *input, size_t blocks, uint64_t *lanes, const uint8_t *key)
+{
+	const __m256i k0 = _mm256_set1_epi64x((long long)uint8_to_uint64(key));
+	const __m256i k1 = _mm256_set1_epi64x((long long)uint8_to_uint64(key + 8));
+	__m256i stat_0 = _mm256_xor_si256(_mm256_set1_epi64x(0x736f6d6570736575LL), k0);
+	__m256i stat_1 = _mm256_xor_si256(_mm256_set1_epi64x(0x646f72616e646f6dLL), k1);
+	__m256i stat_2 = _mm256_xor_si256(_mm256_set1_epi64x(0x6c7967656e657261LL), k0);
+	__m256i stat_3 = _mm256_xor_si256(_mm256_set1_epi64x(0x7465646279746573LL), k1);
+	__m256i m;
+	for(size_t i = 0; i < blocks; i++)
+	{
+		// x86 is little-endian, so one load gathers a word for every stripe:
+		m = _mm256_loadu_si256((const __m256i *)(input + (32 * i)));
+		stat_3 = _mm256_xor_si256(stat_3, m);
+		OCTOTHORPE_X4;
+		OCTOTHORPE_X4;
+		stat_0 = _mm256_xor_si256(stat_0, m);
+	}
+	m = _mm256_set1_epi64x((long long)(((uint64_t)blocks * 8) << 56));
+	stat_3 = _mm256_xor_si256(stat_3, m);
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	stat_0 = _mm256_xor_si256(stat_0, m);
+	stat_2 = _mm256_xor_si256(stat_2, _mm256_set1_epi64x(0xff));
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	OCTOTHORPE_X4;
+	m = _mm256_xor_si256(_mm256_xor_si256(stat_0, stat_1), _mm256_xor_si256(stat_2, stat_3));
+	_mm256_storeu_si256((__m256i *)lanes, m);
+	return;
+}
+#endif
+
+// One OCTOTHORPE round on stripe j; the four stripes are independent, so their
+// rounds interleave in the pipeline:
+#define OCTOTHORPE_STRIPE(j) \
+do { \
+	s0[j] += s1[j]; s1[j]=rotate_left(s1[j], 13); s1[j] ^= s0[j]; s0[j]=rotate_left(s0[j], 32); \
+	s2[j] += s3[j]; s3[j]=rotate_left(s3[j], 16); s3[j] ^= s2[j]; \
+	s0[j] += s3[j]; s3[j]=rotate_left(s3[j], 21); s3[j] ^= s0[j]; \
+	s2[j] += s1[j]; s1[j]=rotate_left(s1[j], 17); s1[j] ^= s2[j]; s2[j]=rotate_left(s2[j], 32); \
+} while(0)
+
+static void octo_hash_stripes_scalar(const uint8_t *input, size_t blocks, uint64_t *lanes, const uint8_t *key)
+{
+	const uint64_t k0 = uint8_to_uint64(key);
+	const uint64_t k1 = uint8_to_uint64(key + 8);
+	uint64_t s0[4];
+	uint64_t s1[4];
+	uint64_t s2[4];
+	uint64_t s3[4];
+	uint64_t m;
+	for(int j = 0; j < 4; j++)
+	{
+		s0[j] = 0x736f6d6570736575ULL ^ k0;
+		s1[j] = 0x646f72616e646f6dULL ^ k1;
+		s2[j] = 0x6c7967656e657261ULL ^ k0;
+		s3[j] = 0x7465646279746573ULL ^ k1;
+	}
+	for(size_t i = 0; i < blocks; i++)
+	{
+		for(int j = 0; j < 4; j++)
+		{
+			m = uint8_to_uint64(input + (32 * i) + (8 * j));
+			s3[j] ^= m;
+			OCTOTHORPE_STRIPE(j);
+			OCTOTHORPE_STRIPE(j);
+			s0[j] ^= m;
+		}
+	}
+	m = ((uint64_t)blocks * 8) << 56;
+	for(int j = 0; j < 4; j++)
+	{
+		s3[j] ^= m;
+		OCTOTHORPE_STRIPE(j);
+		OCTOTHORPE_STRIPE(j);
+		s0[j] ^= m;
+		s2[j] ^= 0xff;
+		for(int r = 0; r < 4; r++)
+		{
+			OCTOTHORPE_STRIPE(j);
+		}
+		lanes[j] = s0[j] ^ s1[j] ^ s2[j] ^ s3[j];
+	}
+	return;
+}
+
+static void (*octo_hash_stripes_kernel)(const uint8_t *input, size_t blocks, uint64_t *lanes, const uint8_t *key) = octo_hash_stripes_scalar;
+
+// Keyed hash for long keys. The whole 32-byte blocks of the input are split
+// into four interleaved stripes that are hashed in parallel, then the stripe
+// hashes and the remaining bytes are hashed together. Keys shorter than
+// OCTO_HASH_LONG_MIN get plain octo_hash.
+void octo_hash_long(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	if(input_length < OCTO_HASH_LONG_MIN)
+	{
+		octo_hash(input, input_length, output, key);
+		return;
+	}
+	const size_t blocks = input_length / 32;
+	const size_t left = input_length % 32;
+	uint64_t lanes[4];
+	uint8_t combined[32 + 31];
+	octo_hash_stripes_kernel(input, blocks, lanes, key);
+	for(int j = 0; j < 4; j++)
+	{
+		uint64_to_uint8(combined + (8 * j), lanes[j]);
+	}
+	memcpy(combined + 32, input + (32 * blocks), left);
+	octo_hash(combined, 32 + left, output, key);
+	return;
+}
+
+// Hash the keys of octo_hash_many that are left after the vector lanes:
+static void octo_hash_many_scalar(const uint8_t *input, size_t count, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		octo_hash(input + (i * input_length), input_length, output + (8 * i), key);
+	}
+	return;
+}
+
+#ifdef OCTO_HASH_X86
+OCTO_TARGET("avx2") static void octo_hash_many_avx2(const uint8_t *input, size_t count, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		octo_hash_x4(input + (i * input_length), input_length, output + (8 * i), key);
+	}
+	octo_hash_many_scalar(input + (i * input_length), count - i, input_length, output + (8 * i), key);
+	return;
+}
+
+OCTO_TARGET("avx512f") static void octo_hash_many_avx512(const uint8_t *input, size_t count, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		octo_hash_x8(input + (i * input_length), input_length, output + (8 * i), key);
+	}
+	octo_hash_many_avx2(input + (i * input_length), count - i, input_length, output + (8 * i), key);
+	return;
+}
+#endif
+
+static void (*octo_hash_many_kernel)(const uint8_t *input, size_t count, size_t input_length, uint8_t *output, const uint8_t *key) = octo_hash_many_scalar;
+
+// Hash count consecutive keys of input_length bytes each in *input, writing
+// count 64-bit hashes to *output. Results are identical to calling octo_hash
+// on each key in turn; the keys are spread across vector lanes where available.
+void octo_hash_many(const uint8_t *input, size_t count, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	octo_hash_many_kernel(input, count, input_length, output, key);
+	return;
+}
+
+#ifdef OCTO_HASH_X86
+// AES-NI keyed hash. Each 16-byte block is folded into the state with an AES
+// round keyed by the master key, then three more rounds finish it.
+OCTO_TARGET("aes") static void octo_hash_aes(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	const __m128i k0 = _mm_loadu_si128((const __m128i *)key);
+	const __m128i k1 = _mm_xor_si128(_mm_shuffle_epi32(k0, 0x4e), _mm_set_epi64x(0x736f6d6570736575LL, 0x646f72616e646f6dLL));
+	__m128i state = _mm_xor_si128(k1, _mm_set_epi64x(0, (long long)input_length));
+	size_t i = 0;
+	for(; i + 16 <= input_length; i += 16)
+	{
+		state = _mm_aesenc_si128(_mm_xor_si128(state, _mm_loadu_si128((const __m128i *)(input + i))), k0);
+	}
+	if(i < input_length)
+	{
+		uint8_t tail[16] = {0};
+		memcpy(tail, input + i, input_length - i);
+		state = _mm_aesenc_si128(_mm_xor_si128(state, _mm_loadu_si128((const __m128i *)tail)), k0);
+	}
+	state = _mm_aesenc_si128(state, k1);
+	state = _mm_aesenc_si128(state, k0);
+	state = _mm_aesenc_si128(state, k1);
+	const uint64_t hash = (uint64_t)_mm_cvtsi128_si64(state) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(state, state));
+	memcpy(output, &hash, sizeof(hash));
+	return;
+}
+
+// CRC32C keyed hash. Two CRC lanes seeded from the master key see differently
+// keyed copies of each word, so their difference isn't input-independent. A
+// multiply-xorshift finalizer spreads the 64 lane bits.
+OCTO_TARGET("sse4.2") static void octo_hash_crc(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	const uint64_t k0 = uint8_to_uint64(key);
+	const uint64_t k1 = uint8_to_uint64(key + 8);
+	uint64_t a = k0;
+	uint64_t b = k1;
+	uint64_t m;
+	for(size_t i = 0; i + 8 <= input_length; i += 8)
+	{
+		m = uint8_to_uint64(input + i);
+		a = _mm_crc32_u64(a, m);
+		b = _mm_crc32_u64(b, rotate_left(m, 29) + k1);
+	}
+	m = octo_hash_tail(input, input_length);
+	a = _mm_crc32_u64(a, m);
+	b = _mm_crc32_u64(b, rotate_left(m, 29) + k1);
+	uint64_t hash = ((a << 32) | b) ^ k0;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	memcpy(output, &hash, sizeof(hash));
+	return;
+}
+#endif
+
+// Fast keyed hash built on AES-NI or CRC32C, whichever the CPU has, or
+// octo_hash on CPUs with neither. Dicts hashing with it switch to octo_hash
+// if their chains or probes get suspiciously long.
+void octo_hash_hw(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *key)
+{
+	octo_hash_hw_kernel(input, input_length, output, key);
+	return;
+}
+
+// Choose the fastest kernels this CPU supports, up to max_isa. Return the
+// highest instruction set in use.
+octo_isa_t octo_hash_dispatch(octo_isa_t max_isa)
+{
+	octo_isa_t isa = OCTO_ISA_BASELINE;
+	octo_hash_many_kernel = octo_hash_many_scalar;
+	octo_hash_stripes_kernel = octo_hash_stripes_scalar;
+	octo_hash_hw_kernel = octo_hash;
+#ifdef OCTO_HASH_X86
+	__builtin_cpu_init();
+	if(max_isa >= OCTO_ISA_SSE42 && __builtin_cpu_supports("sse4.2"))
+	{
+		octo_hash_hw_kernel = octo_hash_crc;
+		isa = OCTO_ISA_SSE42;
+	}
+	if(max_isa >= OCTO_ISA_AES && __builtin_cpu_supports("aes"))
+	{
+		octo_hash_hw_kernel = octo_hash_aes;
+		isa = OCTO_ISA_AES;
+	}
+	if(max_isa >= OCTO_ISA_AVX2 && __builtin_cpu_supports("avx2"))
+	{
+		octo_hash_many_kernel = octo_hash_many_avx2;
+		octo_hash_stripes_kernel = octo_hash_stripes_avx2;
+		isa = OCTO_ISA_AVX2;
+	}
+	if(max_isa >= OCTO_ISA_AVX512 && __builtin_cpu_supports("avx512f"))
+	{
+		octo_hash_many_kernel = octo_hash_many_avx512;
+		isa = OCTO_ISA_AVX512;
+	}
+#else
+	(void)max_isa;
+#endif
+	return isa;
+}
+
+// Pick the kernels once at load time; until then the portable ones are used:
+#ifdef __GNUC__
+__attribute__((constructor)) static void octo_hash_dispatch_init(void)
+{
+	octo_hash_dispatch(OCTO_ISA_AVX512);
+	return;
+}
+#endif
@@ -0,0 +1,204 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+// Helpers shared by the implementation strategies. Not part of the public API.
+
+#ifndef OCTO_INTERNAL_H
+#define OCTO_INTERNAL_H
+
+#include <string.h>
+
+#include <octo/types.h>
+#include <octo/hash.h>
+#include <octo/keygen.h>
+#include <octo/opt.h>
+
+#ifdef __GNUC__
+#define OCTO_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define OCTO_ALWAYS_INLINE inline
+#endif
+
+__extension__ typedef unsigned __int128 octo_uint128_t;
+
+// Reduce a hash to a bucket index according to the dict's index mode:
+static OCTO_ALWAYS_INLINE uint64_t octo_index(const octo_index_t mode, const uint64_t hash, const uint64_t bucket_count)
+{
+	switch(mode)
+	{
+	case OCTO_INDEX_POW2:
+		return hash & (bucket_count - 1);
+	case OCTO_INDEX_FASTRANGE:
+		// The high word of the 128-bit product is uniform in [0, bucket_count):
+		return (uint64_t)(((octo_uint128_t)hash * bucket_count) >> 64);
+	default:
+		return hash % bucket_count;
+	}
+}
+
+// Adjust a requested bucket count to suit an index mode. Return 0 if the
+// mode is unknown or the count can't be represented.
+static inline uint64_t octo_index_buckets(const octo_index_t mode, const uint64_t buckets)
+{
+	switch(mode)
+	{
+	case OCTO_INDEX_MOD:
+	case OCTO_INDEX_FASTRANGE:
+		return buckets;
+	case OCTO_INDEX_POW2:
+		if(buckets > (UINT64_C(1) << 63))
+		{
+			return 0;
+		}
+		uint64_t rounded = 1;
+		while(rounded < buckets)
+		{
+			rounded <<= 1;
+		}
+		return rounded;
+	default:
+		return 0;
+	}
+}
+
+// Whether a chain or probe this long means a dict hashing with octo_hash_hw is
+// being flooded and should switch to octo_hash:
+static OCTO_ALWAYS_INLINE int octo_hw_flooded(const octo_opt_t *opt, const uint64_t length)
+{
+	return opt->hash == octo_hash_hw && length >= (opt->fallback_len != 0 ? opt->fallback_len : OCTO_FALLBACK_LEN);
+}
+
+// Whether a bucket, chain, or probe this long should start an automatic rekey.
+// Only one rekey runs at a time, so the caller checks for one in progress:
+static OCTO_ALWAYS_INLINE int octo_rekey_due(const octo_opt_t *opt, const uint64_t length)
+{
+	return opt->rekey_len != 0 && length >= opt->rekey_len;
+}
+
+// Number of old buckets to move on each insertion or deletion during a rekey:
+static inline uint64_t octo_rekey_step(const octo_opt_t *opt)
+{
+	return opt->rekey_step != 0 ? opt->rekey_step : OCTO_REKEY_STEP;
+}
+
+// Derive the master key for an automatic rekey from fresh random bytes, the
+// old key, and the dict's event count, so it differs from the old key even if
+// the generator were to repeat itself.
+static inline void octo_rekey_master(const uint8_t *old_key, const uint64_t events, uint8_t *new_key)
+{
+	uint8_t block[24];
+	octo_keygen_fast(block);
+	for(uint64_t i = 0; i < 2; i++)
+	{
+		const uint64_t tag = (events * 2) + i;
+		memcpy(block + 16, &tag, sizeof(tag));
+		octo_hash(block, sizeof(block), new_key + (8 * i), old_key);
+	}
+	return;
+}
+
+// The function octo_hash_iov hashes a dict's multi-part keys with, given its
+// selected hash function fn and hash option base. octo_hash_hw stands for the
+// kernel resolved into fn when the dict was created:
+static OCTO_ALWAYS_INLINE octo_hash_fn_t octo_iov_base(octo_hash_fn_t fn, octo_hash_fn_t base)
+{
+	return base == octo_hash_hw ? fn : base;
+}
+
+// Hash a key given in parts with a dict's selected hash function fn, or with
+// its hash option base if the key really is in several parts. Return 1 if the
+// parts couldn't be gathered.
+static inline int octo_hash_parts(octo_hash_fn_t fn, octo_hash_fn_t base, const octo_iov_t *key, const size_t parts, const uint8_t *master_key, uint64_t *hash)
+{
+	if(parts == 1)
+	{
+		fn(key->base, key->len, (uint8_t *)hash, master_key);
+		return 0;
+	}
+	return octo_hash_iov(octo_iov_base(fn, base), key, parts, (uint8_t *)hash, master_key);
+}
+
+// Note a bucket coming into use, for dicts that keep track of them so they can
+// be cleared quickly. Once the log holds one entry per bucket it stops, and
+// clearing visits every bucket instead:
+static OCTO_ALWAYS_INLINE void octo_touch(uint64_t *touched, uint64_t *touched_count, const uint64_t bucket_count, const uint64_t index)
+{
+	if(touched != NULL && *touched_count < bucket_count)
+	{
+		touched[*touched_count] = index;
+		*touched_count += 1;
+	}
+	return;
+}
+
+// Length of the hash stored ahead of each record when opt.cache_hash is set:
+#define OCTO_HASHLEN(opt) ((opt).cache_hash ? sizeof(uint64_t) : 0)
+
+// Load and store a cached hash, which may not be aligned:
+static OCTO_ALWAYS_INLINE uint64_t octo_hash_load(const uint8_t *stored)
+{
+	uint64_t hash;
+	memcpy(&hash, stored, sizeof(hash));
+	return hash;
+}
+
+static OCTO_ALWAYS_INLINE void octo_hash_store(uint8_t *stored, const uint64_t hash)
+{
+	memcpy(stored, &hash, sizeof(hash));
+	return;
+}
+
+// Compare a stored key with a key given in parts, without gathering the parts:
+static OCTO_ALWAYS_INLINE int octo_key_equal(const uint8_t *stored, const octo_iov_t *key, const size_t parts)
+{
+	for(size_t i = 0; i < parts; i++)
+	{
+		if(memcmp(stored, key[i].base, key[i].len) != 0)
+		{
+			return 0;
+		}
+		stored += key[i].len;
+	}
+	return 1;
+}
+
+// Copy a key given in parts into a record:
+static OCTO_ALWAYS_INLINE void octo_key_copy(uint8_t *stored, const octo_iov_t *key, const size_t parts)
+{
+	for(size_t i = 0; i < parts; i++)
+	{
+		memcpy(stored, key[i].base, key[i].len);
+		stored += key[i].len;
+	}
+	return;
+}
+
+// Get the hash of a key handle for a dict. The stored hash is used if the
+// handle was made with the dict's hash function and master key, otherwise the
+// key is hashed again. Return 1 if the key length doesn't match, 0 otherwise.
+static OCTO_ALWAYS_INLINE int octo_key_hash(const octo_key_t *key, const size_t keylen, octo_hash_fn_t fn, const uint8_t *master_key, uint64_t *hash)
+{
+	if(key->keylen != keylen)
+	{
+		return 1;
+	}
+	if(key->fn == fn && memcmp(key->master_key, master_key, 16) == 0)
+	{
+		*hash = key->hash;
+		return 0;
+	}
+	fn(key->key, keylen, (uint8_t *)hash, master_key);
+	return 0;
+}
+
+// Total length of a key given in parts:
+static inline size_t octo_key_length(const octo_iov_t *key, const size_t parts)
+{
+	size_t length = 0;
+	for(size_t i = 0; i < parts; i++)
+	{
+		length += key[i].len;
+	}
+	return length;
+}
+
+#endif
@@ -6,14 +6,68 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <errno.h>
 
 #include <octo/types.h>
 #include <octo/debug.h>
+#include <octo/hash.h>
 #include <octo/keygen.h>
 
+// Each thread keeps its own generator: a secret key, seeded once from the
+// system's entropy source, and a counter. Keys are the keyed hash of the
+// counter, so they're unpredictable without the secret and never repeat.
+static _Thread_local struct
+{
+	int seeded;
+	uint8_t secret[16];
+	uint64_t counter;
+} octo_keygen_state;
+
+// Seed the calling thread's generator. /dev/urandom is preferred; without it
+// the clock, process ID, and a stack address are used instead.
+static void octo_keygen_seed()
+{
+	FILE *urandom = fopen("/dev/urandom", "rb");
+	size_t got = 0;
+	if(urandom != NULL)
+	{
+		got = fread(octo_keygen_state.secret, 1, 16, urandom);
+		fclose(urandom);
+	}
+	if(got != 16)
+	{
+		DEBUG_MSG("unable to read /dev/urandom, seeding from the clock");
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		const uint64_t seed[4] = {(uint64_t)ts.tv_sec, (uint64_t)ts.tv_nsec, (uint64_t)getpid(), (uint64_t)(uintptr_t)&ts};
+		const uint8_t zero_key[16] = {0};
+		octo_hash((const uint8_t *)seed, sizeof(seed), octo_keygen_state.secret, zero_key);
+		octo_hash((const uint8_t *)seed, sizeof(seed) - 8, octo_keygen_state.secret + 8, zero_key);
+	}
+	octo_keygen_state.counter = 0;
+	octo_keygen_state.seeded = 1;
+	return;
+}
+
+// Write a new 16-byte master key to *output without allocating.
+void octo_keygen_fast(uint8_t *output)
+{
+	if(!octo_keygen_state.seeded)
+	{
+		octo_keygen_seed();
+	}
+	for(unsigned int i = 0; i < 2; i++)
+	{
+		const uint64_t block = octo_keygen_state.counter++;
+		octo_hash((const uint8_t *)&block, sizeof(block), output + (8 * i), octo_keygen_state.secret);
+	}
+	return;
+}
+
 uint8_t *octo_keygen()
 {
 	uint8_t *output = malloc(sizeof(uint8_t) * 16);
@@ -23,18 +77,6 @@ uint8_t *octo_keygen()
 		errno = ENOMEM;
 		return NULL;
 	}
-	char *randstate = malloc(256);
-	if(randstate == NULL)
-	{
-		DEBUG_MSG("malloc failed allocating random state array");
-		errno = ENOMEM;
-		return NULL;
-	}
-	initstate((unsigned int)time(NULL), randstate, 256);
-	for(unsigned int i = 0; i < 16; i++)
-	{
-		output[i] = (uint8_t)random();
-	}
-	free(randstate);
+	octo_keygen_fast(output);
 	return output;
 }
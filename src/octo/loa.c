@@ -12,8 +12,16 @@
 #include <octo/hash.h>
 #include <octo/loa.h>
 
-// Allocate memory for and initialize a loa_dict.
+#include "internal.h"
+
+// Allocate memory for and initialize a loa_dict with the default options.
 octo_dict_loa_t *octo_loa_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key)
+{
+	return octo_loa_init_opt(init_keylen, init_vallen, init_buckets, init_master_key, NULL);
+}
+
+// Allocate memory for and initialize a loa_dict with the options in *init_opt.
+octo_dict_loa_t *octo_loa_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t *init_master_key, const octo_opt_t *init_opt)
 {
 	// Make sure the arguments are valid:
 	if(init_keylen <= 0)
@@ -31,20 +39,42 @@ octo_dict_loa_t *octo_loa_init(const size_t init_keylen, const size_t init_valle
 
 	// Allocate the new dict and populate the trivial fields:
 	octo_dict_loa_t *output = malloc(sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating *output");
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(init_opt != NULL)
+	{
+		output->opt = *init_opt;
+	}
+	else
+	{
+		memset(&output->opt, 0, sizeof(output->opt));
+	}
+	const uint64_t bucket_count = octo_index_buckets(output->opt.index_mode, init_buckets);
+	if(bucket_count == 0)
+	{
+		DEBUG_MSG("unknown index mode, or init_buckets too large for it");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
 	output->keylen = init_keylen;
 	output->vallen = init_vallen;
-	const size_t cellen_tmp = init_keylen + init_vallen;
-	if(cellen_tmp < init_keylen)
+	output->hashlen = OCTO_HASHLEN(output->opt);
+	if(init_keylen > SIZE_MAX - output->hashlen || init_vallen > SIZE_MAX - output->hashlen - init_keylen - 1)
 	{
 		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
 		errno = EDOM;
 		free(output);
 		return NULL;
 	}
-	output->cellen = cellen_tmp;
+	output->cellen = output->hashlen + init_keylen + init_vallen;
 
 	// Allocate the array of buckets:
-	void *buckets_tmp = calloc(init_buckets, output->cellen + 1);
+	void *buckets_tmp = calloc(bucket_count, output->cellen + 1);
 	if(buckets_tmp == NULL)
 	{
 		DEBUG_MSG("unable to allocate buckets");
@@ -52,422 +82,756 @@ octo_dict_loa_t *octo_loa_init(const size_t init_keylen, const size_t init_valle
 		free(output);
 		return NULL;
 	}
-	output->bucket_count = init_buckets;
+	output->bucket_count = bucket_count;
 	output->buckets = buckets_tmp;
+	output->records = 0;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = 0;
+	output->touched = NULL;
+	output->touched_count = 0;
 	memcpy(output->master_key, init_master_key, 16);
+	output->hash = octo_hash_select(output->opt.hash, init_keylen);
 	return output;
 }
 
 // Delete a loa_dict.
 void octo_loa_free(octo_dict_loa_t *target)
 {
+	if(target->old != NULL)
+	{
+		octo_loa_free(target->old);
+	}
 	free(target->buckets);
+	free(target->touched);
 	free(target);
 	return;
 }
 
-// Insert a value into a loa_dict. Return 0 on success, 1 on full bucket array.
-int octo_loa_insert(const void *key, const void *value, const octo_dict_loa_t *dict)
-{
-	uint64_t hash;
-	uint64_t index;
+// Bucket accessors. Each bucket is a state byte, the record's cached hash(if
+// enabled), and then the record:
+#define LOA_BUCKET(dict, i) ((uint8_t *)(dict)->buckets + ((i) * ((dict)->cellen + 1)))
+#define LOA_CELL(b) ((uint8_t *)(b) + 1)
+#define LOA_RECORD(b, dict) (LOA_CELL(b) + (dict)->hashlen)
 
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
+// Bucket states:
+#define LOA_EMPTY 0
+#define LOA_DELETED 0xbe
+#define LOA_FULL 0xff
 
-	// If there's nothing in the bucket yet, insert the record:
-	if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0 || *((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0xbe)
+// The next bucket in a probe sequence. Power-of-two tables wrap with a mask:
+static OCTO_ALWAYS_INLINE uint64_t loa_next(const octo_dict_loa_t *dict, const uint64_t index)
+{
+	if(dict->opt.index_mode == OCTO_INDEX_POW2)
 	{
-		*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) = 0xff;
-		memcpy((uint8_t*)dict->buckets + (index * (dict->cellen + 1)) + 1, key, dict->keylen);
-		memcpy((uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen, value, dict->vallen);
-		return 0;
+		return (index + 1) & (dict->bucket_count - 1);
 	}
-	// Are we updating a key's value?
-	else if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+	return index + 1 < dict->bucket_count ? index + 1 : 0;
+}
+
+// Check whether a full bucket holds the given key. With cached hashes, only
+// compare keys whose hashes match:
+static OCTO_ALWAYS_INLINE bool loa_match(const octo_dict_loa_t *dict, const uint8_t *bucket, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->hashlen != 0 && octo_hash_load(LOA_CELL(bucket)) != hash)
 	{
-		memcpy((uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen, value, dict->vallen);
-		return 0;
+		return false;
 	}
+	return octo_key_equal(LOA_RECORD(bucket, dict), key, parts);
+}
 
-	// Linearly probe the remaining addresses:
-	uint64_t atmpt = 1;
-	while(atmpt <= dict->bucket_count)
+static int loa_insert_fallback(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+static int loa_insert_rekey(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+
+// Insert a record with the given key hash. Return values are as for octo_loa_insert.
+static OCTO_ALWAYS_INLINE int loa_insert(const octo_dict_loa_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	uint64_t index = octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+	uint8_t *slot = NULL;
+
+	// Linearly probe for the key, remembering the first bucket we could use.
+	// The key may live past deleted buckets, so only an empty one ends the search:
+	uint64_t atmpt = 0;
+	for(; atmpt < dict->bucket_count; atmpt++)
 	{
-		index = index + 1 < dict->bucket_count ? index + 1 : 0;
-		// Is this bucket available?
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0 || *((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0xbe)
+		uint8_t *bucket = LOA_BUCKET(dict, index);
+		if(*bucket == LOA_FULL)
 		{
-			*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) = 0xff;
-			memcpy((uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, key, dict->keylen);
-			memcpy((uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen, value, dict->vallen);
-			return 0;
+			// Are we updating a key's value?
+			if(loa_match(dict, bucket, hash, key, parts))
+			{
+				memcpy(LOA_RECORD(bucket, dict) + dict->keylen, value, dict->vallen);
+				return 0;
+			}
 		}
-		// Did we find the key?
-		else if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+		else
 		{
-			memcpy((uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen, value, dict->vallen);
-			return 0;
+			if(slot == NULL)
+			{
+				slot = bucket;
+			}
+			if(*bucket == LOA_EMPTY)
+			{
+				break;
+			}
 		}
-		atmpt++;
+		index = loa_next(dict, index);
 	}
-	return 1;
+
+	// A long probe suggests a collision attack. Nothing is done about it while
+	// an earlier rekey is still being migrated, or if the table is simply
+	// full, since a new table of the same size couldn't hold another record:
+	if(dict->old == NULL && slot != NULL)
+	{
+		if(octo_hw_flooded(&dict->opt, atmpt))
+		{
+			return loa_insert_fallback(dict, key, parts, value);
+		}
+		if(octo_rekey_due(&dict->opt, atmpt))
+		{
+			return loa_insert_rekey(dict, key, parts, value);
+		}
+	}
+	if(slot == NULL)
+	{
+		return 1;
+	}
+	// Deleted buckets were full once, so they're already in the log:
+	if(*slot == LOA_EMPTY)
+	{
+		octo_touch(dict->touched, &((octo_dict_loa_t *)dict)->touched_count, dict->bucket_count, (uint64_t)(slot - (uint8_t *)dict->buckets) / (dict->cellen + 1));
+	}
+	*slot = LOA_FULL;
+	((octo_dict_loa_t *)dict)->records++;
+	if(dict->hashlen != 0)
+	{
+		octo_hash_store(LOA_CELL(slot), hash);
+	}
+	octo_key_copy(LOA_RECORD(slot, dict), key, parts);
+	memcpy(LOA_RECORD(slot, dict) + dict->keylen, value, dict->vallen);
+	return 0;
 }
 
-// Fetch a value from a loa_dict. Return NULL on error, return a pointer to
-// the loa_dict itself if the value is not found. The pointer referes to the
-// literal location of the value; if you don't want that, use *fetch_safe.
-void *octo_loa_fetch(const void *key, const octo_dict_loa_t *dict)
+// Remove every record from a loa_dict. Only the buckets that have been used
+// are visited if the dict keeps track of them.
+void octo_loa_clear(octo_dict_loa_t *dict)
 {
-	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
-
-	// Is the bucket occupied?
-	if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) != 0xff)
+	if(dict->old != NULL)
 	{
-		return (void *)dict;
+		octo_loa_free(dict->old);
+		dict->old = NULL;
+		dict->migrated = 0;
 	}
-	// If so, did we find the key?
-	if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+	if(dict->touched != NULL && dict->touched_count < dict->bucket_count)
 	{
-		return (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen;
+		for(uint64_t i = 0; i < dict->touched_count; i++)
+		{
+			*LOA_BUCKET(dict, dict->touched[i]) = LOA_EMPTY;
+		}
+	}
+	else
+	{
+		memset(dict->buckets, 0, dict->bucket_count * (dict->cellen + 1));
 	}
+	dict->records = 0;
+	dict->touched_count = 0;
+	return;
+}
 
-	uint64_t atmpt = 1;
-	while(atmpt <= dict->bucket_count)
+// Find the bucket holding the given key. Return a pointer to the bucket, or
+// NULL if the key isn't in the dict.
+static OCTO_ALWAYS_INLINE uint8_t *loa_find(const octo_dict_loa_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	uint64_t index = octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+	for(uint64_t atmpt = 0; atmpt < dict->bucket_count; atmpt++)
 	{
-		index = index + 1 < dict->bucket_count ? index + 1 : 0;
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0xbe)
+		uint8_t *bucket = LOA_BUCKET(dict, index);
+		if(*bucket == LOA_EMPTY)
 		{
-			atmpt++;
-			continue;
+			return NULL;
 		}
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0)
+		if(*bucket == LOA_FULL && loa_match(dict, bucket, hash, key, parts))
 		{
-			return (void *)dict;
+			return bucket;
 		}
-		if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+		index = loa_next(dict, index);
+	}
+	return NULL;
+}
+
+// Move up to count buckets of the table being drained by a rekey into the
+// current one, and free it once it's empty. Return 0 on success, 1 if a record
+// couldn't be moved; the dict stays usable.
+static int loa_migrate(octo_dict_loa_t *dict, uint64_t count)
+{
+	octo_dict_loa_t *old = dict->old;
+	if(old == NULL)
+	{
+		return 0;
+	}
+	for(; count > 0 && dict->migrated < old->bucket_count; count--)
+	{
+		uint8_t *bucket = LOA_BUCKET(old, dict->migrated);
+		if(*bucket == LOA_FULL)
 		{
-			return (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen;
+			const octo_iov_t flat = {LOA_RECORD(bucket, old), old->keylen};
+			uint64_t hash;
+			dict->hash(flat.base, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+			if(loa_insert(dict, hash, &flat, 1, LOA_RECORD(bucket, old) + old->keylen) != 0)
+			{
+				DEBUG_MSG("insertion failed while migrating a rekey, will retry");
+				return 1;
+			}
+			// Moved records leave a deleted mark, so probes past them still work:
+			*bucket = LOA_DELETED;
+			old->records--;
 		}
-		atmpt++;
+		dict->migrated++;
+	}
+	if(dict->migrated == old->bucket_count)
+	{
+		octo_loa_free(old);
+		dict->old = NULL;
+		dict->migrated = 0;
 	}
-	return (void *)dict;
+	return 0;
 }
 
-// Fetch a value from a loa_dict. Return NULL on error, return a pointer to
-// the loa_dict itself if the value is not found.
-void *octo_loa_fetch_safe(const void *key, const octo_dict_loa_t *dict)
+// Hash a key for the old table during a rekey. Return 0 on success, 1 if the
+// key parts couldn't be gathered.
+static int loa_old_hash(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
 {
-	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
+	const octo_dict_loa_t *old = dict->old;
+	if(octo_hash_parts(old->hash, old->opt.hash, key, parts, old->master_key, hash) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return 1;
+	}
+	return 0;
+}
+
+// Find the bucket of the old table holding a key during a rekey. Return NULL
+// if it isn't there or the key parts couldn't be gathered.
+static uint8_t *loa_find_old(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts)
+{
+	uint64_t old_hash;
+	return loa_old_hash(dict, key, parts, &old_hash) != 0 ? NULL : loa_find(dict->old, old_hash, key, parts);
+}
+
+// Insert a record while a rekey is in progress. A key that hasn't been moved
+// yet is updated in the old table, so it's never in both.
+static int loa_insert_rekeying(const octo_dict_loa_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	uint64_t old_hash;
+	if(loa_old_hash(dict, key, parts, &old_hash) != 0)
+	{
+		return 1;
+	}
+	int ret = 0;
+	uint8_t *bucket = loa_find(dict->old, old_hash, key, parts);
+	if(bucket != NULL)
+	{
+		memcpy(LOA_RECORD(bucket, dict) + dict->keylen, value, dict->vallen);
+	}
+	else if(loa_find(dict, hash, key, parts) == NULL && dict->records + dict->old->records >= dict->bucket_count)
+	{
+		// Every record still in the old table needs a bucket in this one, so
+		// a new key only fits if both tables together have room for it:
+		DEBUG_MSG("loa_dict is full");
+		ret = 1;
+	}
+	else
+	{
+		ret = loa_insert(dict, hash, key, parts, value);
+	}
+	loa_migrate((octo_dict_loa_t *)dict, octo_rekey_step(&dict->opt));
+	return ret;
+}
 
-	// Is the bucket occupied?
-	if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) != 0xff)
+// Insert a record with the given key hash, minding a rekey in progress.
+static OCTO_ALWAYS_INLINE int loa_put(const octo_dict_loa_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	if(dict->old != NULL)
 	{
-		return (void *)dict;
+		return loa_insert_rekeying(dict, hash, key, parts, value);
 	}
-	// If so, did we find the key?
-	if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+	return loa_insert(dict, hash, key, parts, value);
+}
+
+// Find the record with the given key hash. Return a pointer to the record, or
+// NULL if it isn't in the dict.
+static OCTO_ALWAYS_INLINE uint8_t *loa_lookup(const octo_dict_loa_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	uint8_t *bucket = loa_find(dict, hash, key, parts);
+	if(bucket == NULL && dict->old != NULL)
 	{
-		void *output = malloc(dict->vallen);
-		if(output == NULL)
-		{
-			DEBUG_MSG("key found, but malloc failed");
-			errno = ENOMEM;
-			return NULL;
-		}
-		memcpy(output, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen, dict->vallen);
-		return output;
+		bucket = loa_find_old(dict, key, parts);
 	}
+	return bucket == NULL ? NULL : LOA_RECORD(bucket, dict);
+}
 
-	uint64_t atmpt = 1;
-	while(atmpt <= dict->bucket_count)
+// Copy the value of a found record into a dedicated heap block.
+static void *loa_copy_value(const octo_dict_loa_t *dict, const uint8_t *record)
+{
+	void *output = malloc(dict->vallen);
+	if(output == NULL)
 	{
-		index = index + 1 < dict->bucket_count ? index + 1 : 0;
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0xbe)
-		{
-			atmpt++;
-			continue;
-		}
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0)
+		DEBUG_MSG("key found, but malloc failed");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(output, record + dict->keylen, dict->vallen);
+	return output;
+}
+
+// Delete the record with the given key hash. Return values are as for octo_loa_delete.
+static OCTO_ALWAYS_INLINE int loa_delete(const octo_dict_loa_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	uint8_t *bucket = loa_find(dict, hash, key, parts);
+	if(dict->old != NULL)
+	{
+		if(bucket != NULL)
 		{
-			return (void *)dict;
+			*bucket = LOA_DELETED;
+			((octo_dict_loa_t *)dict)->records--;
 		}
-		if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+		else
 		{
-			void *output = malloc(dict->vallen);
-			if(output == NULL)
+			bucket = loa_find_old(dict, key, parts);
+			if(bucket != NULL)
 			{
-				DEBUG_MSG("key found, but malloc failed");
-				errno = ENOMEM;
-				return NULL;
+				*bucket = LOA_DELETED;
+				dict->old->records--;
 			}
-			memcpy(output, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1 + dict->keylen, dict->vallen);
-			return output;
 		}
-		atmpt++;
+		loa_migrate((octo_dict_loa_t *)dict, octo_rekey_step(&dict->opt));
+		return bucket != NULL;
+	}
+	if(bucket == NULL)
+	{
+		return 0;
 	}
-	return (void *)dict;
+	*bucket = LOA_DELETED;
+	((octo_dict_loa_t *)dict)->records--;
+	return 1;
+}
+
+// Get the hash of the record in a full bucket, from the cache if there is one:
+static uint64_t loa_bucket_hash(const octo_dict_loa_t *dict, const uint8_t *bucket)
+{
+	if(dict->hashlen != 0)
+	{
+		return octo_hash_load(LOA_CELL(bucket));
+	}
+	uint64_t hash;
+	dict->hash(LOA_RECORD(bucket, dict), dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+	return hash;
+}
+
+// Hash a flat key for a loa_dict:
+static OCTO_ALWAYS_INLINE uint64_t loa_hash(const octo_dict_loa_t *dict, const void *key)
+{
+	uint64_t hash;
+	dict->hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+	return hash;
+}
+
+// Hash a key given in parts for a loa_dict. Return 0 on success, 1 if the
+// parts don't add up to the dict's key length or hashing them failed.
+static int loa_hash_iov(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	if(octo_key_length(key, parts) != dict->keylen)
+	{
+		DEBUG_MSG("key parts don't add up to the key length");
+		errno = EINVAL;
+		return 1;
+	}
+	if(octo_hash_iov(octo_iov_base(dict->hash, dict->opt.hash), key, parts, (uint8_t *)hash, (const uint8_t *)dict->master_key) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return 1;
+	}
+	return 0;
+}
+
+// Insert a value into a loa_dict. Return 0 on success, 1 on full bucket array.
+int octo_loa_insert(const void *key, const void *value, const octo_dict_loa_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return loa_put(dict, loa_hash(dict, key), &flat, 1, value);
+}
+
+// Fetch a value from a loa_dict. Return NULL on error, return a pointer to
+// the loa_dict itself if the value is not found. The pointer refers to the
+// literal location of the value; if you don't want that, use *fetch_safe.
+void *octo_loa_fetch(const void *key, const octo_dict_loa_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *record = loa_lookup(dict, loa_hash(dict, key), &flat, 1);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Fetch a value from a loa_dict. Return NULL on error, return a pointer to
+// the loa_dict itself if the value is not found.
+void *octo_loa_fetch_safe(const void *key, const octo_dict_loa_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *record = loa_lookup(dict, loa_hash(dict, key), &flat, 1);
+	return record == NULL ? (void *)dict : loa_copy_value(dict, record);
 }
 
 // Like octo_loa_fetch, but don't malloc/memcpy the value.
 // Return 1 if found, 0 if not.
 int octo_loa_poke(const void *key, const octo_dict_loa_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return loa_lookup(dict, loa_hash(dict, key), &flat, 1) != NULL;
+}
+
+// Delete the record with the given key. Return 1 on successful delete,
+// 0 if the record isn't found.
+int octo_loa_delete(const void *key, const octo_dict_loa_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return loa_delete(dict, loa_hash(dict, key), &flat, 1);
+}
+
+// Like octo_loa_insert, but the key is given in parts that add up to keylen.
+int octo_loa_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return 1;
+	}
+	return loa_put(dict, hash, key, parts, value);
+}
+
+// Like octo_loa_fetch, but the key is given in parts that add up to keylen.
+void *octo_loa_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return NULL;
+	}
+	uint8_t *record = loa_lookup(dict, hash, key, parts);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Like octo_loa_fetch_safe, but the key is given in parts that add up to keylen.
+void *octo_loa_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
+	if(loa_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return NULL;
+	}
+	uint8_t *record = loa_lookup(dict, hash, key, parts);
+	return record == NULL ? (void *)dict : loa_copy_value(dict, record);
+}
 
-	// Is the bucket occupied?
-	if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) != 0xff)
+// Like octo_loa_poke, but the key is given in parts that add up to keylen.
+int octo_loa_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_iov(dict, key, parts, &hash) != 0)
 	{
 		return 0;
 	}
-	// If so, did we find the key?
-	if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+	return loa_lookup(dict, hash, key, parts) != NULL;
+}
+
+// Like octo_loa_delete, but the key is given in parts that add up to keylen.
+int octo_loa_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_iov(dict, key, parts, &hash) != 0)
 	{
-		return 1;
+		return 0;
 	}
+	return loa_delete(dict, hash, key, parts);
+}
 
-	uint64_t atmpt = 1;
-	while(atmpt <= dict->bucket_count)
+// Hash a key handle for a loa_dict. Return 0 on success, 1 if the handle's
+// key length doesn't match the dict's.
+static OCTO_ALWAYS_INLINE int loa_hash_h(const octo_dict_loa_t *dict, const octo_key_t *key, uint64_t *hash)
+{
+	if(octo_key_hash(key, dict->keylen, dict->hash, dict->master_key, hash) != 0)
 	{
-		index = index + 1 < dict->bucket_count ? index + 1 : 0;
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0xbe)
-		{
-			atmpt++;
-			continue;
-		}
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0)
-		{
-			return 0;
-		}
-		if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
-		{
-			return 1;
-		}
-		atmpt++;
+		DEBUG_MSG("key handle length doesn't match the key length");
+		errno = EINVAL;
+		return 1;
 	}
 	return 0;
 }
 
-// Delete the record with the given key. Return 1 on successful delete,
-// 0 if the record isn't found.
-int octo_loa_delete(const void *key, const octo_dict_loa_t *dict)
+// Fill in a key handle for use with this dict, or any other dict sharing its
+// key length, hash function and master key.
+void octo_loa_key(octo_key_t *handle, const void *key, const octo_dict_loa_t *dict)
+{
+	octo_key_init(handle, key, dict->keylen, dict->opt.hash, dict->master_key);
+	return;
+}
+
+// Like octo_loa_insert, but take a key handle.
+int octo_loa_insert_h(const octo_key_t *key, const void *value, const octo_dict_loa_t *dict)
 {
 	uint64_t hash;
-	uint64_t index;
-	octo_hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-	index = hash % dict->bucket_count;
+	if(loa_hash_h(dict, key, &hash) != 0)
+	{
+		return 1;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return loa_put(dict, hash, &flat, 1, value);
+}
 
-	// Is the bucket occupied?
-	if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) != 0xff)
+// Like octo_loa_fetch, but take a key handle.
+void *octo_loa_fetch_h(const octo_key_t *key, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_h(dict, key, &hash) != 0)
+	{
+		return NULL;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *record = loa_lookup(dict, hash, &flat, 1);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Like octo_loa_fetch_safe, but take a key handle.
+void *octo_loa_fetch_safe_h(const octo_key_t *key, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_h(dict, key, &hash) != 0)
+	{
+		return NULL;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *record = loa_lookup(dict, hash, &flat, 1);
+	return record == NULL ? (void *)dict : loa_copy_value(dict, record);
+}
+
+// Like octo_loa_poke, but take a key handle.
+int octo_loa_poke_h(const octo_key_t *key, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_h(dict, key, &hash) != 0)
 	{
 		return 0;
 	}
-	// If so, did we find the key?
-	if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return loa_lookup(dict, hash, &flat, 1) != NULL;
+}
+
+// Like octo_loa_delete, but take a key handle.
+int octo_loa_delete_h(const octo_key_t *key, const octo_dict_loa_t *dict)
+{
+	uint64_t hash;
+	if(loa_hash_h(dict, key, &hash) != 0)
 	{
-		*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) = 0xbe;
-		return 1;
+		return 0;
 	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return loa_delete(dict, hash, &flat, 1);
+}
 
-	uint64_t atmpt = 1;
-	while(atmpt <= dict->bucket_count)
+// Insert the records of the full buckets of table, from index start on, into
+// output, reading keys and values through buffers sized for output. Return 0
+// on success, 1 if output is full.
+static int loa_rehash_table(const octo_dict_loa_t *table, const uint64_t start, octo_dict_loa_t *output, void *key_buffer, void *val_buffer)
+{
+	const size_t buffer_keylen = table->keylen < output->keylen ? table->keylen : output->keylen;
+	const size_t buffer_vallen = table->vallen < output->vallen ? table->vallen : output->vallen;
+	// Cached hashes are still valid if the key, hash function, and master key are unchanged:
+	const int reuse_hash = table->hashlen != 0 && table->keylen == output->keylen && table->hash == output->hash
+		&& memcmp(table->master_key, output->master_key, 16) == 0;
+	const octo_iov_t flat = {key_buffer, output->keylen};
+	uint64_t hash;
+	for(uint64_t i = start; i < table->bucket_count; i++)
 	{
-		index = index + 1 < dict->bucket_count ? index + 1 : 0;
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0xbe)
+		const uint8_t *bucket = LOA_BUCKET(table, i);
+		if(*bucket != LOA_FULL)
 		{
-			atmpt++;
 			continue;
 		}
-		if(*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) == 0)
+		memcpy(key_buffer, LOA_RECORD(bucket, table), buffer_keylen);
+		memcpy(val_buffer, LOA_RECORD(bucket, table) + table->keylen, buffer_vallen);
+		if(reuse_hash)
+		{
+			hash = octo_hash_load(LOA_CELL(bucket));
+		}
+		else
 		{
-			return 0;
+			output->hash((const uint8_t *)key_buffer, output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
 		}
-		if(memcmp(key, (uint8_t *)dict->buckets + (index * (dict->cellen + 1)) + 1, dict->keylen) == 0)
+		if(loa_insert(output, hash, &flat, 1, val_buffer) != 0)
 		{
-			*((uint8_t *)dict->buckets + (index * (dict->cellen + 1))) = 0xbe;
 			return 1;
 		}
-		atmpt++;
 	}
 	return 0;
 }
 
-// Re-create the loa_dict with a new key length, value length(both will be truncated), number of buckets,
-// and/or new master_key. Return pointer to new loa_dict on success, NULL on failure.
-octo_dict_loa_t *octo_loa_rehash(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+// Build a new loa_dict from the records in *dict, including those a rekey in
+// progress hasn't moved yet. If keep is zero, the old dict is freed once every
+// record has been moved.
+static octo_dict_loa_t *loa_rehash(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key, const int keep)
 {
-	// Make sure the arguments are valid:
-	if(new_keylen <= 0)
-	{
-		DEBUG_MSG("key length must not be zero");
-		errno = EINVAL;
-		return NULL;
-	}
-	if(new_buckets <= 0)
-	{
-		DEBUG_MSG("init_buckets must not be zero");
-		errno = EINVAL;
-		return NULL;
-	}
-
-	// Allocate the new dict and populate trivial fields:
-	octo_dict_loa_t *output = malloc(sizeof(*output));
+	// Allocate the new dict with the same options; this validates the arguments:
+	octo_dict_loa_t *output = octo_loa_init_opt(new_keylen, new_vallen, new_buckets, new_master_key, &dict->opt);
 	if(output == NULL)
 	{
-		DEBUG_MSG("malloc failed allocating *output");
-		errno = ENOMEM;
-		return NULL;
-	}
-	output->keylen = new_keylen;
-	output->vallen = new_vallen;
-	const size_t new_cellen = new_keylen + new_vallen;
-	if(new_cellen < new_keylen)
-	{
-		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
-		errno = EDOM;
-		free(output);
 		return NULL;
 	}
-	output->cellen = new_cellen;
-	output->bucket_count = new_buckets;
-	memcpy(output->master_key, new_master_key, 16);
 	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
 	void *key_buffer = calloc(1, output->keylen);
-	void *val_buffer = calloc(1, output->vallen);
+	void *val_buffer = calloc(1, output->vallen + 1);
 	if(key_buffer == NULL || val_buffer == NULL)
 	{
 		DEBUG_MSG("malloc failed while allocating key/val buffer");
 		errno = ENOMEM;
+		free(key_buffer);
+		free(val_buffer);
 		octo_loa_free(output);
 		return NULL;
 	}
-	size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
-	size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
-
-	// Allocate the new array of buckets:
-	void *buckets_tmp = calloc(new_buckets, output->cellen + 1);
-	if(buckets_tmp == NULL)
+	output->flood_events = dict->flood_events;
+	// The old table's buckets before dict->migrated hold no records any more:
+	int failed = loa_rehash_table(dict, 0, output, key_buffer, val_buffer);
+	if(failed == 0 && dict->old != NULL)
 	{
-		DEBUG_MSG("unable to malloc for *buckets_tmp");
-		errno = ENOMEM;
-		free(output);
+		failed = loa_rehash_table(dict->old, dict->migrated, output, key_buffer, val_buffer);
+	}
+	free(key_buffer);
+	free(val_buffer);
+	if(failed != 0)
+	{
+		// The old dict is only freed after a successful rehash:
+		DEBUG_MSG("insertion failed during rehash, original loa_dict in known-good state");
+		octo_loa_free(output);
 		return NULL;
 	}
-	output->buckets = buckets_tmp;
-
-	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	if(!keep)
 	{
-		if(*((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0 || *((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0xbe)
-		{
-			continue;
-		}
-		memcpy(key_buffer, (uint8_t *)dict->buckets + (i * (dict->cellen + 1)) + 1, buffer_keylen);
-		memcpy(val_buffer, (uint8_t *)dict->buckets + (i * (dict->cellen + 1)) + 1 + dict->keylen, buffer_vallen);
-		if(octo_loa_insert(key_buffer, val_buffer, output) == 1)
-		{
-			DEBUG_MSG("octo_loa_insert failed, data may be recoverable");
-			octo_loa_free(output);
-			return NULL;
-		}
+		// At this point we're finished with the old dict, free it:
+		octo_loa_free(dict);
 	}
-	// At this point we're finished with the old dict, free it:
-	free(dict->buckets);
-	free(dict);
-	free(key_buffer);
-	free(val_buffer);
 	return output;
 }
 
-// Like octo_loa_rehash, but retain the original dict. It is up to the caller
-// to free the old dict.
-octo_dict_loa_t *octo_loa_rehash_safe(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+// Give the dict an empty table keyed with new_master_key, keeping the current
+// one as the old table to be drained. The struct itself stays put, so the
+// caller's dict pointer remains valid.
+static int loa_rekey(octo_dict_loa_t *dict, const uint8_t *new_master_key)
 {
-	// Make sure the arguments are valid:
-	if(new_keylen <= 0)
-	{
-		DEBUG_MSG("key length must not be zero");
-		errno = EINVAL;
-		return NULL;
-	}
-	if(new_buckets <= 0)
+	// Only one old table is kept, so finish any earlier rekey first:
+	if(loa_migrate(dict, UINT64_MAX) != 0)
 	{
-		DEBUG_MSG("init_buckets must not be zero");
-		errno = EINVAL;
-		return NULL;
+		return 1;
 	}
-
-	// Allocate the new dict and populate trivial fields:
-	octo_dict_loa_t *output = malloc(sizeof(*output));
+	octo_dict_loa_t *output = octo_loa_init_opt(dict->keylen, dict->vallen, dict->bucket_count, new_master_key, &dict->opt);
 	if(output == NULL)
 	{
-		DEBUG_MSG("malloc failed allocating *output");
-		errno = ENOMEM;
-		return NULL;
+		return 1;
 	}
-	output->keylen = new_keylen;
-	output->vallen = new_vallen;
-	const size_t new_cellen = new_keylen + new_vallen;
-	if(new_cellen < new_keylen)
+	octo_dict_loa_t old = *dict;
+	*dict = *output;
+	*output = old;
+	dict->old = output;
+	// A pooled dict's log of used buckets stays with the live table, which
+	// starts out with none:
+	dict->touched = output->touched;
+	dict->touched_count = 0;
+	output->touched = NULL;
+	dict->flood_events = output->flood_events;
+	return 0;
+}
+
+// Switch a flooded octo_hash_hw dict over to octo_hash, then retry the insertion.
+// The records move to an octo_hash table through an ordinary rekey, a few
+// buckets at a time, while the old table keeps hashing with octo_hash_hw.
+static int loa_insert_fallback(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long probe in octo_hash_hw loa_dict, falling back to octo_hash");
+	octo_dict_loa_t *target = (octo_dict_loa_t *)dict;
+	// The new table takes the dict's options:
+	target->opt.hash = octo_hash;
+	if(loa_rekey(target, target->master_key) != 0)
 	{
-		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
-		errno = EDOM;
-		free(output);
-		return NULL;
+		target->opt.hash = octo_hash_hw;
+		return 1;
 	}
-	output->cellen = new_cellen;
-	output->bucket_count = new_buckets;
-	memcpy(output->master_key, new_master_key, 16);
-	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
-	void *key_buffer = calloc(1, output->keylen);
-	void *val_buffer = calloc(1, output->vallen);
-	if(key_buffer == NULL || val_buffer == NULL)
+	target->old->opt.hash = octo_hash_hw;
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
 	{
-		DEBUG_MSG("malloc failed while allocating key/val buffer");
 		errno = ENOMEM;
-		octo_loa_free(output);
-		return NULL;
+		return 1;
 	}
-	size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
-	size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
+	return loa_insert(target, hash, key, parts, value);
+}
 
-	// Allocate the new array of buckets:
-	void *buckets_tmp = calloc(new_buckets, output->cellen + 1);
-	if(buckets_tmp == NULL)
+// Start rekeying a dict with a suspiciously long probe, then retry the
+// insertion in the new table.
+static int loa_insert_rekey(const octo_dict_loa_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long probe in loa_dict, rekeying");
+	octo_dict_loa_t *target = (octo_dict_loa_t *)dict;
+	uint8_t new_master_key[16];
+	octo_rekey_master(target->master_key, target->flood_events, new_master_key);
+	if(loa_rekey(target, new_master_key) != 0)
+	{
+		return 1;
+	}
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
 	{
-		DEBUG_MSG("unable to malloc for *buckets_tmp");
 		errno = ENOMEM;
-		free(output);
-		return NULL;
+		return 1;
 	}
-	output->buckets = buckets_tmp;
+	return loa_insert(target, hash, key, parts, value);
+}
 
-	for(uint64_t i = 0; i < dict->bucket_count; i++)
+// Start moving the records of a loa_dict to a table keyed with new_master_key,
+// or with a freshly derived key if new_master_key is NULL. Records are moved a
+// few buckets at a time by later insertions and deletions, or by
+// octo_loa_migrate, and can be found throughout. Return 0 on success, 1 on failure.
+int octo_loa_rekey(octo_dict_loa_t *dict, const uint8_t *new_master_key)
+{
+	uint8_t derived_key[16];
+	if(new_master_key == NULL)
 	{
-		if(*((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0 || *((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0xbe)
-		{
-			continue;
-		}
-		memcpy(key_buffer, (uint8_t *)dict->buckets + (i * (dict->cellen + 1)) + 1, buffer_keylen);
-		memcpy(val_buffer, (uint8_t *)dict->buckets + (i * (dict->cellen + 1)) + 1 + dict->keylen, buffer_vallen);
-		if(octo_loa_insert(key_buffer, val_buffer, output) == 1)
-		{
-			DEBUG_MSG("octo_loa_insert failed, original dict in known-good state");
-			octo_loa_free(output);
-			return NULL;
-		}
+		octo_rekey_master(dict->master_key, dict->flood_events, derived_key);
+		new_master_key = derived_key;
 	}
-	free(key_buffer);
-	free(val_buffer);
-	return output;
+	return loa_rekey(dict, new_master_key);
+}
+
+// Move up to the given number of old buckets during a rekey. The rekey is
+// finished once dict->old is NULL. Return 0 on success, 1 if a record couldn't
+// be moved.
+int octo_loa_migrate(octo_dict_loa_t *dict, const uint64_t buckets)
+{
+	return loa_migrate(dict, buckets);
+}
+
+// Re-create the loa_dict with a new key length, value length(both will be truncated), number of buckets,
+// and/or new master_key. Return pointer to new loa_dict on success, NULL on failure.
+octo_dict_loa_t *octo_loa_rehash(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+{
+	return loa_rehash(dict, new_keylen, new_vallen, new_buckets, new_master_key, 0);
+}
+
+// Like octo_loa_rehash, but retain the original dict. It is up to the caller
+// to free the old dict.
+octo_dict_loa_t *octo_loa_rehash_safe(octo_dict_loa_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t *new_master_key)
+{
+	return loa_rehash(dict, new_keylen, new_vallen, new_buckets, new_master_key, 1);
 }
 
 // Make a deep copy of a loa_dict. Return NULL on error, pointer to the new
@@ -475,6 +839,11 @@ octo_dict_loa_t *octo_loa_rehash_safe(octo_dict_loa_t *dict, const size_t new_ke
 // other dict types.
 octo_dict_loa_t *octo_loa_clone(octo_dict_loa_t *dict)
 {
+	// Finish any rekey in progress, so only one table has to be copied:
+	if(loa_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
 	// Allocate the new dict and populate trivial fields:
 	octo_dict_loa_t *output = malloc(sizeof(*output));
 	if(output == NULL)
@@ -486,8 +855,17 @@ octo_dict_loa_t *octo_loa_clone(octo_dict_loa_t *dict)
 	output->keylen = dict->keylen;
 	output->vallen = dict->vallen;
 	output->cellen = dict->cellen;
+	output->hashlen = dict->hashlen;
 	output->bucket_count = dict->bucket_count;
 	memcpy(output->master_key, dict->master_key, 16);
+	output->hash = dict->hash;
+	output->opt = dict->opt;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = dict->flood_events;
+	output->records = dict->records;
+	output->touched = NULL;
+	output->touched_count = 0;
 
 	// Allocate the new array of buckets:
 	void *buckets_tmp = calloc(output->bucket_count, output->cellen + 1);
@@ -500,13 +878,18 @@ octo_dict_loa_t *octo_loa_clone(octo_dict_loa_t *dict)
 	}
 	output->buckets = buckets_tmp;
 	// Nice and easy:
-	memcpy(output->buckets, dict->buckets, output->bucket_count * (output->cellen * 1));
+	memcpy(output->buckets, dict->buckets, output->bucket_count * (output->cellen + 1));
 	return output;
 }
 
 // Populate and return a pointer to an octo_stat_loa_t on success, NULL on error.
 octo_stat_loa_t *octo_loa_stats(octo_dict_loa_t *dict)
 {
+	// Finish any rekey in progress, so only one table has to be counted:
+	if(loa_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
 	octo_stat_loa_t *output = calloc(1, sizeof(*output));
 	if(output == NULL)
 	{
@@ -514,22 +897,21 @@ octo_stat_loa_t *octo_loa_stats(octo_dict_loa_t *dict)
 		errno = ENOMEM;
 		return NULL;
 	}
-	uint64_t hash;
 	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		if(*((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0)
+		const uint8_t *bucket = LOA_BUCKET(dict, i);
+		if(*bucket == LOA_EMPTY)
 		{
 			output->empty_buckets++;
 			continue;
 		}
-		if(*((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0xbe)
+		if(*bucket == LOA_DELETED)
 		{
 			output->garbage_buckets++;
 			continue;
 		}
 		output->total_entries++;
-		octo_hash((uint8_t const *)dict->buckets + (i * (dict->cellen + 1)) + 1, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-		if(i == hash % dict->bucket_count)
+		if(i == octo_index(dict->opt.index_mode, loa_bucket_hash(dict, bucket), dict->bucket_count))
 		{
 			output->optimal_buckets++;
 		}
@@ -538,12 +920,13 @@ octo_stat_loa_t *octo_loa_stats(octo_dict_loa_t *dict)
 			output->colliding_buckets++;
 		}
 	}
-	if((output->empty_buckets + output->optimal_buckets + output->colliding_buckets) != dict->bucket_count)
+	if((output->empty_buckets + output->garbage_buckets + output->optimal_buckets + output->colliding_buckets) != dict->bucket_count)
 	{
 		DEBUG_MSG("sum of bucket types not equal to bucket count");
 		free(output);
 		return NULL;
 	}
+	output->flood_events = dict->flood_events;
 	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
 	return output;
 }
@@ -551,6 +934,10 @@ octo_stat_loa_t *octo_loa_stats(octo_dict_loa_t *dict)
 // Print out a summary of octo_stat_loa_t for debugging purposes.
 void octo_loa_stats_msg(octo_dict_loa_t *dict)
 {
+	if(loa_migrate(dict, UINT64_MAX) != 0)
+	{
+		return;
+	}
 	octo_stat_loa_t *output = calloc(1, sizeof(*output));
 	if(output == NULL)
 	{
@@ -558,22 +945,21 @@ void octo_loa_stats_msg(octo_dict_loa_t *dict)
 		errno = ENOMEM;
 		return;
 	}
-	uint64_t hash;
 	for(uint64_t i = 0; i < dict->bucket_count; i++)
 	{
-		if(*((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0)
+		const uint8_t *bucket = LOA_BUCKET(dict, i);
+		if(*bucket == LOA_EMPTY)
 		{
 			output->empty_buckets++;
 			continue;
 		}
-		if(*((uint8_t *)dict->buckets + (i * (dict->cellen + 1))) == 0xbe)
+		if(*bucket == LOA_DELETED)
 		{
 			output->garbage_buckets++;
 			continue;
 		}
 		output->total_entries++;
-		octo_hash((uint8_t const *)dict->buckets + (i * (dict->cellen + 1)) + 1, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
-		if(i == hash % dict->bucket_count)
+		if(i == octo_index(dict->opt.index_mode, loa_bucket_hash(dict, bucket), dict->bucket_count))
 		{
 			output->optimal_buckets++;
 		}
@@ -582,12 +968,13 @@ void octo_loa_stats_msg(octo_dict_loa_t *dict)
 			output->colliding_buckets++;
 		}
 	}
-	if((output->empty_buckets + output->optimal_buckets + output->colliding_buckets) != dict->bucket_count)
+	if((output->empty_buckets + output->garbage_buckets + output->optimal_buckets + output->colliding_buckets) != dict->bucket_count)
 	{
 		DEBUG_MSG("sum of bucket types not equal to bucket count");
 		free(output);
 		return;
 	}
+	output->flood_events = dict->flood_events;
 	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
 	printf("######## libocto octo_dict_loa_t statistics summary ########\n");
 	printf("virtual address:%44llu\n", (unsigned long long)dict);
@@ -596,6 +983,7 @@ void octo_loa_stats_msg(octo_dict_loa_t *dict)
 	printf("optimal buckets:%44llu\n", (unsigned long long)output->optimal_buckets);
 	printf("colliding buckets:%42llu\n", (unsigned long long)output->colliding_buckets);
 	printf("garbage buckets:%44llu\n", (unsigned long long)output->garbage_buckets);
+	printf("flood events:%47llu\n", (unsigned long long)output->flood_events);
 	printf("load factor:%48Lf\n", output->load);
 	printf("############################################################\n");
 	free(output);
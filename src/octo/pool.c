@@ -0,0 +1,305 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include <octo/types.h>
+#include <octo/debug.h>
+#include <octo/keygen.h>
+#include <octo/carry.h>
+#include <octo/cll.h>
+#include <octo/loa.h>
+#include <octo/ucll.h>
+#include <octo/pool.h>
+
+#include "internal.h"
+
+// Allocate memory for and initialize a pool of dicts with the given shape.
+// At most capacity empty dicts are kept; dicts returned beyond that are freed.
+octo_pool_t *octo_pool_init(const octo_strategy_t strategy, const size_t keylen, const size_t vallen, const uint64_t buckets, const uint8_t tolerance, const size_t capacity, const octo_opt_t *opt)
+{
+	// Make sure the arguments are valid; the rest are checked by the first ~_init_opt:
+	if(strategy != OCTO_POOL_CARRY && strategy != OCTO_POOL_CLL && strategy != OCTO_POOL_LOA && strategy != OCTO_POOL_UCLL)
+	{
+		DEBUG_MSG("unknown strategy");
+		errno = EINVAL;
+		return NULL;
+	}
+	if(capacity <= 0)
+	{
+		DEBUG_MSG("capacity must not be zero");
+		errno = EINVAL;
+		return NULL;
+	}
+	octo_pool_t *output = malloc(sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating *output");
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(opt != NULL)
+	{
+		output->opt = *opt;
+	}
+	else
+	{
+		memset(&output->opt, 0, sizeof(output->opt));
+	}
+	// Keep the bucket count the dicts will really have, to recognize them when they come back:
+	output->bucket_count = octo_index_buckets(output->opt.index_mode, buckets);
+	if(output->bucket_count == 0)
+	{
+		DEBUG_MSG("unknown index mode, or buckets too large for it");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
+	output->dicts = malloc(sizeof(*output->dicts) * capacity);
+	if(output->dicts == NULL)
+	{
+		DEBUG_MSG("unable to allocate dict stack");
+		errno = ENOMEM;
+		free(output);
+		return NULL;
+	}
+	output->strategy = strategy;
+	output->keylen = keylen;
+	output->vallen = vallen;
+	output->tolerance = tolerance;
+	output->capacity = capacity;
+	output->count = 0;
+	return output;
+}
+
+// Free a dict of the pool's strategy.
+static void pool_dict_free(const octo_pool_t *pool, void *dict)
+{
+	switch(pool->strategy)
+	{
+	case OCTO_POOL_CARRY:
+		octo_carry_free(dict);
+		break;
+	case OCTO_POOL_CLL:
+		octo_cll_free(dict);
+		break;
+	case OCTO_POOL_UCLL:
+		octo_ucll_free(dict);
+		break;
+	default:
+		octo_loa_free(dict);
+		break;
+	}
+	return;
+}
+
+// Delete a pool and the empty dicts it holds. Dicts that are out of the pool
+// are left alone.
+void octo_pool_free(octo_pool_t *pool)
+{
+	for(size_t i = 0; i < pool->count; i++)
+	{
+		pool_dict_free(pool, pool->dicts[i]);
+	}
+	free(pool->dicts);
+	free(pool);
+	return;
+}
+
+// Start a dict's log of buckets in use, so it can be cleared without visiting
+// every bucket. Return 0 on success, 1 on malloc failure.
+static int pool_track(uint64_t **touched, uint64_t *touched_count, const uint64_t bucket_count)
+{
+	if(*touched != NULL)
+	{
+		return 0;
+	}
+	*touched = malloc(sizeof(**touched) * bucket_count);
+	if(*touched == NULL)
+	{
+		DEBUG_MSG("unable to allocate bucket log");
+		errno = ENOMEM;
+		return 1;
+	}
+	*touched_count = 0;
+	return 0;
+}
+
+// Allocate a new dict of the pool's shape. Return NULL on failure.
+static void *pool_dict_init(const octo_pool_t *pool)
+{
+	uint8_t master_key[16];
+	octo_keygen_fast(master_key);
+	switch(pool->strategy)
+	{
+	case OCTO_POOL_CARRY:
+	{
+		octo_dict_carry_t *dict = octo_carry_init_opt(pool->keylen, pool->vallen, pool->bucket_count, pool->tolerance, master_key, &pool->opt);
+		if(dict != NULL && pool_track(&dict->touched, &dict->touched_count, dict->bucket_count) != 0)
+		{
+			octo_carry_free(dict);
+			return NULL;
+		}
+		return dict;
+	}
+	case OCTO_POOL_CLL:
+	{
+		octo_dict_cll_t *dict = octo_cll_init_opt(pool->keylen, pool->vallen, pool->bucket_count, master_key, &pool->opt);
+		if(dict != NULL && pool_track(&dict->touched, &dict->touched_count, dict->bucket_count) != 0)
+		{
+			octo_cll_free(dict);
+			return NULL;
+		}
+		return dict;
+	}
+	case OCTO_POOL_UCLL:
+	{
+		octo_dict_ucll_t *dict = octo_ucll_init_opt(pool->keylen, pool->vallen, pool->bucket_count, pool->tolerance, master_key, &pool->opt);
+		if(dict != NULL && pool_track(&dict->touched, &dict->touched_count, dict->bucket_count) != 0)
+		{
+			octo_ucll_free(dict);
+			return NULL;
+		}
+		return dict;
+	}
+	default:
+	{
+		octo_dict_loa_t *dict = octo_loa_init_opt(pool->keylen, pool->vallen, pool->bucket_count, master_key, &pool->opt);
+		if(dict != NULL && pool_track(&dict->touched, &dict->touched_count, dict->bucket_count) != 0)
+		{
+			octo_loa_free(dict);
+			return NULL;
+		}
+		return dict;
+	}
+	}
+}
+
+// Allocate up to count dicts ahead of time, without going over the pool's
+// capacity. Return 0 on success, 1 on failure.
+int octo_pool_fill(octo_pool_t *pool, const size_t count)
+{
+	for(size_t i = 0; i < count && pool->count < pool->capacity; i++)
+	{
+		void *dict = pool_dict_init(pool);
+		if(dict == NULL)
+		{
+			return 1;
+		}
+		pool->dicts[pool->count] = dict;
+		pool->count++;
+	}
+	return 0;
+}
+
+// Hand out an empty dict of the pool's shape, with a fresh master key. The
+// result is an octo_dict_~_t of the pool's strategy. Return NULL on failure.
+void *octo_pool_get(octo_pool_t *pool)
+{
+	if(pool->count == 0)
+	{
+		return pool_dict_init(pool);
+	}
+	pool->count--;
+	void *dict = pool->dicts[pool->count];
+	switch(pool->strategy)
+	{
+	case OCTO_POOL_CARRY:
+		octo_keygen_fast(((octo_dict_carry_t *)dict)->master_key);
+		break;
+	case OCTO_POOL_CLL:
+		octo_keygen_fast(((octo_dict_cll_t *)dict)->master_key);
+		break;
+	case OCTO_POOL_UCLL:
+		octo_keygen_fast(((octo_dict_ucll_t *)dict)->master_key);
+		break;
+	default:
+		octo_keygen_fast(((octo_dict_loa_t *)dict)->master_key);
+		break;
+	}
+	return dict;
+}
+
+// Whether a returned dict still has the pool's shape. Rehashing can change it,
+// and so can falling back from octo_hash_hw:
+#define POOL_SHAPE_MATCHES(pool, dict) ((dict)->keylen == (pool)->keylen && (dict)->vallen == (pool)->vallen \
+	&& (dict)->bucket_count == (pool)->bucket_count && (dict)->opt.hash == (pool)->opt.hash \
+	&& (dict)->opt.cache_hash == (pool)->opt.cache_hash)
+
+// Clear a dict that's being returned to a pool. Return 0 if it can be handed
+// out again, 1 if not.
+static int pool_reclaim(const octo_pool_t *pool, void *dict)
+{
+	switch(pool->strategy)
+	{
+	case OCTO_POOL_CARRY:
+	{
+		octo_dict_carry_t *carry = dict;
+		if(!POOL_SHAPE_MATCHES(pool, carry) || carry->tolerance != pool->tolerance || carry->opt.fingerprint != pool->opt.fingerprint
+			|| carry->opt.cow_clone != pool->opt.cow_clone)
+		{
+			return 1;
+		}
+		octo_carry_clear(carry);
+		carry->flood_events = 0;
+		carry->hits = 0;
+		carry->hit_depth = 0;
+		return pool_track(&carry->touched, &carry->touched_count, carry->bucket_count);
+	}
+	case OCTO_POOL_CLL:
+	{
+		octo_dict_cll_t *cll = dict;
+		if(!POOL_SHAPE_MATCHES(pool, cll) || cll->opt.compact_links != pool->opt.compact_links)
+		{
+			return 1;
+		}
+		octo_cll_clear(cll);
+		cll->flood_events = 0;
+		cll->hits = 0;
+		cll->hit_depth = 0;
+		return pool_track(&cll->touched, &cll->touched_count, cll->bucket_count);
+	}
+	case OCTO_POOL_UCLL:
+	{
+		octo_dict_ucll_t *ucll = dict;
+		if(!POOL_SHAPE_MATCHES(pool, ucll) || ucll->tolerance != pool->tolerance)
+		{
+			return 1;
+		}
+		octo_ucll_clear(ucll);
+		ucll->flood_events = 0;
+		ucll->hits = 0;
+		ucll->hit_depth = 0;
+		return pool_track(&ucll->touched, &ucll->touched_count, ucll->bucket_count);
+	}
+	default:
+	{
+		octo_dict_loa_t *loa = dict;
+		if(!POOL_SHAPE_MATCHES(pool, loa))
+		{
+			return 1;
+		}
+		octo_loa_clear(loa);
+		loa->flood_events = 0;
+		return pool_track(&loa->touched, &loa->touched_count, loa->bucket_count);
+	}
+	}
+}
+
+// Return a dict to the pool it came from. Its records are dropped, visiting
+// only the buckets that were used. If the pool is full, or the dict has been
+// rehashed into another shape, it is freed instead.
+void octo_pool_put(octo_pool_t *pool, void *dict)
+{
+	if(pool->count == pool->capacity || pool_reclaim(pool, dict) != 0)
+	{
+		pool_dict_free(pool, dict);
+		return;
+	}
+	pool->dicts[pool->count] = dict;
+	pool->count++;
+	return;
+}
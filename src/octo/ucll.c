@@ -0,0 +1,1053 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include <octo/types.h>
+#include <octo/debug.h>
+#include <octo/hash.h>
+#include <octo/ucll.h>
+
+#include "internal.h"
+
+// Node layout. Each node starts with a pointer to the next node in its chain
+// and the number of records in the node, followed by room for tolerance
+// records, each the record's cached hash(if enabled) and then the record:
+#define UCLL_NEXT(n) (*((void **)(n)))
+#define UCLL_RECORDS(n) (*((uint8_t *)(n) + sizeof(void *)))
+#define UCLL_HEADER (sizeof(void *) + 1)
+#define UCLL_CELL(n, dict, i) ((uint8_t *)(n) + UCLL_HEADER + ((dict)->cellen * (i)))
+#define UCLL_RECORD(n, dict, i) (UCLL_CELL(n, dict, i) + (dict)->hashlen)
+#define UCLL_NODE_SIZE(dict) (UCLL_HEADER + ((dict)->cellen * (dict)->tolerance))
+
+// Allocate memory for and initialize a ucll_dict with the default options.
+octo_dict_ucll_t *octo_ucll_init(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key)
+{
+	return octo_ucll_init_opt(init_keylen, init_vallen, init_buckets, init_tolerance, init_master_key, NULL);
+}
+
+// Allocate memory for and initialize a ucll_dict with the options in *init_opt.
+// init_tolerance is the number of records each node has room for.
+octo_dict_ucll_t *octo_ucll_init_opt(const size_t init_keylen, const size_t init_vallen, const uint64_t init_buckets, const uint8_t init_tolerance, const uint8_t *init_master_key, const octo_opt_t *init_opt)
+{
+	// Make sure the arguments are valid:
+	if(init_keylen <= 0)
+	{
+		DEBUG_MSG("key length must not be zero");
+		errno = EINVAL;
+		return NULL;
+	}
+	if(init_buckets <= 0)
+	{
+		DEBUG_MSG("init_buckets must not be zero");
+		errno = EINVAL;
+		return NULL;
+	}
+	if(init_tolerance <= 0)
+	{
+		DEBUG_MSG("init_tolerance must not be zero");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	// Allocate the new dict and populate the trivial fields:
+	octo_dict_ucll_t *output = malloc(sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating *output");
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(init_opt != NULL)
+	{
+		output->opt = *init_opt;
+	}
+	else
+	{
+		memset(&output->opt, 0, sizeof(output->opt));
+	}
+	const uint64_t bucket_count = octo_index_buckets(output->opt.index_mode, init_buckets);
+	if(bucket_count == 0)
+	{
+		DEBUG_MSG("unknown index mode, or init_buckets too large for it");
+		errno = EINVAL;
+		free(output);
+		return NULL;
+	}
+	output->keylen = init_keylen;
+	output->vallen = init_vallen;
+	output->hashlen = OCTO_HASHLEN(output->opt);
+	if(init_keylen > SIZE_MAX - output->hashlen || init_vallen > SIZE_MAX - output->hashlen - init_keylen)
+	{
+		DEBUG_MSG("size_t overflow, keylen + vallen is too large");
+		errno = EDOM;
+		free(output);
+		return NULL;
+	}
+	output->cellen = output->hashlen + init_keylen + init_vallen;
+	if(output->cellen > (SIZE_MAX - UCLL_HEADER) / init_tolerance)
+	{
+		DEBUG_MSG("size_t overflow, nodes are too large");
+		errno = EDOM;
+		free(output);
+		return NULL;
+	}
+	output->tolerance = init_tolerance;
+
+	// Allocate the array of bucket pointers. Bucket slots are left
+	// unalloc'd in ucll_dicts, so use calloc here:
+	void **buckets_tmp = calloc(bucket_count, sizeof(*buckets_tmp));
+	if(buckets_tmp == NULL)
+	{
+		DEBUG_MSG("unable to allocate bucket pointer array");
+		errno = ENOMEM;
+		free(output);
+		return NULL;
+	}
+	output->bucket_count = bucket_count;
+	output->buckets = buckets_tmp;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = 0;
+	output->hits = 0;
+	output->hit_depth = 0;
+	output->touched = NULL;
+	output->touched_count = 0;
+	memcpy(output->master_key, init_master_key, 16);
+	output->hash = octo_hash_select(output->opt.hash, init_keylen);
+	return output;
+}
+
+// Free the nodes of one chain of a ucll_dict, leaving the bucket empty.
+static void ucll_clear_bucket(octo_dict_ucll_t *dict, const uint64_t index)
+{
+	void *this = *(dict->buckets + index);
+	while(this != NULL)
+	{
+		void *next = UCLL_NEXT(this);
+		free(this);
+		this = next;
+	}
+	*(dict->buckets + index) = NULL;
+	return;
+}
+
+// Delete a ucll_dict.
+void octo_ucll_free(octo_dict_ucll_t *target)
+{
+	if(target->old != NULL)
+	{
+		octo_ucll_free(target->old);
+	}
+	for(uint64_t i = 0; i < target->bucket_count; i++)
+	{
+		ucll_clear_bucket(target, i);
+	}
+	free(target->buckets);
+	free(target->touched);
+	free(target);
+	return;
+}
+
+// Remove every record from a ucll_dict. Only the buckets that have been used
+// are visited if the dict keeps track of them.
+void octo_ucll_clear(octo_dict_ucll_t *dict)
+{
+	if(dict->old != NULL)
+	{
+		octo_ucll_free(dict->old);
+		dict->old = NULL;
+		dict->migrated = 0;
+	}
+	if(dict->touched != NULL && dict->touched_count < dict->bucket_count)
+	{
+		for(uint64_t i = 0; i < dict->touched_count; i++)
+		{
+			ucll_clear_bucket(dict, dict->touched[i]);
+		}
+	}
+	else
+	{
+		for(uint64_t i = 0; i < dict->bucket_count; i++)
+		{
+			ucll_clear_bucket(dict, i);
+		}
+	}
+	dict->touched_count = 0;
+	return;
+}
+
+// Check whether record i of the node holds the given key. With cached hashes,
+// only compare keys whose hashes match:
+static OCTO_ALWAYS_INLINE bool ucll_match(const octo_dict_ucll_t *dict, const void *node, const uint64_t i, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->hashlen != 0 && octo_hash_load(UCLL_CELL(node, dict, i)) != hash)
+	{
+		return false;
+	}
+	return octo_key_equal(UCLL_RECORD(node, dict, i), key, parts);
+}
+
+static int ucll_insert_fallback(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+static int ucll_insert_rekey(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts, const void *value);
+
+// Insert a record with the given key hash. Return values are as for octo_ucll_insert.
+static OCTO_ALWAYS_INLINE int ucll_insert(const octo_dict_ucll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	const uint64_t index = octo_index(dict->opt.index_mode, hash, dict->bucket_count);
+
+	// Check to see if the key is already in the bucket, noting the first node
+	// with room for another record:
+	uint64_t chain_len = 0;
+	void *room = NULL;
+	for(void *this = *(dict->buckets + index); this != NULL; this = UCLL_NEXT(this))
+	{
+		for(uint64_t i = 0; i < UCLL_RECORDS(this); i++)
+		{
+			if(ucll_match(dict, this, i, hash, key, parts))
+			{
+				memcpy(UCLL_RECORD(this, dict, i) + dict->keylen, value, dict->vallen);
+				return 0;
+			}
+		}
+		chain_len += UCLL_RECORDS(this);
+		if(room == NULL && UCLL_RECORDS(this) < dict->tolerance)
+		{
+			room = this;
+		}
+	}
+
+	// A long chain suggests a collision attack. Nothing is done about it while
+	// an earlier rekey is still being migrated:
+	if(dict->old == NULL)
+	{
+		if(octo_hw_flooded(&dict->opt, chain_len))
+		{
+			return ucll_insert_fallback(dict, key, parts, value);
+		}
+		if(octo_rekey_due(&dict->opt, chain_len))
+		{
+			return ucll_insert_rekey(dict, key, parts, value);
+		}
+	}
+
+	// Nope. If every node is full, add one at the head of the chain:
+	if(room == NULL)
+	{
+		room = malloc(UCLL_NODE_SIZE(dict));
+		if(room == NULL)
+		{
+			DEBUG_MSG("unable to malloc new node");
+			errno = ENOMEM;
+			return 1;
+		}
+		if(*(dict->buckets + index) == NULL)
+		{
+			octo_touch(dict->touched, &((octo_dict_ucll_t *)dict)->touched_count, dict->bucket_count, index);
+		}
+		UCLL_NEXT(room) = *(dict->buckets + index);
+		UCLL_RECORDS(room) = 0;
+		*(dict->buckets + index) = room;
+	}
+	const uint64_t i = UCLL_RECORDS(room);
+	if(dict->hashlen != 0)
+	{
+		octo_hash_store(UCLL_CELL(room, dict, i), hash);
+	}
+	octo_key_copy(UCLL_RECORD(room, dict, i), key, parts);
+	memcpy(UCLL_RECORD(room, dict, i) + dict->keylen, value, dict->vallen);
+	UCLL_RECORDS(room) += 1;
+	return 0;
+}
+
+// Find the record with the given key in the chain starting at head. Return a
+// pointer to the record, or NULL if it isn't in the chain. If depth isn't
+// NULL, it's set to the number of records ahead of the one found.
+static OCTO_ALWAYS_INLINE uint8_t *ucll_find(const octo_dict_ucll_t *dict, void *head, const uint64_t hash, const octo_iov_t *key, const size_t parts, uint64_t *depth)
+{
+	uint64_t ahead = 0;
+	for(void *this = head; this != NULL; this = UCLL_NEXT(this))
+	{
+		for(uint64_t i = 0; i < UCLL_RECORDS(this); i++)
+		{
+			if(ucll_match(dict, this, i, hash, key, parts))
+			{
+				if(depth != NULL)
+				{
+					*depth = ahead + i;
+				}
+				return UCLL_RECORD(this, dict, i);
+			}
+		}
+		ahead += UCLL_RECORDS(this);
+	}
+	return NULL;
+}
+
+// Move up to count buckets of the table being drained by a rekey into the
+// current one, and free it once it's empty. Return 0 on success, or the
+// insertion error if a record couldn't be moved; the dict stays usable.
+static int ucll_migrate(octo_dict_ucll_t *dict, uint64_t count)
+{
+	octo_dict_ucll_t *old = dict->old;
+	if(old == NULL)
+	{
+		return 0;
+	}
+	for(; count > 0 && dict->migrated < old->bucket_count; count--)
+	{
+		void **head = old->buckets + dict->migrated;
+		while(*head != NULL)
+		{
+			void *this = *head;
+			// Take records from the end, so each leaves the old node once it's placed:
+			while(UCLL_RECORDS(this) > 0)
+			{
+				const uint64_t last = UCLL_RECORDS(this) - 1;
+				const octo_iov_t flat = {UCLL_RECORD(this, old, last), old->keylen};
+				uint64_t hash;
+				dict->hash(flat.base, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+				const int failed = ucll_insert(dict, hash, &flat, 1, UCLL_RECORD(this, old, last) + old->keylen);
+				if(failed != 0)
+				{
+					DEBUG_MSG("insertion failed while migrating a rekey, will retry");
+					return failed;
+				}
+				UCLL_RECORDS(this) -= 1;
+			}
+			*head = UCLL_NEXT(this);
+			free(this);
+		}
+		dict->migrated++;
+	}
+	if(dict->migrated == old->bucket_count)
+	{
+		octo_ucll_free(old);
+		dict->old = NULL;
+		dict->migrated = 0;
+	}
+	return 0;
+}
+
+// Find the chain of the old table that would hold a key during a rekey.
+// Return NULL if the key parts couldn't be gathered.
+static void **ucll_old_link(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	const octo_dict_ucll_t *old = dict->old;
+	if(octo_hash_parts(old->hash, old->opt.hash, key, parts, old->master_key, hash) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return NULL;
+	}
+	return old->buckets + octo_index(old->opt.index_mode, *hash, old->bucket_count);
+}
+
+// Insert a record while a rekey is in progress. A key that hasn't been moved
+// yet is updated in the old table, so it's never in both.
+static int ucll_insert_rekeying(const octo_dict_ucll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	uint64_t old_hash;
+	void **old_link = ucll_old_link(dict, key, parts, &old_hash);
+	if(old_link == NULL)
+	{
+		return 1;
+	}
+	int ret = 0;
+	uint8_t *record = ucll_find(dict->old, *old_link, old_hash, key, parts, NULL);
+	if(record != NULL)
+	{
+		memcpy(record + dict->keylen, value, dict->vallen);
+	}
+	else
+	{
+		ret = ucll_insert(dict, hash, key, parts, value);
+	}
+	ucll_migrate((octo_dict_ucll_t *)dict, octo_rekey_step(&dict->opt));
+	return ret;
+}
+
+// Insert a record with the given key hash, minding a rekey in progress.
+static OCTO_ALWAYS_INLINE int ucll_put(const octo_dict_ucll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	if(dict->old != NULL)
+	{
+		return ucll_insert_rekeying(dict, hash, key, parts, value);
+	}
+	return ucll_insert(dict, hash, key, parts, value);
+}
+
+// Find the record with the given key in the chain starting at head, in table,
+// which is dict or the old table it is draining, counting the hit if the
+// dict's options ask for it. Return values are as for ucll_find.
+static OCTO_ALWAYS_INLINE uint8_t *ucll_find_hit(const octo_dict_ucll_t *dict, const octo_dict_ucll_t *table, void *head, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	uint64_t depth;
+	uint8_t *record = ucll_find(table, head, hash, key, parts, &depth);
+	if(record != NULL && dict->opt.count_hits)
+	{
+		((octo_dict_ucll_t *)dict)->hits++;
+		((octo_dict_ucll_t *)dict)->hit_depth += depth;
+	}
+	return record;
+}
+
+// Look for a key in the old table during a rekey:
+static uint8_t *ucll_lookup_old(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts)
+{
+	uint64_t old_hash;
+	void **old_link = ucll_old_link(dict, key, parts, &old_hash);
+	return old_link == NULL ? NULL : ucll_find_hit(dict, dict->old, *old_link, old_hash, key, parts);
+}
+
+// Find the record with the given key hash. Return a pointer to the record, or
+// NULL if it isn't in the dict.
+static OCTO_ALWAYS_INLINE uint8_t *ucll_lookup(const octo_dict_ucll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	uint8_t *record = ucll_find_hit(dict, dict, *(dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count)), hash, key, parts);
+	if(record == NULL && dict->old != NULL)
+	{
+		record = ucll_lookup_old(dict, key, parts);
+	}
+	return record;
+}
+
+// Copy the value of a found record into a dedicated heap block.
+static void *ucll_copy_value(const octo_dict_ucll_t *dict, const uint8_t *record)
+{
+	void *output = malloc(dict->vallen);
+	if(output == NULL)
+	{
+		DEBUG_MSG("lookup successful but malloc failed");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(output, record + dict->keylen, dict->vallen);
+	return output;
+}
+
+// Delete the record with the given key from the chain starting at *head. The
+// node's last record fills the hole, and a node left empty is freed. Return
+// values are as for octo_ucll_delete.
+static OCTO_ALWAYS_INLINE int ucll_remove(const octo_dict_ucll_t *dict, void **head, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	void *prev = NULL;
+	for(void *this = *head; this != NULL; prev = this, this = UCLL_NEXT(this))
+	{
+		for(uint64_t i = 0; i < UCLL_RECORDS(this); i++)
+		{
+			if(!ucll_match(dict, this, i, hash, key, parts))
+			{
+				continue;
+			}
+			const uint64_t last = UCLL_RECORDS(this) - 1;
+			if(i != last)
+			{
+				memcpy(UCLL_CELL(this, dict, i), UCLL_CELL(this, dict, last), dict->cellen);
+			}
+			UCLL_RECORDS(this) -= 1;
+			if(UCLL_RECORDS(this) == 0)
+			{
+				if(prev == NULL)
+				{
+					*head = UCLL_NEXT(this);
+				}
+				else
+				{
+					UCLL_NEXT(prev) = UCLL_NEXT(this);
+				}
+				free(this);
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Delete a record while a rekey is in progress, from whichever table holds it.
+static int ucll_delete_rekeying(const octo_dict_ucll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	int deleted = ucll_remove(dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+	if(!deleted)
+	{
+		uint64_t old_hash;
+		void **old_link = ucll_old_link(dict, key, parts, &old_hash);
+		deleted = old_link != NULL && ucll_remove(dict->old, old_link, old_hash, key, parts);
+	}
+	ucll_migrate((octo_dict_ucll_t *)dict, octo_rekey_step(&dict->opt));
+	return deleted;
+}
+
+// Delete the record with the given key hash. Return values are as for octo_ucll_delete.
+static OCTO_ALWAYS_INLINE int ucll_delete(const octo_dict_ucll_t *dict, const uint64_t hash, const octo_iov_t *key, const size_t parts)
+{
+	if(dict->old != NULL)
+	{
+		return ucll_delete_rekeying(dict, hash, key, parts);
+	}
+	return ucll_remove(dict, dict->buckets + octo_index(dict->opt.index_mode, hash, dict->bucket_count), hash, key, parts);
+}
+
+// Hash a flat key for a ucll_dict:
+static OCTO_ALWAYS_INLINE uint64_t ucll_hash(const octo_dict_ucll_t *dict, const void *key)
+{
+	uint64_t hash;
+	dict->hash(key, dict->keylen, (uint8_t *)&hash, (const uint8_t *)dict->master_key);
+	return hash;
+}
+
+// Hash a key given in parts for a ucll_dict. Return 0 on success, 1 if the
+// parts don't add up to the dict's key length or hashing them failed.
+static int ucll_hash_iov(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts, uint64_t *hash)
+{
+	if(octo_key_length(key, parts) != dict->keylen)
+	{
+		DEBUG_MSG("key parts don't add up to the key length");
+		errno = EINVAL;
+		return 1;
+	}
+	if(octo_hash_iov(octo_iov_base(dict->hash, dict->opt.hash), key, parts, (uint8_t *)hash, (const uint8_t *)dict->master_key) != 0)
+	{
+		DEBUG_MSG("malloc failed while gathering key parts");
+		errno = ENOMEM;
+		return 1;
+	}
+	return 0;
+}
+
+// Insert a value into a ucll_dict. Return 0 on success, 1 on malloc failure.
+int octo_ucll_insert(const void *key, const void *value, const octo_dict_ucll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return ucll_put(dict, ucll_hash(dict, key), &flat, 1, value);
+}
+
+// Fetch a value from a ucll_dict. Return NULL on error, return a pointer to
+// the ucll_dict itself if the value is not found. The pointer refers to the
+// literal location of the value; if you don't want that, use *fetch_safe.
+void *octo_ucll_fetch(const void *key, const octo_dict_ucll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *record = ucll_lookup(dict, ucll_hash(dict, key), &flat, 1);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Fetch a value from a ucll_dict. Return NULL on error, return a pointer to
+// the ucll_dict itself if the value is not found.
+void *octo_ucll_fetch_safe(const void *key, const octo_dict_ucll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	uint8_t *record = ucll_lookup(dict, ucll_hash(dict, key), &flat, 1);
+	return record == NULL ? (void *)dict : ucll_copy_value(dict, record);
+}
+
+// Like octo_ucll_fetch, but don't malloc/memcpy the value.
+// Return 1 if found, 0 if not.
+int octo_ucll_poke(const void *key, const octo_dict_ucll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return ucll_lookup(dict, ucll_hash(dict, key), &flat, 1) != NULL;
+}
+
+// Delete the record with the given key. Return 1 on successful delete,
+// 0 if the record isn't found.
+int octo_ucll_delete(const void *key, const octo_dict_ucll_t *dict)
+{
+	const octo_iov_t flat = {key, dict->keylen};
+	return ucll_delete(dict, ucll_hash(dict, key), &flat, 1);
+}
+
+// Like octo_ucll_insert, but the key is given in parts that add up to keylen.
+int octo_ucll_insert_iov(const octo_iov_t *key, const size_t parts, const void *value, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return 1;
+	}
+	return ucll_put(dict, hash, key, parts, value);
+}
+
+// Like octo_ucll_fetch, but the key is given in parts that add up to keylen.
+void *octo_ucll_fetch_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return NULL;
+	}
+	uint8_t *record = ucll_lookup(dict, hash, key, parts);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Like octo_ucll_fetch_safe, but the key is given in parts that add up to keylen.
+void *octo_ucll_fetch_safe_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return NULL;
+	}
+	uint8_t *record = ucll_lookup(dict, hash, key, parts);
+	return record == NULL ? (void *)dict : ucll_copy_value(dict, record);
+}
+
+// Like octo_ucll_poke, but the key is given in parts that add up to keylen.
+int octo_ucll_poke_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return 0;
+	}
+	return ucll_lookup(dict, hash, key, parts) != NULL;
+}
+
+// Like octo_ucll_delete, but the key is given in parts that add up to keylen.
+int octo_ucll_delete_iov(const octo_iov_t *key, const size_t parts, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_iov(dict, key, parts, &hash) != 0)
+	{
+		return 0;
+	}
+	return ucll_delete(dict, hash, key, parts);
+}
+
+// Hash a key handle for a ucll_dict. Return 0 on success, 1 if the handle's
+// key length doesn't match the dict's.
+static OCTO_ALWAYS_INLINE int ucll_hash_h(const octo_dict_ucll_t *dict, const octo_key_t *key, uint64_t *hash)
+{
+	if(octo_key_hash(key, dict->keylen, dict->hash, dict->master_key, hash) != 0)
+	{
+		DEBUG_MSG("key handle length doesn't match the key length");
+		errno = EINVAL;
+		return 1;
+	}
+	return 0;
+}
+
+// Fill in a key handle for use with this dict, or any other dict sharing its
+// key length, hash function and master key.
+void octo_ucll_key(octo_key_t *handle, const void *key, const octo_dict_ucll_t *dict)
+{
+	octo_key_init(handle, key, dict->keylen, dict->opt.hash, dict->master_key);
+	return;
+}
+
+// Like octo_ucll_insert, but take a key handle.
+int octo_ucll_insert_h(const octo_key_t *key, const void *value, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_h(dict, key, &hash) != 0)
+	{
+		return 1;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return ucll_put(dict, hash, &flat, 1, value);
+}
+
+// Like octo_ucll_fetch, but take a key handle.
+void *octo_ucll_fetch_h(const octo_key_t *key, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_h(dict, key, &hash) != 0)
+	{
+		return NULL;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *record = ucll_lookup(dict, hash, &flat, 1);
+	return record == NULL ? (void *)dict : record + dict->keylen;
+}
+
+// Like octo_ucll_fetch_safe, but take a key handle.
+void *octo_ucll_fetch_safe_h(const octo_key_t *key, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_h(dict, key, &hash) != 0)
+	{
+		return NULL;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	uint8_t *record = ucll_lookup(dict, hash, &flat, 1);
+	return record == NULL ? (void *)dict : ucll_copy_value(dict, record);
+}
+
+// Like octo_ucll_poke, but take a key handle.
+int octo_ucll_poke_h(const octo_key_t *key, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_h(dict, key, &hash) != 0)
+	{
+		return 0;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return ucll_lookup(dict, hash, &flat, 1) != NULL;
+}
+
+// Like octo_ucll_delete, but take a key handle.
+int octo_ucll_delete_h(const octo_key_t *key, const octo_dict_ucll_t *dict)
+{
+	uint64_t hash;
+	if(ucll_hash_h(dict, key, &hash) != 0)
+	{
+		return 0;
+	}
+	const octo_iov_t flat = {key->key, dict->keylen};
+	return ucll_delete(dict, hash, &flat, 1);
+}
+
+// Build a new ucll_dict from the records in *dict. If keep is zero, the old
+// dict is freed once its records are moved.
+static octo_dict_ucll_t *ucll_rehash(octo_dict_ucll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key, const int keep)
+{
+	// Finish any rekey in progress, so every record is in the current table:
+	if(ucll_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
+	// Allocate the new dict with the same options; this validates the arguments:
+	octo_dict_ucll_t *output = octo_ucll_init_opt(new_keylen, new_vallen, new_buckets, new_tolerance, new_master_key, &dict->opt);
+	if(output == NULL)
+	{
+		return NULL;
+	}
+	// If the new keylen/vallen is longer than the old one, we need to read it from an initialized buffer:
+	void *key_buffer = calloc(1, output->keylen);
+	void *val_buffer = calloc(1, output->vallen + 1);
+	if(key_buffer == NULL || val_buffer == NULL)
+	{
+		DEBUG_MSG("malloc failed while allocating key/val buffer");
+		errno = ENOMEM;
+		free(key_buffer);
+		free(val_buffer);
+		octo_ucll_free(output);
+		return NULL;
+	}
+	const size_t buffer_keylen = dict->keylen < output->keylen ? dict->keylen : output->keylen;
+	const size_t buffer_vallen = dict->vallen < output->vallen ? dict->vallen : output->vallen;
+	// Cached hashes are still valid if the key, hash function, and master key are unchanged:
+	const int reuse_hash = dict->hashlen != 0 && dict->keylen == output->keylen && dict->hash == output->hash
+		&& memcmp(dict->master_key, output->master_key, 16) == 0;
+	const octo_iov_t flat = {key_buffer, output->keylen};
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	uint64_t hash;
+	int failed = 0;
+	for(uint64_t i = 0; i < dict->bucket_count && failed == 0; i++)
+	{
+		for(void *this = *(dict->buckets + i); this != NULL && failed == 0; this = UCLL_NEXT(this))
+		{
+			for(uint64_t j = 0; j < UCLL_RECORDS(this) && failed == 0; j++)
+			{
+				memcpy(key_buffer, UCLL_RECORD(this, dict, j), buffer_keylen);
+				memcpy(val_buffer, UCLL_RECORD(this, dict, j) + dict->keylen, buffer_vallen);
+				if(reuse_hash)
+				{
+					hash = octo_hash_load(UCLL_CELL(this, dict, j));
+				}
+				else
+				{
+					output->hash((const uint8_t *)key_buffer, output->keylen, (uint8_t *)&hash, (const uint8_t *)output->master_key);
+				}
+				failed = ucll_insert(output, hash, &flat, 1, val_buffer);
+			}
+		}
+	}
+	free(key_buffer);
+	free(val_buffer);
+	if(!keep)
+	{
+		// At this point we're finished with the old dict, free it:
+		octo_ucll_free(dict);
+	}
+	if(failed != 0)
+	{
+		DEBUG_MSG(keep ? "insertion failed during rehash, original ucll_dict in known-good state" : "insertion failed during rehash, lazy rehash was used, data is unrecoverable");
+		octo_ucll_free(output);
+		return NULL;
+	}
+	return output;
+}
+
+// Give the dict an empty table keyed with new_master_key, keeping the current
+// one as the old table to be drained. The struct itself stays put, so the
+// caller's dict pointer remains valid.
+static int ucll_rekey(octo_dict_ucll_t *dict, const uint8_t *new_master_key)
+{
+	// Only one old table is kept, so finish any earlier rekey first:
+	if(ucll_migrate(dict, UINT64_MAX) != 0)
+	{
+		return 1;
+	}
+	octo_dict_ucll_t *output = octo_ucll_init_opt(dict->keylen, dict->vallen, dict->bucket_count, dict->tolerance, new_master_key, &dict->opt);
+	if(output == NULL)
+	{
+		return 1;
+	}
+	octo_dict_ucll_t old = *dict;
+	*dict = *output;
+	*output = old;
+	dict->old = output;
+	// A pooled dict's log of used buckets stays with the live table, which
+	// starts out with none:
+	dict->touched = output->touched;
+	dict->touched_count = 0;
+	output->touched = NULL;
+	dict->flood_events = output->flood_events;
+	dict->hits = output->hits;
+	dict->hit_depth = output->hit_depth;
+	return 0;
+}
+
+// Switch a flooded octo_hash_hw dict over to octo_hash, then retry the insertion.
+// The records move to an octo_hash table through an ordinary rekey, a few
+// buckets at a time, while the old table keeps hashing with octo_hash_hw.
+static int ucll_insert_fallback(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long chain in octo_hash_hw ucll_dict, falling back to octo_hash");
+	octo_dict_ucll_t *target = (octo_dict_ucll_t *)dict;
+	// The new table takes the dict's options:
+	target->opt.hash = octo_hash;
+	if(ucll_rekey(target, target->master_key) != 0)
+	{
+		target->opt.hash = octo_hash_hw;
+		return 1;
+	}
+	target->old->opt.hash = octo_hash_hw;
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
+	{
+		errno = ENOMEM;
+		return 1;
+	}
+	return ucll_insert(target, hash, key, parts, value);
+}
+
+// Start rekeying a dict with a suspiciously long chain, then retry the
+// insertion in the new table.
+static int ucll_insert_rekey(const octo_dict_ucll_t *dict, const octo_iov_t *key, const size_t parts, const void *value)
+{
+	DEBUG_MSG("long chain in ucll_dict, rekeying");
+	octo_dict_ucll_t *target = (octo_dict_ucll_t *)dict;
+	uint8_t new_master_key[16];
+	octo_rekey_master(target->master_key, target->flood_events, new_master_key);
+	if(ucll_rekey(target, new_master_key) != 0)
+	{
+		return 1;
+	}
+	target->flood_events++;
+	uint64_t hash;
+	if(octo_hash_parts(target->hash, target->opt.hash, key, parts, target->master_key, &hash) != 0)
+	{
+		errno = ENOMEM;
+		return 1;
+	}
+	return ucll_insert(target, hash, key, parts, value);
+}
+
+// Start moving the records of a ucll_dict to a table keyed with new_master_key,
+// or with a freshly derived key if new_master_key is NULL. Records are moved a
+// few buckets at a time by later insertions and deletions, or by
+// octo_ucll_migrate, and can be found throughout. Return 0 on success, 1 on failure.
+int octo_ucll_rekey(octo_dict_ucll_t *dict, const uint8_t *new_master_key)
+{
+	uint8_t derived_key[16];
+	if(new_master_key == NULL)
+	{
+		octo_rekey_master(dict->master_key, dict->flood_events, derived_key);
+		new_master_key = derived_key;
+	}
+	return ucll_rekey(dict, new_master_key);
+}
+
+// Move up to the given number of old buckets during a rekey. The rekey is
+// finished once dict->old is NULL. Return 0 on success, or the insertion error
+// if a record couldn't be moved.
+int octo_ucll_migrate(octo_dict_ucll_t *dict, const uint64_t buckets)
+{
+	return ucll_migrate(dict, buckets);
+}
+
+// Re-create the ucll_dict with a new key length, value length(both will be truncated), number of buckets,
+// tolerance value, and/or new master_key. Return pointer to new ucll_dict on success, NULL on failure.
+octo_dict_ucll_t *octo_ucll_rehash(octo_dict_ucll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key)
+{
+	return ucll_rehash(dict, new_keylen, new_vallen, new_buckets, new_tolerance, new_master_key, 0);
+}
+
+// Like octo_ucll_rehash, but retain the original dict. It is up to the caller
+// to free the old dict.
+octo_dict_ucll_t *octo_ucll_rehash_safe(octo_dict_ucll_t *dict, const size_t new_keylen, const size_t new_vallen, const uint64_t new_buckets, const uint8_t new_tolerance, const uint8_t *new_master_key)
+{
+	return ucll_rehash(dict, new_keylen, new_vallen, new_buckets, new_tolerance, new_master_key, 1);
+}
+
+// Make a deep copy of a ucll_dict. Return NULL on error, pointer to the new
+// dict on success.
+octo_dict_ucll_t *octo_ucll_clone(octo_dict_ucll_t *dict)
+{
+	// Finish any rekey in progress, so only one table has to be copied:
+	if(ucll_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
+	// Allocate the new dict and populate trivial fields:
+	octo_dict_ucll_t *output = malloc(sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed allocating *output");
+		errno = ENOMEM;
+		return NULL;
+	}
+	output->keylen = dict->keylen;
+	output->vallen = dict->vallen;
+	output->cellen = dict->cellen;
+	output->hashlen = dict->hashlen;
+	output->tolerance = dict->tolerance;
+	output->bucket_count = dict->bucket_count;
+	memcpy(output->master_key, dict->master_key, 16);
+	output->hash = dict->hash;
+	output->opt = dict->opt;
+	output->old = NULL;
+	output->migrated = 0;
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	output->touched = NULL;
+	output->touched_count = 0;
+
+	// Allocate the new array of bucket pointers, initializing them to NULL:
+	void **buckets_tmp = calloc(output->bucket_count, sizeof(*buckets_tmp));
+	if(buckets_tmp == NULL)
+	{
+		DEBUG_MSG("unable to malloc for **buckets_tmp");
+		errno = ENOMEM;
+		free(output);
+		return NULL;
+	}
+	output->buckets = buckets_tmp;
+	const size_t header_len = UCLL_HEADER;
+	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	{
+		// Append each copied node at the tail, keeping the chain order:
+		void **tail = output->buckets + i;
+		for(void *src_this = *(dict->buckets + i); src_this != NULL; src_this = UCLL_NEXT(src_this))
+		{
+			void *tmp = malloc(UCLL_NODE_SIZE(output));
+			if(tmp == NULL)
+			{
+				DEBUG_MSG("malloc failed while copying nodes");
+				errno = ENOMEM;
+				octo_ucll_free(output);
+				return NULL;
+			}
+			// Only copy the records in use:
+			memcpy(tmp, src_this, header_len + (output->cellen * UCLL_RECORDS(src_this)));
+			UCLL_NEXT(tmp) = NULL;
+			*tail = tmp;
+			tail = &UCLL_NEXT(tmp);
+		}
+	}
+	return output;
+}
+
+// Count the records and nodes of a ucll_dict into *output. A bucket whose
+// records fit in a single node counts as optimal. Return 0 on success, 1 if
+// the counts don't add up.
+static int ucll_count(octo_dict_ucll_t *dict, octo_stat_ucll_t *output)
+{
+	for(uint64_t i = 0; i < dict->bucket_count; i++)
+	{
+		void *this = *(dict->buckets + i);
+		if(this == NULL)
+		{
+			output->null_buckets++;
+			continue;
+		}
+		if(UCLL_NEXT(this) == NULL)
+		{
+			output->optimal_buckets++;
+		}
+		else
+		{
+			output->chained_buckets++;
+		}
+		uint64_t current_chain_len = 0;
+		for(; this != NULL; this = UCLL_NEXT(this))
+		{
+			current_chain_len += UCLL_RECORDS(this);
+			output->total_nodes++;
+		}
+		output->total_entries += current_chain_len;
+		if(current_chain_len > output->max_chain_len)
+		{
+			output->max_chain_len = current_chain_len;
+		}
+	}
+	if((output->null_buckets + output->optimal_buckets + output->chained_buckets) != dict->bucket_count)
+	{
+		DEBUG_MSG("sum of bucket types not equal to bucket count");
+		return 1;
+	}
+	output->flood_events = dict->flood_events;
+	output->hits = dict->hits;
+	output->hit_depth = dict->hit_depth;
+	output->load = ((long double)(output->total_entries))/((long double)(dict->bucket_count));
+	return 0;
+}
+
+// Populate and return a pointer to a octo_stat_ucll_t on success, NULL on error.
+octo_stat_ucll_t *octo_ucll_stats(octo_dict_ucll_t *dict)
+{
+	// Finish any rekey in progress, so only one table has to be counted:
+	if(ucll_migrate(dict, UINT64_MAX) != 0)
+	{
+		return NULL;
+	}
+	octo_stat_ucll_t *output = calloc(1, sizeof(*output));
+	if(output == NULL)
+	{
+		DEBUG_MSG("malloc failed while allocating octo_stat_ucll_t");
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(ucll_count(dict, output) != 0)
+	{
+		free(output);
+		return NULL;
+	}
+	return output;
+}
+
+// Print out a summary of octo_stat_ucll_t for debugging purposes.
+void octo_ucll_stats_msg(octo_dict_ucll_t *dict)
+{
+	octo_stat_ucll_t *output = octo_ucll_stats(dict);
+	if(output == NULL)
+	{
+		return;
+	}
+	printf("######## libocto octo_dict_ucll_t statistics summary #######\n");
+	printf("virtual address:%44llu\n", (unsigned long long)dict);
+	printf("total entries:%46llu\n", (unsigned long long)output->total_entries);
+	printf("total nodes:%48llu\n", (unsigned long long)output->total_nodes);
+	printf("records per node:%43llu\n", (unsigned long long)dict->tolerance);
+	printf("null buckets:%47llu\n", (unsigned long long)output->null_buckets);
+	printf("optimal buckets:%44llu\n", (unsigned long long)output->optimal_buckets);
+	printf("chained buckets:%44llu\n", (unsigned long long)output->chained_buckets);
+	printf("longest chain:%46llu\n", (unsigned long long)output->max_chain_len);
+	printf("flood events:%47llu\n", (unsigned long long)output->flood_events);
+	printf("fetch hits:%49llu\n", (unsigned long long)output->hits);
+	printf("hit depth:%50llu\n", (unsigned long long)output->hit_depth);
+	printf("load factor:%48Lf\n", output->load);
+	printf("############################################################\n");
+	free(output);
+	return;
+}
@@ -0,0 +1,272 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+// Hash function throughput and quality benchmark. Every result is printed on
+// its own line as space separated key=value pairs, so runs can be diffed or
+// parsed to track regressions. Exits non-zero if a quality check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <octo/types.h>
+#include <octo/keygen.h>
+#include <octo/hash.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+// Keys are spread over this many slots so consecutive calls don't hash the same bytes:
+#define BENCH_SLOTS 64
+#define BENCH_MAX_KEYLEN 1024
+
+// Each timed run hashes roughly this many bytes, and at least BENCH_MIN_CALLS keys:
+#define BENCH_BYTES (1 << 22)
+#define BENCH_MIN_CALLS (1 << 16)
+
+// Quality check parameters:
+#define DIST_KEYS (1 << 16)
+#define DIST_BUCKETS 1024
+#define AVAL_TRIALS 4096
+#define AVAL_MAX_BIAS 0.1
+// Only this many bytes of longer keys, spread from the first to the last, have
+// their bits flipped in the avalanche check:
+#define AVAL_MAX_BYTES 32
+
+typedef struct
+{
+	const char *name;
+	octo_hash_fn_t fn;
+} bench_fn_t;
+
+// A NULL fn stands for the octo_hash_fixed variant for each key length:
+static const bench_fn_t bench_fns[] =
+{
+	{"octo_hash", octo_hash},
+	{"octo_hash13", octo_hash13},
+	{"octo_hash_fixed", NULL},
+	{"octo_hash_hw", octo_hash_hw},
+	{"octo_hash_long", octo_hash_long}
+};
+
+static const size_t bench_keylens[] = {1, 3, 4, 7, 8, 13, 16, 24, 32, 64, 100, 128, 256, 512, 1024};
+
+// Key lengths for the quality checks; the longer ones go through
+// octo_hash_long's stripes and the multi-block AES and CRC32C loops:
+static const size_t quality_keylens[] = {8, 32, 128, 256, 1024};
+
+static volatile uint64_t bench_sink;
+
+static double bench_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static void bench_report(const char *name, const size_t keylen, const uint64_t calls, const double seconds, const uint64_t cycles)
+{
+	printf("bench=speed fn=%s keylen=%zu hashes_per_sec=%.0f ns_per_hash=%.2f cycles_per_byte=%.3f\n",
+		name, keylen, (double)calls / seconds, (seconds * 1e9) / (double)calls,
+		(double)cycles / ((double)calls * (double)keylen));
+	return;
+}
+
+// Time a single-key hash function on keys of keylen bytes:
+static void bench_speed(const char *name, octo_hash_fn_t fn, const uint8_t *keys, const size_t keylen, const uint8_t *master_key)
+{
+	uint64_t calls = BENCH_BYTES / keylen;
+	if(calls < BENCH_MIN_CALLS)
+	{
+		calls = BENCH_MIN_CALLS;
+	}
+	uint64_t out;
+	uint64_t acc = 0;
+	const double start = bench_now();
+	const uint64_t start_cycles = BENCH_CYCLES();
+	for(uint64_t i = 0; i < calls; i++)
+	{
+		fn(keys + ((i % BENCH_SLOTS) * keylen), keylen, (uint8_t *)&out, master_key);
+		acc ^= out;
+	}
+	const uint64_t cycles = BENCH_CYCLES() - start_cycles;
+	const double seconds = bench_now() - start;
+	bench_sink ^= acc;
+	bench_report(name, keylen, calls, seconds, cycles);
+	return;
+}
+
+// Time octo_hash_many on batches of BENCH_SLOTS keys:
+static void bench_speed_many(const uint8_t *keys, const size_t keylen, const uint8_t *master_key)
+{
+	uint64_t batches = (BENCH_BYTES / keylen) / BENCH_SLOTS;
+	if(batches < BENCH_MIN_CALLS / BENCH_SLOTS)
+	{
+		batches = BENCH_MIN_CALLS / BENCH_SLOTS;
+	}
+	uint64_t out[BENCH_SLOTS];
+	uint64_t acc = 0;
+	const double start = bench_now();
+	const uint64_t start_cycles = BENCH_CYCLES();
+	for(uint64_t i = 0; i < batches; i++)
+	{
+		octo_hash_many(keys, BENCH_SLOTS, keylen, (uint8_t *)out, master_key);
+		acc ^= out[i % BENCH_SLOTS];
+	}
+	const uint64_t cycles = BENCH_CYCLES() - start_cycles;
+	const double seconds = bench_now() - start;
+	bench_sink ^= acc;
+	bench_report("octo_hash_many", keylen, batches * BENCH_SLOTS, seconds, cycles);
+	return;
+}
+
+// Hash keys of keylen bytes that differ only in a sequential integer in their
+// last 8 bytes into buckets and compare the spread with a uniform one. Return 0
+// if it passes, 1 if not.
+static int bench_distribution(const char *name, octo_hash_fn_t fn, const size_t keylen, const uint8_t *master_key)
+{
+	uint64_t *counts = calloc(DIST_BUCKETS, sizeof(*counts));
+	uint8_t *key = malloc(keylen);
+	if(counts == NULL || key == NULL)
+	{
+		free(counts);
+		free(key);
+		printf("bench=distribution fn=%s result=error\n", name);
+		return 1;
+	}
+	for(size_t i = 0; i < keylen; i++)
+	{
+		key[i] = (uint8_t)((i * 131) + 7);
+	}
+	uint64_t hash;
+	for(uint64_t i = 0; i < DIST_KEYS; i++)
+	{
+		memcpy(key + keylen - sizeof(i), &i, sizeof(i));
+		fn(key, keylen, (uint8_t *)&hash, master_key);
+		counts[hash % DIST_BUCKETS]++;
+	}
+	const double expected = (double)DIST_KEYS / DIST_BUCKETS;
+	double chi2 = 0;
+	uint64_t max_bucket = 0;
+	for(uint64_t i = 0; i < DIST_BUCKETS; i++)
+	{
+		chi2 += ((double)counts[i] - expected) * ((double)counts[i] - expected) / expected;
+		if(counts[i] > max_bucket)
+		{
+			max_bucket = counts[i];
+		}
+	}
+	free(counts);
+	free(key);
+	// With DIST_BUCKETS - 1 degrees of freedom, chi2 has a mean of about
+	// 1023 and a standard deviation of about 45; allow six of those:
+	const int failed = chi2 > (DIST_BUCKETS - 1) + (6 * 45);
+	printf("bench=distribution fn=%s keylen=%zu keys=%d buckets=%d chi2=%.1f max_bucket=%llu result=%s\n",
+		name, keylen, DIST_KEYS, DIST_BUCKETS, chi2, (unsigned long long)max_bucket, failed ? "FAIL" : "ok");
+	return failed;
+}
+
+// Flip each input bit of random keys(or of AVAL_MAX_BYTES of their bytes) and
+// check that every output bit flips about half the time. Return 0 if it
+// passes, 1 if not.
+static int bench_avalanche(const char *name, octo_hash_fn_t fn, const size_t keylen, const uint8_t *master_key)
+{
+	const size_t in_bytes = keylen < AVAL_MAX_BYTES ? keylen : AVAL_MAX_BYTES;
+	const size_t in_bits = in_bytes * 8;
+	uint32_t *flips = calloc(in_bits * 64, sizeof(*flips));
+	uint8_t *key = malloc(keylen);
+	if(flips == NULL || key == NULL)
+	{
+		free(flips);
+		free(key);
+		printf("bench=avalanche fn=%s result=error\n", name);
+		return 1;
+	}
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	uint64_t base;
+	uint64_t flipped;
+	for(int t = 0; t < AVAL_TRIALS; t++)
+	{
+		for(size_t i = 0; i < keylen; i++)
+		{
+			state = (state * 6364136223846793005ULL) + 1442695040888963407ULL;
+			key[i] = (uint8_t)(state >> 56);
+		}
+		fn(key, keylen, (uint8_t *)&base, master_key);
+		for(size_t b = 0; b < in_bits; b++)
+		{
+			const size_t byte = in_bytes > 1 ? ((b / 8) * (keylen - 1)) / (in_bytes - 1) : 0;
+			key[byte] ^= (uint8_t)(1 << (b % 8));
+			fn(key, keylen, (uint8_t *)&flipped, master_key);
+			key[byte] ^= (uint8_t)(1 << (b % 8));
+			const uint64_t diff = base ^ flipped;
+			for(int o = 0; o < 64; o++)
+			{
+				flips[(b * 64) + o] += (uint32_t)((diff >> o) & 1);
+			}
+		}
+	}
+	double sum = 0;
+	double max_bias = 0;
+	for(size_t i = 0; i < in_bits * 64; i++)
+	{
+		const double p = (double)flips[i] / AVAL_TRIALS;
+		const double bias = p > 0.5 ? p - 0.5 : 0.5 - p;
+		sum += p;
+		if(bias > max_bias)
+		{
+			max_bias = bias;
+		}
+	}
+	free(flips);
+	free(key);
+	const int failed = max_bias > AVAL_MAX_BIAS;
+	printf("bench=avalanche fn=%s keylen=%zu bits=%zu trials=%d mean_flip=%.4f max_bias=%.4f result=%s\n",
+		name, keylen, in_bits, AVAL_TRIALS, sum / (double)(in_bits * 64), max_bias, failed ? "FAIL" : "ok");
+	return failed;
+}
+
+int main()
+{
+	uint8_t *master_key = octo_keygen();
+	uint8_t *keys = malloc(BENCH_SLOTS * BENCH_MAX_KEYLEN);
+	if(master_key == NULL || keys == NULL)
+	{
+		printf("bench_hash: FAILED: malloc failed\n");
+		return 1;
+	}
+	for(size_t i = 0; i < BENCH_SLOTS * BENCH_MAX_KEYLEN; i++)
+	{
+		keys[i] = (uint8_t)((i * 131) + 7);
+	}
+	for(size_t i = 0; i < sizeof(bench_keylens) / sizeof(*bench_keylens); i++)
+	{
+		const size_t keylen = bench_keylens[i];
+		for(size_t j = 0; j < sizeof(bench_fns) / sizeof(*bench_fns); j++)
+		{
+			octo_hash_fn_t fn = bench_fns[j].fn != NULL ? bench_fns[j].fn : octo_hash_fixed(keylen);
+			bench_speed(bench_fns[j].name, fn, keys, keylen, master_key);
+		}
+		bench_speed_many(keys, keylen, master_key);
+	}
+	int failed = 0;
+	for(size_t j = 0; j < sizeof(bench_fns) / sizeof(*bench_fns); j++)
+	{
+		if(bench_fns[j].fn == NULL)
+		{
+			continue;
+		}
+		for(size_t i = 0; i < sizeof(quality_keylens) / sizeof(*quality_keylens); i++)
+		{
+			failed |= bench_distribution(bench_fns[j].name, bench_fns[j].fn, quality_keylens[i], master_key);
+			failed |= bench_avalanche(bench_fns[j].name, bench_fns[j].fn, quality_keylens[i], master_key);
+		}
+	}
+	free(master_key);
+	free(keys);
+	return failed;
+}
@@ -389,6 +389,41 @@ int main()
 		printf("test_carry: FAILED: octo_carry_insert failed re-inserting deleted key\n");
 		return 1;
 	}
+	DEBUG_MSG("test_carry: Using keys given in parts...");
+	const octo_iov_t key2_parts[3] = {{key2, 3}, {key2 + 3, 1}, {key2 + 4, 4}};
+	if(octo_carry_delete_iov(key2_parts, 3, (const octo_dict_carry_t *)test_carry_safe) != 1)
+	{
+		printf("test_carry: FAILED: octo_carry_delete_iov couldn't delete key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(octo_carry_poke(key2, (const octo_dict_carry_t *)test_carry_safe) || octo_carry_poke_iov(key2_parts, 3, (const octo_dict_carry_t *)test_carry_safe))
+	{
+		printf("test_carry: FAILED: deleted key \"bcdefgh\\0\" still present\n");
+		return 1;
+	}
+	if(octo_carry_insert_iov(key2_parts, 3, val2, (const octo_dict_carry_t *)test_carry_safe) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_insert_iov failed inserting key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	output2 = octo_carry_fetch(key2, (const octo_dict_carry_t *)test_carry_safe);
+	if(output2 == (void *)test_carry_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch couldn't find key inserted in parts\n");
+		return 1;
+	}
+	output2 = octo_carry_fetch_safe_iov(key2_parts, 3, (const octo_dict_carry_t *)test_carry_safe);
+	if(output2 == NULL || output2 == (void *)test_carry_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch_safe_iov couldn't find key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	free(output2);
+	if(octo_carry_fetch_iov(key2_parts, 2, (const octo_dict_carry_t *)test_carry_safe) != NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch_iov accepted a key of the wrong length\n");
+		return 1;
+	}
 	DEBUG_MSG("test_carry: Cloning carry_dict...");
 	octo_dict_carry_t *test_carry_clone = octo_carry_clone(test_carry_safe);
 	if(test_carry_clone == NULL)
@@ -426,6 +461,851 @@ int main()
 		printf("test_carry: FAILED: octo_carry_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
 		return 1;
 	}
+	DEBUG_MSG("test_carry: Creating SipHash-1-3 carry_dict...");
+	octo_opt_t test_opt = {0};
+	test_opt.hash = octo_hash13;
+	octo_dict_carry_t *test_carry_opt = octo_carry_init_opt(8, 64, 128, 1, init_master_key, &test_opt);
+	if(test_carry_opt == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+		return 1;
+	}
+	if(octo_carry_insert(key1, val1, (const octo_dict_carry_t *)test_carry_opt) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_insert failed on SipHash-1-3 dict\n");
+		return 1;
+	}
+	DEBUG_MSG("test_carry: Rehashing and cloning SipHash-1-3 carry_dict...");
+	test_carry_opt = octo_carry_rehash(test_carry_opt, 8, 64, 16, 2, new_master_key);
+	if(test_carry_opt == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_rehash returned NULL on SipHash-1-3 dict\n");
+		return 1;
+	}
+	octo_dict_carry_t *test_carry_opt_clone = octo_carry_clone(test_carry_opt);
+	if(test_carry_opt_clone == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_clone returned NULL on SipHash-1-3 dict\n");
+		return 1;
+	}
+	if(test_carry_opt_clone->opt.hash != octo_hash13 || test_carry_opt_clone->hash != octo_hash_select(octo_hash13, 8))
+	{
+		printf("test_carry: FAILED: hash selection not preserved by rehash and clone\n");
+		return 1;
+	}
+	output1 = octo_carry_fetch(key1, (const octo_dict_carry_t *)test_carry_opt_clone);
+	if(output1 == (void *)test_carry_opt_clone || memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch couldn't find test value in SipHash-1-3 dict\n");
+		return 1;
+	}
+	octo_carry_free(test_carry_opt);
+	octo_carry_free(test_carry_opt_clone);
+	DEBUG_MSG("test_carry: Creating carry_dict with cached hashes...");
+	octo_opt_t test_cache_opt = {0};
+	test_cache_opt.cache_hash = 1;
+	octo_dict_carry_t *test_carry_cache = octo_carry_init_opt(8, 8, 16, 1, init_master_key, &test_cache_opt);
+	if(test_carry_cache == NULL || test_carry_cache->hashlen != sizeof(uint64_t))
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt didn't set up hash caching\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		if(octo_carry_insert(&i, &val, (const octo_dict_carry_t *)test_carry_cache) != 0)
+		{
+			printf("test_carry: FAILED: octo_carry_insert failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	for(uint64_t i = 0; i < 200; i += 2)
+	{
+		if(octo_carry_delete(&i, (const octo_dict_carry_t *)test_carry_cache) != 1)
+		{
+			printf("test_carry: FAILED: octo_carry_delete failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	DEBUG_MSG("test_carry: Rehashing and cloning carry_dict with cached hashes...");
+	test_carry_cache = octo_carry_rehash(test_carry_cache, 8, 8, 16, 2, init_master_key);
+	if(test_carry_cache == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_rehash returned NULL on cached hash dict\n");
+		return 1;
+	}
+	test_carry_cache = octo_carry_rehash(test_carry_cache, 8, 8, 64, 1, new_master_key);
+	if(test_carry_cache == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_rehash returned NULL on cached hash dict with new master key\n");
+		return 1;
+	}
+	octo_dict_carry_t *test_carry_cache_clone = octo_carry_clone(test_carry_cache);
+	if(test_carry_cache_clone == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_clone returned NULL on cached hash dict\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		void *found = octo_carry_fetch(&i, (const octo_dict_carry_t *)test_carry_cache_clone);
+		if((i % 2 == 0) != (found == (void *)test_carry_cache_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0))
+		{
+			printf("test_carry: FAILED: cached hash dict has the wrong records after rehash and clone\n");
+			return 1;
+		}
+	}
+	octo_carry_free(test_carry_cache);
+	octo_carry_free(test_carry_cache_clone);
+	DEBUG_MSG("test_carry: Checking carry_dict index modes...");
+	const octo_index_t test_modes[2] = {OCTO_INDEX_POW2, OCTO_INDEX_FASTRANGE};
+	for(int m = 0; m < 2; m++)
+	{
+		octo_opt_t test_index_opt = {0};
+		test_index_opt.index_mode = test_modes[m];
+		octo_dict_carry_t *test_carry_index = octo_carry_init_opt(8, 8, 100, 1, init_master_key, &test_index_opt);
+		if(test_carry_index == NULL || test_carry_index->bucket_count != (test_modes[m] == OCTO_INDEX_POW2 ? 128 : 100))
+		{
+			printf("test_carry: FAILED: octo_carry_init_opt didn't set up index mode %d\n", m);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			const uint64_t val = i * 5;
+			if(octo_carry_insert(&i, &val, (const octo_dict_carry_t *)test_carry_index) != 0)
+			{
+				printf("test_carry: FAILED: octo_carry_insert failed with index mode %d\n", m);
+				return 1;
+			}
+		}
+		for(uint64_t i = 0; i < 64; i += 2)
+		{
+			if(octo_carry_delete(&i, (const octo_dict_carry_t *)test_carry_index) != 1)
+			{
+				printf("test_carry: FAILED: octo_carry_delete failed with index mode %d\n", m);
+				return 1;
+			}
+		}
+		test_carry_index = octo_carry_rehash(test_carry_index, 8, 8, 50, 2, new_master_key);
+		if(test_carry_index == NULL || test_carry_index->bucket_count != (test_modes[m] == OCTO_INDEX_POW2 ? 64 : 50))
+		{
+			printf("test_carry: FAILED: octo_carry_rehash didn't keep index mode %d\n", m);
+			return 1;
+		}
+		octo_dict_carry_t *test_carry_index_clone = octo_carry_clone(test_carry_index);
+		if(test_carry_index_clone == NULL || test_carry_index_clone->opt.index_mode != test_modes[m])
+		{
+			printf("test_carry: FAILED: octo_carry_clone didn't keep index mode %d\n", m);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			const uint64_t val = i * 5;
+			void *found = octo_carry_fetch(&i, (const octo_dict_carry_t *)test_carry_index_clone);
+			if((i % 2 == 0) != (found == (void *)test_carry_index_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0)
+				|| octo_carry_poke(&i, (const octo_dict_carry_t *)test_carry_index) != (int)(i % 2))
+			{
+				printf("test_carry: FAILED: wrong records after rehash and clone with index mode %d\n", m);
+				return 1;
+			}
+		}
+		octo_carry_free(test_carry_index);
+		octo_carry_free(test_carry_index_clone);
+	}
+	octo_opt_t test_bad_opt = {0};
+	test_bad_opt.index_mode = (octo_index_t)7;
+	if(octo_carry_init_opt(8, 8, 100, 1, init_master_key, &test_bad_opt) != NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt accepted an unknown index mode\n");
+		return 1;
+	}
+	DEBUG_MSG("test_carry: Checking octo_hash_hw fallback...");
+	octo_opt_t test_hw_opt = {0};
+	test_hw_opt.hash = octo_hash_hw;
+	test_hw_opt.fallback_len = 4;
+	octo_dict_carry_t *test_carry_hw = octo_carry_init_opt(8, 8, 1, 1, init_master_key, &test_hw_opt);
+	if(test_carry_hw == NULL || test_carry_hw->hash != octo_hash_select(octo_hash_hw, 8))
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt didn't select octo_hash_hw\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 16; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_carry_insert(&i, &val, (const octo_dict_carry_t *)test_carry_hw) != 0)
+		{
+			printf("test_carry: FAILED: octo_carry_insert failed on octo_hash_hw dict\n");
+			return 1;
+		}
+	}
+	if(test_carry_hw->opt.hash != octo_hash || test_carry_hw->hash != octo_hash_select(octo_hash, 8))
+	{
+		printf("test_carry: FAILED: flooded octo_hash_hw dict didn't fall back to octo_hash\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 16; i++)
+	{
+		const uint64_t val = i + 1;
+		void *found = octo_carry_fetch(&i, (const octo_dict_carry_t *)test_carry_hw);
+		if(found == (void *)test_carry_hw || memcmp(found, &val, 8) != 0)
+		{
+			printf("test_carry: FAILED: records lost in octo_hash_hw fallback\n");
+			return 1;
+		}
+	}
+	if(octo_carry_migrate(test_carry_hw, UINT64_MAX) != 0 || test_carry_hw->old != NULL)
+	{
+		printf("test_carry: FAILED: octo_hash_hw fallback didn't finish migrating\n");
+		return 1;
+	}
+	octo_carry_free(test_carry_hw);
+	DEBUG_MSG("test_carry: Checking key handles...");
+	octo_dict_carry_t *test_carry_shard1 = octo_carry_init(8, 8, 16, 1, init_master_key);
+	octo_dict_carry_t *test_carry_shard2 = octo_carry_init(8, 8, 16, 1, init_master_key);
+	if(test_carry_shard1 == NULL || test_carry_shard2 == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init returned NULL\n");
+		return 1;
+	}
+	const uint64_t test_h_key = 0x0123456789abcdefULL;
+	const uint64_t test_h_val = 42;
+	octo_key_t test_handle;
+	octo_carry_key(&test_handle, &test_h_key, test_carry_shard1);
+	if(octo_carry_poke_h(&test_handle, test_carry_shard1) != 0
+		|| octo_carry_insert_h(&test_handle, &test_h_val, test_carry_shard1) != 0
+		|| octo_carry_insert_h(&test_handle, &test_h_val, test_carry_shard2) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_insert_h failed\n");
+		return 1;
+	}
+	if(octo_carry_poke(&test_h_key, test_carry_shard2) != 1 || octo_carry_poke_h(&test_handle, test_carry_shard1) != 1)
+	{
+		printf("test_carry: FAILED: record inserted by handle not found\n");
+		return 1;
+	}
+	void *test_h_found = octo_carry_fetch_h(&test_handle, test_carry_shard2);
+	if(test_h_found == (void *)test_carry_shard2 || memcmp(test_h_found, &test_h_val, 8) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch_h returned the wrong value\n");
+		return 1;
+	}
+	test_h_found = octo_carry_fetch_safe_h(&test_handle, test_carry_shard1);
+	if(test_h_found == (void *)test_carry_shard1 || memcmp(test_h_found, &test_h_val, 8) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch_safe_h returned the wrong value\n");
+		return 1;
+	}
+	free(test_h_found);
+	// A handle made for another master key is hashed again:
+	uint8_t test_h_master_key[16];
+	memcpy(test_h_master_key, init_master_key, 16);
+	test_h_master_key[0] ^= 1;
+	test_carry_shard2 = octo_carry_rehash(test_carry_shard2, 8, 8, 16, 1, test_h_master_key);
+	if(test_carry_shard2 == NULL || octo_carry_poke_h(&test_handle, test_carry_shard2) != 1 || octo_carry_delete_h(&test_handle, test_carry_shard2) != 1
+		|| octo_carry_poke(&test_h_key, test_carry_shard2) != 0)
+	{
+		printf("test_carry: FAILED: key handle not usable after a rehash with a new master key\n");
+		return 1;
+	}
+	test_handle.keylen = 4;
+	if(octo_carry_fetch_h(&test_handle, test_carry_shard1) != NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch_h accepted a handle with the wrong key length\n");
+		return 1;
+	}
+	octo_carry_free(test_carry_shard1);
+	octo_carry_free(test_carry_shard2);
+	DEBUG_MSG("test_carry: Checking automatic rekeying...");
+	octo_opt_t test_rekey_opt = {0};
+	test_rekey_opt.cache_hash = 1;
+	test_rekey_opt.rekey_len = 3;
+	test_rekey_opt.rekey_step = 1;
+	octo_dict_carry_t *test_carry_rekey = octo_carry_init_opt(8, 8, 8, 1, init_master_key, &test_rekey_opt);
+	if(test_carry_rekey == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_carry_insert(&i, &val, test_carry_rekey) != 0)
+		{
+			printf("test_carry: FAILED: octo_carry_insert failed on rekeying dict\n");
+			return 1;
+		}
+	}
+	if(test_carry_rekey->flood_events == 0 || memcmp(test_carry_rekey->master_key, init_master_key, 16) == 0)
+	{
+		printf("test_carry: FAILED: flooded dict didn't rekey itself\n");
+		return 1;
+	}
+	uint8_t test_rekey_key[16];
+	memcpy(test_rekey_key, init_master_key, 16);
+	test_rekey_key[3] ^= 0x10;
+	if(octo_carry_rekey(test_carry_rekey, test_rekey_key) != 0 || test_carry_rekey->old == NULL
+		|| memcmp(test_carry_rekey->master_key, test_rekey_key, 16) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_rekey didn't start a rekey\n");
+		return 1;
+	}
+	// Records must stay reachable while they're spread over both tables:
+	const uint64_t test_rekey_five = 5;
+	const uint64_t test_rekey_seven = 7;
+	const uint64_t test_rekey_new = 100;
+	if(octo_carry_insert(&test_rekey_five, &test_rekey_new, test_carry_rekey) != 0 || octo_carry_delete(&test_rekey_seven, test_carry_rekey) != 1
+		|| octo_carry_poke(&test_rekey_seven, test_carry_rekey) != 0 || test_carry_rekey->old == NULL)
+	{
+		printf("test_carry: FAILED: update or delete failed during rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		const octo_iov_t parts[2] = {{&i, 3}, {(uint8_t *)&i + 3, 5}};
+		void *found = octo_carry_fetch_iov(parts, 2, test_carry_rekey);
+		if(i != 7 && (found == (void *)test_carry_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_carry: FAILED: record %llu lost during rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	if(octo_carry_migrate(test_carry_rekey, UINT64_MAX) != 0 || test_carry_rekey->old != NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_migrate didn't finish the rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		void *found = octo_carry_fetch(&i, test_carry_rekey);
+		if(i == 7 ? found != (void *)test_carry_rekey : (found == (void *)test_carry_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_carry: FAILED: record %llu wrong after rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_stat_carry_t *test_rekey_stats = octo_carry_stats(test_carry_rekey);
+	if(test_rekey_stats == NULL || test_rekey_stats->total_entries != 63 || test_rekey_stats->flood_events != test_carry_rekey->flood_events)
+	{
+		printf("test_carry: FAILED: octo_carry_stats wrong after rekey\n");
+		return 1;
+	}
+	free(test_rekey_stats);
+	octo_carry_free(test_carry_rekey);
+	DEBUG_MSG("test_carry: Checking bucket growth across size classes...");
+	octo_dict_carry_t *test_carry_grow = octo_carry_init(8, 8, 2, 1, init_master_key);
+	if(test_carry_grow == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init returned NULL\n");
+		return 1;
+	}
+	// Grow the buckets one record at a time, emptying and refilling them so
+	// freed blocks get reused:
+	for(int round = 0; round < 3; round++)
+	{
+		for(uint64_t i = 0; i < 300; i++)
+		{
+			const uint64_t val = (i * 3) + (uint64_t)round;
+			if(octo_carry_insert(&i, &val, test_carry_grow) != 0)
+			{
+				printf("test_carry: FAILED: octo_carry_insert failed while growing buckets\n");
+				return 1;
+			}
+		}
+		for(uint64_t i = 0; i < 300; i += 2)
+		{
+			if(octo_carry_delete(&i, test_carry_grow) != 1)
+			{
+				printf("test_carry: FAILED: octo_carry_delete failed on grown bucket\n");
+				return 1;
+			}
+		}
+	}
+	octo_dict_carry_t *test_carry_grow_clone = octo_carry_clone(test_carry_grow);
+	if(test_carry_grow_clone == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_clone failed on grown buckets\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 300; i++)
+	{
+		const uint64_t val = (i * 3) + 2;
+		void *found = octo_carry_fetch(&i, test_carry_grow);
+		void *cloned = octo_carry_fetch(&i, test_carry_grow_clone);
+		if(i % 2 == 0 ? (found != (void *)test_carry_grow || cloned != (void *)test_carry_grow_clone)
+			: (found == (void *)test_carry_grow || memcmp(found, &val, 8) != 0 || cloned == (void *)test_carry_grow_clone || memcmp(cloned, &val, 8) != 0))
+		{
+			printf("test_carry: FAILED: record %llu wrong after growing buckets\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_carry_free(test_carry_grow);
+	octo_carry_free(test_carry_grow_clone);
+	DEBUG_MSG("test_carry: Checking bucket growth and shrink policy...");
+	octo_opt_t test_policy_opt = {0};
+	test_policy_opt.grow_percent = 100;
+	test_policy_opt.shrink_percent = 25;
+	octo_dict_carry_t *test_carry_policy = octo_carry_init_opt(8, 8, 1, 3, init_master_key, &test_policy_opt);
+	if(test_carry_policy == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 100; i++)
+	{
+		if(octo_carry_insert(&i, &i, test_carry_policy) != 0)
+		{
+			printf("test_carry: FAILED: octo_carry_insert failed on policy dict\n");
+			return 1;
+		}
+	}
+	// Doubling from a tolerance of 3 holds 100 records in 192:
+	if(*((octo_carry_hdr_t *)*(test_carry_policy->buckets) + 1) != 192)
+	{
+		printf("test_carry: FAILED: bucket didn't grow geometrically\n");
+		return 1;
+	}
+	for(uint64_t i = 10; i < 100; i++)
+	{
+		octo_carry_delete(&i, test_carry_policy);
+	}
+	// The last shrink happened at 12 records, from 48 to 24, and 10 records
+	// are still above a quarter of 24:
+	if(*((octo_carry_hdr_t *)*(test_carry_policy->buckets) + 1) != 24)
+	{
+		printf("test_carry: FAILED: bucket didn't shrink after deletions\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 10; i++)
+	{
+		void *found = octo_carry_fetch(&i, test_carry_policy);
+		if(found == (void *)test_carry_policy || memcmp(found, &i, 8) != 0)
+		{
+			printf("test_carry: FAILED: record %llu lost when shrinking bucket\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	for(uint64_t i = 0; i < 10; i++)
+	{
+		octo_carry_delete(&i, test_carry_policy);
+	}
+	if(*((octo_carry_hdr_t *)*(test_carry_policy->buckets) + 1) != 3)
+	{
+		printf("test_carry: FAILED: empty bucket didn't shrink back to its tolerance\n");
+		return 1;
+	}
+	octo_carry_free(test_carry_policy);
+	DEBUG_MSG("test_carry: Checking the bucket size limit...");
+	octo_dict_carry_t *test_carry_full = octo_carry_init(8, 8, 1, 1, init_master_key);
+	if(test_carry_full == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init returned NULL\n");
+		return 1;
+	}
+	// Only 8-bit headers stop a bucket short of 300 records:
+	for(uint64_t i = 0; i < 300; i++)
+	{
+		if(octo_carry_insert(&i, &i, test_carry_full) != (i < OCTO_CARRY_MAX ? 0 : 2))
+		{
+			printf("test_carry: FAILED: wrong result inserting record %llu into one bucket\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_stat_carry_t *test_full_stats = octo_carry_stats(test_carry_full);
+	if(test_full_stats == NULL || test_full_stats->max_bucket_elements != (OCTO_CARRY_MAX < 300 ? OCTO_CARRY_MAX : 300))
+	{
+		printf("test_carry: FAILED: octo_carry_stats reported the wrong largest bucket\n");
+		return 1;
+	}
+	free(test_full_stats);
+	octo_carry_free(test_carry_full);
+	DEBUG_MSG("test_carry: Checking fingerprinted buckets...");
+	for(int cache = 0; cache <= 1; cache++)
+	{
+		octo_opt_t test_fp_opt = {0};
+		test_fp_opt.fingerprint = 1;
+		test_fp_opt.cache_hash = cache;
+		// Few buckets, so the fingerprint scan has to skip over many records:
+		octo_dict_carry_t *test_carry_fp = octo_carry_init_opt(8, 24, 4, 2, init_master_key, &test_fp_opt);
+		if(test_carry_fp == NULL)
+		{
+			printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+			return 1;
+		}
+		uint64_t test_fp_val[3];
+		for(uint64_t i = 0; i < 400; i++)
+		{
+			test_fp_val[0] = test_fp_val[1] = test_fp_val[2] = i * 7;
+			if(octo_carry_insert(&i, test_fp_val, test_carry_fp) != 0)
+			{
+				printf("test_carry: FAILED: octo_carry_insert failed on fingerprinted dict\n");
+				return 1;
+			}
+		}
+		for(uint64_t i = 0; i < 400; i += 3)
+		{
+			if(octo_carry_delete(&i, test_carry_fp) != 1)
+			{
+				printf("test_carry: FAILED: octo_carry_delete failed on fingerprinted dict\n");
+				return 1;
+			}
+		}
+		octo_dict_carry_t *test_carry_fp_clone = octo_carry_clone(test_carry_fp);
+		octo_dict_carry_t *test_carry_fp_rehash = octo_carry_rehash_safe(test_carry_fp, 8, 24, 16, 1, new_master_key);
+		if(test_carry_fp_clone == NULL || test_carry_fp_rehash == NULL)
+		{
+			printf("test_carry: FAILED: clone or rehash failed on fingerprinted dict\n");
+			return 1;
+		}
+		octo_dict_carry_t *test_fp_dicts[3] = {test_carry_fp, test_carry_fp_clone, test_carry_fp_rehash};
+		for(int d = 0; d < 3; d++)
+		{
+			for(uint64_t i = 0; i < 500; i++)
+			{
+				test_fp_val[0] = test_fp_val[1] = test_fp_val[2] = i * 7;
+				void *found = octo_carry_fetch(&i, test_fp_dicts[d]);
+				if(i % 3 == 0 || i >= 400 ? found != (void *)test_fp_dicts[d] : (found == (void *)test_fp_dicts[d] || memcmp(found, test_fp_val, 24) != 0))
+				{
+					printf("test_carry: FAILED: record %llu wrong in fingerprinted dict %d\n", (unsigned long long)i, d);
+					return 1;
+				}
+			}
+			octo_carry_free(test_fp_dicts[d]);
+		}
+	}
+	DEBUG_MSG("test_carry: Checking lazily allocated buckets...");
+	octo_dict_carry_t *test_carry_lazy = octo_carry_init(8, 64, 1 << 16, 4, init_master_key);
+	if(test_carry_lazy == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init returned NULL\n");
+		return 1;
+	}
+	if(octo_carry_poke(key1, test_carry_lazy) || octo_carry_delete(key1, test_carry_lazy) != 0
+		|| octo_carry_fetch(key1, test_carry_lazy) != (void *)test_carry_lazy)
+	{
+		printf("test_carry: FAILED: empty dict found a record\n");
+		return 1;
+	}
+	if(octo_carry_insert(key1, val1, test_carry_lazy) != 0 || octo_carry_insert(key2, val2, test_carry_lazy) != 0)
+	{
+		printf("test_carry: FAILED: octo_carry_insert failed on lazy dict\n");
+		return 1;
+	}
+	uint64_t test_lazy_allocated = 0;
+	for(uint64_t i = 0; i < test_carry_lazy->bucket_count; i++)
+	{
+		test_lazy_allocated += *(test_carry_lazy->buckets + i) != NULL;
+	}
+	if(test_lazy_allocated != 2)
+	{
+		printf("test_carry: FAILED: %llu buckets allocated for two records\n", (unsigned long long)test_lazy_allocated);
+		return 1;
+	}
+	octo_dict_carry_t *test_carry_lazy_clone = octo_carry_clone(test_carry_lazy);
+	octo_stat_carry_t *test_lazy_stats = octo_carry_stats(test_carry_lazy);
+	if(test_carry_lazy_clone == NULL || test_lazy_stats == NULL || test_lazy_stats->total_entries != 2 || test_lazy_stats->empty_buckets != (1 << 16) - 2)
+	{
+		printf("test_carry: FAILED: clone or stats wrong on lazy dict\n");
+		return 1;
+	}
+	free(test_lazy_stats);
+	test_carry_lazy = octo_carry_rehash(test_carry_lazy, 8, 64, 1 << 10, 1, init_master_key);
+	if(test_carry_lazy == NULL || memcmp(octo_carry_fetch(key2, test_carry_lazy), val2, 64) != 0
+		|| memcmp(octo_carry_fetch(key1, test_carry_lazy_clone), val1, 64) != 0 || octo_carry_poke(key3, test_carry_lazy_clone))
+	{
+		printf("test_carry: FAILED: records wrong after rehashing or cloning lazy dict\n");
+		return 1;
+	}
+	octo_carry_clear(test_carry_lazy);
+	if(octo_carry_poke(key1, test_carry_lazy))
+	{
+		printf("test_carry: FAILED: octo_carry_clear left a record in lazy dict\n");
+		return 1;
+	}
+	octo_carry_free(test_carry_lazy);
+	octo_carry_free(test_carry_lazy_clone);
+	DEBUG_MSG("test_carry: Growing carry_dict in place...");
+	if(octo_carry_grow(test_carry_safe) != 1)
+	{
+		printf("test_carry: FAILED: octo_carry_grow grew an OCTO_INDEX_MOD dict\n");
+		return 1;
+	}
+	for(int variant = 0; variant < 3; variant++)
+	{
+		octo_opt_t test_grow_opt = {0};
+		test_grow_opt.index_mode = OCTO_INDEX_POW2;
+		test_grow_opt.cache_hash = variant == 1;
+		test_grow_opt.fingerprint = variant == 2;
+		octo_dict_carry_t *test_carry_split = octo_carry_init_opt(8, 8, 8, 1, init_master_key, &test_grow_opt);
+		if(test_carry_split == NULL)
+		{
+			printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+			return 1;
+		}
+		for(uint64_t i = 0; i < 500; i++)
+		{
+			const uint64_t val = i * 5;
+			if(octo_carry_insert(&i, &val, test_carry_split) != 0)
+			{
+				printf("test_carry: FAILED: octo_carry_insert failed before growing\n");
+				return 1;
+			}
+		}
+		for(int g = 0; g < 4; g++)
+		{
+			if(octo_carry_grow(test_carry_split) != 0)
+			{
+				printf("test_carry: FAILED: octo_carry_grow failed\n");
+				return 1;
+			}
+		}
+		octo_stat_carry_t *test_split_stats = octo_carry_stats(test_carry_split);
+		if(test_carry_split->bucket_count != 128 || test_split_stats == NULL || test_split_stats->total_entries != 500)
+		{
+			printf("test_carry: FAILED: wrong bucket or record count after growing\n");
+			return 1;
+		}
+		free(test_split_stats);
+		for(uint64_t i = 0; i < 500; i++)
+		{
+			const uint64_t val = i * 5;
+			void *found = octo_carry_fetch(&i, test_carry_split);
+			if(found == (void *)test_carry_split || memcmp(found, &val, 8) != 0)
+			{
+				printf("test_carry: FAILED: record %llu lost when growing\n", (unsigned long long)i);
+				return 1;
+			}
+		}
+		octo_carry_free(test_carry_split);
+	}
+	DEBUG_MSG("test_carry: Checking swap deletes...");
+	for(int fp = 0; fp <= 1; fp++)
+	{
+		octo_opt_t test_swap_opt = {0};
+		test_swap_opt.swap_delete = 1;
+		test_swap_opt.fingerprint = fp;
+		octo_dict_carry_t *test_carry_swap = octo_carry_init_opt(8, 8, 1, 1, init_master_key, &test_swap_opt);
+		if(test_carry_swap == NULL)
+		{
+			printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+			return 1;
+		}
+		for(uint64_t i = 0; i < 50; i++)
+		{
+			if(octo_carry_insert(&i, &i, test_carry_swap) != 0)
+			{
+				printf("test_carry: FAILED: octo_carry_insert failed on swap delete dict\n");
+				return 1;
+			}
+		}
+		// The last record takes the deleted first record's slot:
+		const uint64_t test_swap_first = 0;
+		const uint64_t test_swap_last = 49;
+		void *test_swap_slot = octo_carry_fetch(&test_swap_first, test_carry_swap);
+		if(octo_carry_delete(&test_swap_first, test_carry_swap) != 1 || octo_carry_fetch(&test_swap_last, test_carry_swap) != test_swap_slot)
+		{
+			printf("test_carry: FAILED: swap delete didn't move the last record\n");
+			return 1;
+		}
+		for(uint64_t i = 2; i < 50; i += 2)
+		{
+			octo_carry_delete(&i, test_carry_swap);
+		}
+		octo_dict_carry_t *test_carry_swap_clone = octo_carry_clone(test_carry_swap);
+		octo_stat_carry_t *test_swap_stats = octo_carry_stats(test_carry_swap);
+		if(test_carry_swap_clone == NULL || test_swap_stats == NULL || test_swap_stats->total_entries != 25)
+		{
+			printf("test_carry: FAILED: clone or stats wrong after swap deletes\n");
+			return 1;
+		}
+		free(test_swap_stats);
+		for(uint64_t i = 0; i < 50; i++)
+		{
+			void *found = octo_carry_fetch(&i, test_carry_swap_clone);
+			if(i % 2 == 0 ? found != (void *)test_carry_swap_clone : (found == (void *)test_carry_swap_clone || memcmp(found, &i, 8) != 0))
+			{
+				printf("test_carry: FAILED: record %llu wrong after swap deletes\n", (unsigned long long)i);
+				return 1;
+			}
+		}
+		octo_carry_free(test_carry_swap);
+		octo_carry_free(test_carry_swap_clone);
+	}
+	DEBUG_MSG("test_carry: Checking self-organizing buckets...");
+	// Hit depths of fetching the last of 8 records twice, with each policy:
+	const uint64_t test_reorder_depth[3] = {14, 7, 13};
+	for(int reorder = OCTO_REORDER_NONE; reorder <= OCTO_REORDER_TRANSPOSE; reorder++)
+	{
+		for(int fp = 0; fp <= 1; fp++)
+		{
+			octo_opt_t test_reorder_opt = {0};
+			test_reorder_opt.reorder = (octo_reorder_t)reorder;
+			test_reorder_opt.count_hits = 1;
+			test_reorder_opt.fingerprint = fp;
+			octo_dict_carry_t *test_carry_reorder = octo_carry_init_opt(8, 8, 1, 8, init_master_key, &test_reorder_opt);
+			if(test_carry_reorder == NULL)
+			{
+				printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+				return 1;
+			}
+			for(uint64_t i = 0; i < 8; i++)
+			{
+				if(octo_carry_insert(&i, &i, test_carry_reorder) != 0)
+				{
+					printf("test_carry: FAILED: octo_carry_insert failed on self-organizing dict\n");
+					return 1;
+				}
+			}
+			const uint64_t test_reorder_key = 7;
+			for(int i = 0; i < 2; i++)
+			{
+				void *found = octo_carry_fetch(&test_reorder_key, test_carry_reorder);
+				if(found == (void *)test_carry_reorder || memcmp(found, &test_reorder_key, 8) != 0)
+				{
+					printf("test_carry: FAILED: self-organizing dict returned the wrong value\n");
+					return 1;
+				}
+			}
+			if(test_carry_reorder->hits != 2 || test_carry_reorder->hit_depth != test_reorder_depth[reorder])
+			{
+				printf("test_carry: FAILED: policy %d made %llu hits at depth %llu\n", reorder, (unsigned long long)test_carry_reorder->hits, (unsigned long long)test_carry_reorder->hit_depth);
+				return 1;
+			}
+			for(uint64_t i = 0; i < 8; i++)
+			{
+				void *found = octo_carry_fetch(&i, test_carry_reorder);
+				if(found == (void *)test_carry_reorder || memcmp(found, &i, 8) != 0)
+				{
+					printf("test_carry: FAILED: record %llu wrong after reordering\n", (unsigned long long)i);
+					return 1;
+				}
+			}
+			octo_stat_carry_t *test_reorder_stats = octo_carry_stats(test_carry_reorder);
+			if(test_reorder_stats == NULL || test_reorder_stats->total_entries != 8 || test_reorder_stats->hits != 10)
+			{
+				printf("test_carry: FAILED: stats wrong on self-organizing dict\n");
+				return 1;
+			}
+			free(test_reorder_stats);
+			octo_carry_free(test_carry_reorder);
+		}
+	}
+	DEBUG_MSG("test_carry: Checking copy-on-write clones...");
+	octo_opt_t test_cow_opt = {0};
+	test_cow_opt.cow_clone = 1;
+	test_cow_opt.index_mode = OCTO_INDEX_POW2;
+	test_cow_opt.shrink_percent = 25;
+	octo_dict_carry_t *test_carry_cow = octo_carry_init_opt(8, 8, 64, 2, init_master_key, &test_cow_opt);
+	if(test_carry_cow == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		if(octo_carry_insert(&i, &i, test_carry_cow) != 0)
+		{
+			printf("test_carry: FAILED: octo_carry_insert failed on copy-on-write dict\n");
+			return 1;
+		}
+	}
+	octo_dict_carry_t *test_carry_snap1 = octo_carry_clone(test_carry_cow);
+	if(test_carry_snap1 == NULL || test_carry_snap1->arena != test_carry_cow->arena || *(test_carry_snap1->buckets) != *(test_carry_cow->buckets))
+	{
+		printf("test_carry: FAILED: copy-on-write clone didn't share the buckets\n");
+		return 1;
+	}
+	// Update, delete, rekey, and grow the original; the snapshot must not change:
+	for(uint64_t i = 0; i < 50; i++)
+	{
+		const uint64_t val = i + 1000;
+		if(octo_carry_insert(&i, &val, test_carry_cow) != 0)
+		{
+			printf("test_carry: FAILED: update failed on shared bucket\n");
+			return 1;
+		}
+	}
+	for(uint64_t i = 50; i < 100; i++)
+	{
+		if(octo_carry_delete(&i, test_carry_cow) != 1)
+		{
+			printf("test_carry: FAILED: delete failed on shared bucket\n");
+			return 1;
+		}
+	}
+	octo_dict_carry_t *test_carry_snap2 = octo_carry_clone(test_carry_cow);
+	uint8_t test_cow_key[16];
+	memcpy(test_cow_key, init_master_key, 16);
+	test_cow_key[5] ^= 0x01;
+	if(test_carry_snap2 == NULL || octo_carry_rekey(test_carry_cow, test_cow_key) != 0 || octo_carry_migrate(test_carry_cow, UINT64_MAX) != 0
+		|| octo_carry_grow(test_carry_cow) != 0)
+	{
+		printf("test_carry: FAILED: rekey or grow failed on copy-on-write dict\n");
+		return 1;
+	}
+	for(uint64_t i = 200; i < 250; i++)
+	{
+		octo_carry_insert(&i, &i, test_carry_cow);
+	}
+	octo_carry_free(test_carry_cow);
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		void *found = octo_carry_fetch(&i, test_carry_snap1);
+		if(found == (void *)test_carry_snap1 || memcmp(found, &i, 8) != 0)
+		{
+			printf("test_carry: FAILED: record %llu changed in first snapshot\n", (unsigned long long)i);
+			return 1;
+		}
+		const uint64_t val = i < 50 ? i + 1000 : i;
+		found = octo_carry_fetch(&i, test_carry_snap2);
+		if(i >= 50 && i < 100 ? found != (void *)test_carry_snap2 : (found == (void *)test_carry_snap2 || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_carry: FAILED: record %llu wrong in second snapshot\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_carry_clear(test_carry_snap2);
+	const uint64_t test_cow_probe = 7;
+	if(octo_carry_poke(&test_cow_probe, test_carry_snap2) != 0 || octo_carry_poke(&test_cow_probe, test_carry_snap1) != 1
+		|| octo_carry_insert(&test_cow_probe, &test_cow_probe, test_carry_snap2) != 0)
+	{
+		printf("test_carry: FAILED: clearing a snapshot changed another\n");
+		return 1;
+	}
+	// Writing through a fetched pointer mustn't reach a clone sharing the bucket:
+	octo_dict_carry_t *test_carry_snap3 = octo_carry_clone(test_carry_snap2);
+	if(test_carry_snap3 == NULL)
+	{
+		printf("test_carry: FAILED: octo_carry_clone returned NULL\n");
+		return 1;
+	}
+	const uint64_t test_cow_written = 99;
+	void *test_cow_found = octo_carry_fetch(&test_cow_probe, test_carry_snap2);
+	if(test_cow_found == NULL || test_cow_found == (void *)test_carry_snap2)
+	{
+		printf("test_carry: FAILED: octo_carry_fetch didn't find record in copy-on-write dict\n");
+		return 1;
+	}
+	memcpy(test_cow_found, &test_cow_written, 8);
+	octo_key_t test_cow_handle;
+	octo_carry_key(&test_cow_handle, &test_cow_probe, test_carry_snap3);
+	test_cow_found = octo_carry_fetch_h(&test_cow_handle, test_carry_snap3);
+	if(test_cow_found == NULL || test_cow_found == (void *)test_carry_snap3 || memcmp(test_cow_found, &test_cow_probe, 8) != 0)
+	{
+		printf("test_carry: FAILED: write through a fetched pointer reached a clone\n");
+		return 1;
+	}
+	test_cow_found = octo_carry_fetch(&test_cow_probe, test_carry_snap2);
+	if(test_cow_found == NULL || test_cow_found == (void *)test_carry_snap2 || memcmp(test_cow_found, &test_cow_written, 8) != 0)
+	{
+		printf("test_carry: FAILED: write through a fetched pointer was lost\n");
+		return 1;
+	}
+	octo_carry_free(test_carry_snap1);
+	octo_carry_free(test_carry_snap2);
+	octo_carry_free(test_carry_snap3);
 	DEBUG_MSG("test_carry: Deleting carry_dict...");
 	octo_carry_free(test_carry_safe);
 	octo_carry_free(test_carry_clone);
@@ -389,6 +389,41 @@ int main()
 		printf("test_cll: FAILED: octo_cll_insert failed to re-insert deleted record\n");
 		return 1;
 	}
+	DEBUG_MSG("test_cll: Using keys given in parts...");
+	const octo_iov_t key2_parts[3] = {{key2, 3}, {key2 + 3, 1}, {key2 + 4, 4}};
+	if(octo_cll_delete_iov(key2_parts, 3, (const octo_dict_cll_t *)test_cll_safe) != 1)
+	{
+		printf("test_cll: FAILED: octo_cll_delete_iov couldn't delete key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(octo_cll_poke(key2, (const octo_dict_cll_t *)test_cll_safe) || octo_cll_poke_iov(key2_parts, 3, (const octo_dict_cll_t *)test_cll_safe))
+	{
+		printf("test_cll: FAILED: deleted key \"bcdefgh\\0\" still present\n");
+		return 1;
+	}
+	if(octo_cll_insert_iov(key2_parts, 3, val2, (const octo_dict_cll_t *)test_cll_safe) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_insert_iov failed inserting key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	output2 = octo_cll_fetch(key2, (const octo_dict_cll_t *)test_cll_safe);
+	if(output2 == (void *)test_cll_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch couldn't find key inserted in parts\n");
+		return 1;
+	}
+	output2 = octo_cll_fetch_safe_iov(key2_parts, 3, (const octo_dict_cll_t *)test_cll_safe);
+	if(output2 == NULL || output2 == (void *)test_cll_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch_safe_iov couldn't find key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	free(output2);
+	if(octo_cll_fetch_iov(key2_parts, 2, (const octo_dict_cll_t *)test_cll_safe) != NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch_iov accepted a key of the wrong length\n");
+		return 1;
+	}
 	DEBUG_MSG("test_cll: Cloning cll_dict...");
 	octo_dict_cll_t *test_cll_clone = octo_cll_clone(test_cll_safe);
 	if(test_cll_clone == NULL)
@@ -426,6 +461,527 @@ int main()
 		printf("test_cll: FAILED: octo_cll_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
 		return 1;
 	}
+	DEBUG_MSG("test_cll: Creating SipHash-1-3 cll_dict...");
+	octo_opt_t test_opt = {0};
+	test_opt.hash = octo_hash13;
+	octo_dict_cll_t *test_cll_opt = octo_cll_init_opt(8, 64, 128, init_master_key, &test_opt);
+	if(test_cll_opt == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_init_opt returned NULL\n");
+		return 1;
+	}
+	if(octo_cll_insert(key1, val1, (const octo_dict_cll_t *)test_cll_opt) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_insert failed on SipHash-1-3 dict\n");
+		return 1;
+	}
+	DEBUG_MSG("test_cll: Rehashing and cloning SipHash-1-3 cll_dict...");
+	test_cll_opt = octo_cll_rehash(test_cll_opt, 8, 64, 16, new_master_key);
+	if(test_cll_opt == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_rehash returned NULL on SipHash-1-3 dict\n");
+		return 1;
+	}
+	octo_dict_cll_t *test_cll_opt_clone = octo_cll_clone(test_cll_opt);
+	if(test_cll_opt_clone == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_clone returned NULL on SipHash-1-3 dict\n");
+		return 1;
+	}
+	if(test_cll_opt_clone->opt.hash != octo_hash13 || test_cll_opt_clone->hash != octo_hash_select(octo_hash13, 8))
+	{
+		printf("test_cll: FAILED: hash selection not preserved by rehash and clone\n");
+		return 1;
+	}
+	output1 = octo_cll_fetch(key1, (const octo_dict_cll_t *)test_cll_opt_clone);
+	if(output1 == (void *)test_cll_opt_clone || memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch couldn't find test value in SipHash-1-3 dict\n");
+		return 1;
+	}
+	octo_cll_free(test_cll_opt);
+	octo_cll_free(test_cll_opt_clone);
+	DEBUG_MSG("test_cll: Creating cll_dict with cached hashes...");
+	octo_opt_t test_cache_opt = {0};
+	test_cache_opt.cache_hash = 1;
+	octo_dict_cll_t *test_cll_cache = octo_cll_init_opt(8, 8, 16, init_master_key, &test_cache_opt);
+	if(test_cll_cache == NULL || test_cll_cache->hashlen != sizeof(uint64_t))
+	{
+		printf("test_cll: FAILED: octo_cll_init_opt didn't set up hash caching\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		if(octo_cll_insert(&i, &val, (const octo_dict_cll_t *)test_cll_cache) != 0)
+		{
+			printf("test_cll: FAILED: octo_cll_insert failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	for(uint64_t i = 0; i < 200; i += 2)
+	{
+		if(octo_cll_delete(&i, (const octo_dict_cll_t *)test_cll_cache) != 1)
+		{
+			printf("test_cll: FAILED: octo_cll_delete failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	DEBUG_MSG("test_cll: Rehashing and cloning cll_dict with cached hashes...");
+	test_cll_cache = octo_cll_rehash(test_cll_cache, 8, 8, 32, init_master_key);
+	if(test_cll_cache == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_rehash returned NULL on cached hash dict\n");
+		return 1;
+	}
+	test_cll_cache = octo_cll_rehash(test_cll_cache, 8, 8, 64, new_master_key);
+	if(test_cll_cache == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_rehash returned NULL on cached hash dict with new master key\n");
+		return 1;
+	}
+	octo_dict_cll_t *test_cll_cache_clone = octo_cll_clone(test_cll_cache);
+	if(test_cll_cache_clone == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_clone returned NULL on cached hash dict\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		void *found = octo_cll_fetch(&i, (const octo_dict_cll_t *)test_cll_cache_clone);
+		if((i % 2 == 0) != (found == (void *)test_cll_cache_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0))
+		{
+			printf("test_cll: FAILED: cached hash dict has the wrong records after rehash and clone\n");
+			return 1;
+		}
+	}
+	octo_cll_free(test_cll_cache);
+	octo_cll_free(test_cll_cache_clone);
+	DEBUG_MSG("test_cll: Checking cll_dict index modes...");
+	const octo_index_t test_modes[2] = {OCTO_INDEX_POW2, OCTO_INDEX_FASTRANGE};
+	for(int m = 0; m < 2; m++)
+	{
+		octo_opt_t test_index_opt = {0};
+		test_index_opt.index_mode = test_modes[m];
+		octo_dict_cll_t *test_cll_index = octo_cll_init_opt(8, 8, 100, init_master_key, &test_index_opt);
+		if(test_cll_index == NULL || test_cll_index->bucket_count != (test_modes[m] == OCTO_INDEX_POW2 ? 128 : 100))
+		{
+			printf("test_cll: FAILED: octo_cll_init_opt didn't set up index mode %d\n", m);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			const uint64_t val = i * 5;
+			if(octo_cll_insert(&i, &val, (const octo_dict_cll_t *)test_cll_index) != 0)
+			{
+				printf("test_cll: FAILED: octo_cll_insert failed with index mode %d\n", m);
+				return 1;
+			}
+		}
+		for(uint64_t i = 0; i < 64; i += 2)
+		{
+			if(octo_cll_delete(&i, (const octo_dict_cll_t *)test_cll_index) != 1)
+			{
+				printf("test_cll: FAILED: octo_cll_delete failed with index mode %d\n", m);
+				return 1;
+			}
+		}
+		test_cll_index = octo_cll_rehash(test_cll_index, 8, 8, 50, new_master_key);
+		if(test_cll_index == NULL || test_cll_index->bucket_count != (test_modes[m] == OCTO_INDEX_POW2 ? 64 : 50))
+		{
+			printf("test_cll: FAILED: octo_cll_rehash didn't keep index mode %d\n", m);
+			return 1;
+		}
+		octo_dict_cll_t *test_cll_index_clone = octo_cll_clone(test_cll_index);
+		if(test_cll_index_clone == NULL || test_cll_index_clone->opt.index_mode != test_modes[m])
+		{
+			printf("test_cll: FAILED: octo_cll_clone didn't keep index mode %d\n", m);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			const uint64_t val = i * 5;
+			void *found = octo_cll_fetch(&i, (const octo_dict_cll_t *)test_cll_index_clone);
+			if((i % 2 == 0) != (found == (void *)test_cll_index_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0)
+				|| octo_cll_poke(&i, (const octo_dict_cll_t *)test_cll_index) != (int)(i % 2))
+			{
+				printf("test_cll: FAILED: wrong records after rehash and clone with index mode %d\n", m);
+				return 1;
+			}
+		}
+		octo_cll_free(test_cll_index);
+		octo_cll_free(test_cll_index_clone);
+	}
+	octo_opt_t test_bad_opt = {0};
+	test_bad_opt.index_mode = (octo_index_t)7;
+	if(octo_cll_init_opt(8, 8, 100, init_master_key, &test_bad_opt) != NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_init_opt accepted an unknown index mode\n");
+		return 1;
+	}
+	DEBUG_MSG("test_cll: Checking octo_hash_hw fallback...");
+	octo_opt_t test_hw_opt = {0};
+	test_hw_opt.hash = octo_hash_hw;
+	test_hw_opt.fallback_len = 4;
+	octo_dict_cll_t *test_cll_hw = octo_cll_init_opt(8, 8, 1, init_master_key, &test_hw_opt);
+	if(test_cll_hw == NULL || test_cll_hw->hash != octo_hash_select(octo_hash_hw, 8))
+	{
+		printf("test_cll: FAILED: octo_cll_init_opt didn't select octo_hash_hw\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 16; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_cll_insert(&i, &val, (const octo_dict_cll_t *)test_cll_hw) != 0)
+		{
+			printf("test_cll: FAILED: octo_cll_insert failed on octo_hash_hw dict\n");
+			return 1;
+		}
+	}
+	if(test_cll_hw->opt.hash != octo_hash || test_cll_hw->hash != octo_hash_select(octo_hash, 8))
+	{
+		printf("test_cll: FAILED: flooded octo_hash_hw dict didn't fall back to octo_hash\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 16; i++)
+	{
+		const uint64_t val = i + 1;
+		void *found = octo_cll_fetch(&i, (const octo_dict_cll_t *)test_cll_hw);
+		if(found == (void *)test_cll_hw || memcmp(found, &val, 8) != 0)
+		{
+			printf("test_cll: FAILED: records lost in octo_hash_hw fallback\n");
+			return 1;
+		}
+	}
+	if(octo_cll_migrate(test_cll_hw, UINT64_MAX) != 0 || test_cll_hw->old != NULL)
+	{
+		printf("test_cll: FAILED: octo_hash_hw fallback didn't finish migrating\n");
+		return 1;
+	}
+	octo_cll_free(test_cll_hw);
+	DEBUG_MSG("test_cll: Checking key handles...");
+	octo_dict_cll_t *test_cll_shard1 = octo_cll_init(8, 8, 16, init_master_key);
+	octo_dict_cll_t *test_cll_shard2 = octo_cll_init(8, 8, 16, init_master_key);
+	if(test_cll_shard1 == NULL || test_cll_shard2 == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_init returned NULL\n");
+		return 1;
+	}
+	const uint64_t test_h_key = 0x0123456789abcdefULL;
+	const uint64_t test_h_val = 42;
+	octo_key_t test_handle;
+	octo_cll_key(&test_handle, &test_h_key, test_cll_shard1);
+	if(octo_cll_poke_h(&test_handle, test_cll_shard1) != 0
+		|| octo_cll_insert_h(&test_handle, &test_h_val, test_cll_shard1) != 0
+		|| octo_cll_insert_h(&test_handle, &test_h_val, test_cll_shard2) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_insert_h failed\n");
+		return 1;
+	}
+	if(octo_cll_poke(&test_h_key, test_cll_shard2) != 1 || octo_cll_poke_h(&test_handle, test_cll_shard1) != 1)
+	{
+		printf("test_cll: FAILED: record inserted by handle not found\n");
+		return 1;
+	}
+	void *test_h_found = octo_cll_fetch_h(&test_handle, test_cll_shard2);
+	if(test_h_found == (void *)test_cll_shard2 || memcmp(test_h_found, &test_h_val, 8) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch_h returned the wrong value\n");
+		return 1;
+	}
+	test_h_found = octo_cll_fetch_safe_h(&test_handle, test_cll_shard1);
+	if(test_h_found == (void *)test_cll_shard1 || memcmp(test_h_found, &test_h_val, 8) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch_safe_h returned the wrong value\n");
+		return 1;
+	}
+	free(test_h_found);
+	// A handle made for another master key is hashed again:
+	uint8_t test_h_master_key[16];
+	memcpy(test_h_master_key, init_master_key, 16);
+	test_h_master_key[0] ^= 1;
+	test_cll_shard2 = octo_cll_rehash(test_cll_shard2, 8, 8, 16, test_h_master_key);
+	if(test_cll_shard2 == NULL || octo_cll_poke_h(&test_handle, test_cll_shard2) != 1 || octo_cll_delete_h(&test_handle, test_cll_shard2) != 1
+		|| octo_cll_poke(&test_h_key, test_cll_shard2) != 0)
+	{
+		printf("test_cll: FAILED: key handle not usable after a rehash with a new master key\n");
+		return 1;
+	}
+	test_handle.keylen = 4;
+	if(octo_cll_fetch_h(&test_handle, test_cll_shard1) != NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_fetch_h accepted a handle with the wrong key length\n");
+		return 1;
+	}
+	octo_cll_free(test_cll_shard1);
+	octo_cll_free(test_cll_shard2);
+	DEBUG_MSG("test_cll: Checking automatic rekeying...");
+	octo_opt_t test_rekey_opt = {0};
+	test_rekey_opt.cache_hash = 1;
+	test_rekey_opt.rekey_len = 3;
+	test_rekey_opt.rekey_step = 1;
+	octo_dict_cll_t *test_cll_rekey = octo_cll_init_opt(8, 8, 8, init_master_key, &test_rekey_opt);
+	if(test_cll_rekey == NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_cll_insert(&i, &val, test_cll_rekey) != 0)
+		{
+			printf("test_cll: FAILED: octo_cll_insert failed on rekeying dict\n");
+			return 1;
+		}
+	}
+	if(test_cll_rekey->flood_events == 0 || memcmp(test_cll_rekey->master_key, init_master_key, 16) == 0)
+	{
+		printf("test_cll: FAILED: flooded dict didn't rekey itself\n");
+		return 1;
+	}
+	uint8_t test_rekey_key[16];
+	memcpy(test_rekey_key, init_master_key, 16);
+	test_rekey_key[3] ^= 0x10;
+	if(octo_cll_rekey(test_cll_rekey, test_rekey_key) != 0 || test_cll_rekey->old == NULL
+		|| memcmp(test_cll_rekey->master_key, test_rekey_key, 16) != 0)
+	{
+		printf("test_cll: FAILED: octo_cll_rekey didn't start a rekey\n");
+		return 1;
+	}
+	// Records must stay reachable while they're spread over both tables:
+	const uint64_t test_rekey_five = 5;
+	const uint64_t test_rekey_seven = 7;
+	const uint64_t test_rekey_new = 100;
+	if(octo_cll_insert(&test_rekey_five, &test_rekey_new, test_cll_rekey) != 0 || octo_cll_delete(&test_rekey_seven, test_cll_rekey) != 1
+		|| octo_cll_poke(&test_rekey_seven, test_cll_rekey) != 0 || test_cll_rekey->old == NULL)
+	{
+		printf("test_cll: FAILED: update or delete failed during rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		const octo_iov_t parts[2] = {{&i, 3}, {(uint8_t *)&i + 3, 5}};
+		void *found = octo_cll_fetch_iov(parts, 2, test_cll_rekey);
+		if(i != 7 && (found == (void *)test_cll_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_cll: FAILED: record %llu lost during rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	if(octo_cll_migrate(test_cll_rekey, UINT64_MAX) != 0 || test_cll_rekey->old != NULL)
+	{
+		printf("test_cll: FAILED: octo_cll_migrate didn't finish the rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		void *found = octo_cll_fetch(&i, test_cll_rekey);
+		if(i == 7 ? found != (void *)test_cll_rekey : (found == (void *)test_cll_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_cll: FAILED: record %llu wrong after rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_stat_cll_t *test_rekey_stats = octo_cll_stats(test_cll_rekey);
+	if(test_rekey_stats == NULL || test_rekey_stats->total_entries != 63 || test_rekey_stats->flood_events != test_cll_rekey->flood_events)
+	{
+		printf("test_cll: FAILED: octo_cll_stats wrong after rekey\n");
+		return 1;
+	}
+	free(test_rekey_stats);
+	octo_cll_free(test_cll_rekey);
+	DEBUG_MSG("test_cll: Checking self-organizing chains...");
+	// Hit depths of fetching the first of 8 records, now at the tail, twice:
+	const uint64_t test_reorder_depth[3] = {14, 7, 13};
+	for(int reorder = OCTO_REORDER_NONE; reorder <= OCTO_REORDER_TRANSPOSE; reorder++)
+	{
+		octo_opt_t test_reorder_opt = {0};
+		test_reorder_opt.reorder = (octo_reorder_t)reorder;
+		test_reorder_opt.count_hits = 1;
+		octo_dict_cll_t *test_cll_reorder = octo_cll_init_opt(8, 8, 1, init_master_key, &test_reorder_opt);
+		if(test_cll_reorder == NULL)
+		{
+			printf("test_cll: FAILED: octo_cll_init_opt returned NULL\n");
+			return 1;
+		}
+		for(uint64_t i = 0; i < 8; i++)
+		{
+			if(octo_cll_insert(&i, &i, test_cll_reorder) != 0)
+			{
+				printf("test_cll: FAILED: octo_cll_insert failed on self-organizing dict\n");
+				return 1;
+			}
+		}
+		const uint64_t test_reorder_key = 0;
+		for(int i = 0; i < 2; i++)
+		{
+			void *found = octo_cll_fetch(&test_reorder_key, test_cll_reorder);
+			if(found == (void *)test_cll_reorder || memcmp(found, &test_reorder_key, 8) != 0)
+			{
+				printf("test_cll: FAILED: self-organizing dict returned the wrong value\n");
+				return 1;
+			}
+		}
+		if(test_cll_reorder->hits != 2 || test_cll_reorder->hit_depth != test_reorder_depth[reorder])
+		{
+			printf("test_cll: FAILED: policy %d made %llu hits at depth %llu\n", reorder, (unsigned long long)test_cll_reorder->hits, (unsigned long long)test_cll_reorder->hit_depth);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 8; i++)
+		{
+			void *found = octo_cll_fetch(&i, test_cll_reorder);
+			if(found == (void *)test_cll_reorder || memcmp(found, &i, 8) != 0)
+			{
+				printf("test_cll: FAILED: record %llu wrong after reordering\n", (unsigned long long)i);
+				return 1;
+			}
+		}
+		octo_stat_cll_t *test_reorder_stats = octo_cll_stats(test_cll_reorder);
+		if(test_reorder_stats == NULL || test_reorder_stats->total_entries != 8 || test_reorder_stats->hits != 10)
+		{
+			printf("test_cll: FAILED: stats wrong on self-organizing dict\n");
+			return 1;
+		}
+		free(test_reorder_stats);
+		octo_cll_free(test_cll_reorder);
+	}
+	DEBUG_MSG("test_cll: Checking slab allocated nodes...");
+	for(int compact = 0; compact <= 1; compact++)
+	{
+		octo_opt_t test_slab_opt = {0};
+		test_slab_opt.compact_links = compact;
+		test_slab_opt.cache_hash = compact;
+		test_slab_opt.reorder = OCTO_REORDER_TRANSPOSE;
+		octo_dict_cll_t *test_cll_slab = octo_cll_init_opt(8, 8, 64, init_master_key, &test_slab_opt);
+		if(test_cll_slab == NULL || test_cll_slab->linklen != (compact ? 4 : sizeof(void *)))
+		{
+			printf("test_cll: FAILED: octo_cll_init_opt returned NULL or the wrong link size\n");
+			return 1;
+		}
+		// Enough records for several slabs, with deleted nodes reused:
+		for(int round = 0; round < 2; round++)
+		{
+			for(uint64_t i = 0; i < 2000; i++)
+			{
+				if(octo_cll_insert(&i, &i, test_cll_slab) != 0)
+				{
+					printf("test_cll: FAILED: octo_cll_insert failed on slab dict\n");
+					return 1;
+				}
+			}
+			for(uint64_t i = 0; i < 2000; i += 2)
+			{
+				if(octo_cll_delete(&i, test_cll_slab) != 1)
+				{
+					printf("test_cll: FAILED: octo_cll_delete failed on slab dict\n");
+					return 1;
+				}
+			}
+		}
+		uint8_t test_slab_key[16];
+		memcpy(test_slab_key, init_master_key, 16);
+		test_slab_key[9] ^= 0x04;
+		if(octo_cll_rekey(test_cll_slab, test_slab_key) != 0 || octo_cll_migrate(test_cll_slab, 20) != 0)
+		{
+			printf("test_cll: FAILED: rekey failed on slab dict\n");
+			return 1;
+		}
+		octo_dict_cll_t *test_cll_slab_clone = octo_cll_clone(test_cll_slab);
+		if(test_cll_slab_clone == NULL)
+		{
+			printf("test_cll: FAILED: octo_cll_clone failed on slab dict\n");
+			return 1;
+		}
+		for(uint64_t i = 0; i < 2000; i++)
+		{
+			void *found = octo_cll_fetch(&i, test_cll_slab);
+			void *copy = octo_cll_fetch(&i, test_cll_slab_clone);
+			if(i % 2 == 0 ? (found != (void *)test_cll_slab || copy != (void *)test_cll_slab_clone)
+				: (found == (void *)test_cll_slab || memcmp(found, &i, 8) != 0 || copy == (void *)test_cll_slab_clone || memcmp(copy, &i, 8) != 0))
+			{
+				printf("test_cll: FAILED: record %llu wrong in slab dict\n", (unsigned long long)i);
+				return 1;
+			}
+		}
+		octo_stat_cll_t *test_slab_stats = octo_cll_stats(test_cll_slab_clone);
+		if(test_slab_stats == NULL || test_slab_stats->total_entries != 1000)
+		{
+			printf("test_cll: FAILED: octo_cll_stats wrong on slab dict\n");
+			return 1;
+		}
+		free(test_slab_stats);
+		octo_cll_clear(test_cll_slab);
+		const uint64_t test_slab_probe = 1;
+		if(octo_cll_poke(&test_slab_probe, test_cll_slab) != 0 || octo_cll_insert(&test_slab_probe, &test_slab_probe, test_cll_slab) != 0
+			|| octo_cll_poke(&test_slab_probe, test_cll_slab) != 1)
+		{
+			printf("test_cll: FAILED: slab dict unusable after clearing\n");
+			return 1;
+		}
+		octo_cll_free(test_cll_slab);
+		octo_cll_free(test_cll_slab_clone);
+	}
+	DEBUG_MSG("test_cll: Checking relinking rehash...");
+	for(int compact = 0; compact <= 1; compact++)
+	{
+		octo_opt_t test_relink_opt = {0};
+		test_relink_opt.compact_links = compact;
+		test_relink_opt.cache_hash = !compact;
+		octo_dict_cll_t *test_cll_relink = octo_cll_init_opt(8, 8, 32, init_master_key, &test_relink_opt);
+		if(test_cll_relink == NULL)
+		{
+			printf("test_cll: FAILED: octo_cll_init_opt returned NULL\n");
+			return 1;
+		}
+		for(uint64_t i = 0; i < 1000; i++)
+		{
+			if(octo_cll_insert(&i, &i, test_cll_relink) != 0 || (i % 3 == 0 && octo_cll_delete(&i, test_cll_relink) != 1))
+			{
+				printf("test_cll: FAILED: couldn't fill relinking dict\n");
+				return 1;
+			}
+		}
+		// Keep the key and then change it; the nodes move to the new table either way:
+		for(int round = 0; round < 2; round++)
+		{
+			struct octo_cll_arena_s *test_relink_arena = test_cll_relink->arena;
+			test_cll_relink = octo_cll_rehash(test_cll_relink, 8, 8, round == 0 ? 512 : 7, round == 0 ? init_master_key : new_master_key);
+			if(test_cll_relink == NULL || test_cll_relink->arena != test_relink_arena)
+			{
+				printf("test_cll: FAILED: octo_cll_rehash didn't relink the nodes\n");
+				return 1;
+			}
+			for(uint64_t i = 0; i < 1000; i++)
+			{
+				void *found = octo_cll_fetch(&i, test_cll_relink);
+				if(i % 3 == 0 ? found != (void *)test_cll_relink : (found == (void *)test_cll_relink || memcmp(found, &i, 8) != 0))
+				{
+					printf("test_cll: FAILED: record %llu wrong after relinking rehash\n", (unsigned long long)i);
+					return 1;
+				}
+			}
+		}
+		// Deleted nodes are still reused, and a longer value still copies:
+		const uint64_t test_relink_key = 3;
+		if(octo_cll_insert(&test_relink_key, &test_relink_key, test_cll_relink) != 0)
+		{
+			printf("test_cll: FAILED: octo_cll_insert failed after relinking rehash\n");
+			return 1;
+		}
+		test_cll_relink = octo_cll_rehash(test_cll_relink, 8, 16, 64, new_master_key);
+		octo_stat_cll_t *test_relink_stats = test_cll_relink == NULL ? NULL : octo_cll_stats(test_cll_relink);
+		if(test_relink_stats == NULL || test_relink_stats->total_entries != 667)
+		{
+			printf("test_cll: FAILED: copying rehash failed after relinking rehash\n");
+			return 1;
+		}
+		free(test_relink_stats);
+		octo_cll_free(test_cll_relink);
+	}
 	DEBUG_MSG("test_cll: Deleting cll_dict...");
 	octo_cll_free(test_cll_safe);
 	octo_cll_free(test_cll_clone);
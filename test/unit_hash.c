@@ -0,0 +1,294 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include <octo/types.h>
+#include <octo/keygen.h>
+#include <octo/hash.h>
+#include <octo/debug.h>
+
+// SipHash-2-4 reference vector: key 00..0f, message 00..0e.
+const uint8_t ref_out[8] = {0xe5, 0x45, 0xbe, 0x49, 0x61, 0xca, 0x29, 0xa1};
+
+// A trivial user-supplied keyed hash:
+void user_hash(const uint8_t *input, size_t input_length, uint8_t *output, const uint8_t *master_key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ master_key[0];
+	for(size_t i = 0; i < input_length; i++)
+	{
+		h = (h ^ input[i]) * 0x100000001b3ULL;
+	}
+	memcpy(output, &h, 8);
+	return;
+}
+
+int main()
+{
+	uint8_t ref_key[16];
+	uint8_t ref_msg[15];
+	uint8_t out[8];
+	for(unsigned int i = 0; i < 16; i++)
+	{
+		ref_key[i] = (uint8_t)i;
+	}
+	for(unsigned int i = 0; i < 15; i++)
+	{
+		ref_msg[i] = (uint8_t)i;
+	}
+	DEBUG_MSG("test_hash: Checking reference vector...");
+	octo_hash(ref_msg, 15, out, ref_key);
+	if(memcmp(out, ref_out, 8) != 0)
+	{
+		printf("test_hash: FAILED: octo_hash doesn't match the reference vector\n");
+		return 1;
+	}
+	DEBUG_MSG("test_hash: Comparing octo_hash_many with octo_hash...");
+	uint8_t *master_key = octo_keygen();
+	uint8_t *keys = malloc(37 * 67);
+	uint8_t *many = malloc(37 * 8);
+	if(master_key == NULL || keys == NULL || many == NULL)
+	{
+		printf("test_hash: FAILED: malloc failed\n");
+		return 1;
+	}
+	for(unsigned int i = 0; i < 37 * 67; i++)
+	{
+		keys[i] = (uint8_t)(i * 131 + 7);
+	}
+	for(size_t keylen = 1; keylen <= 67; keylen++)
+	{
+		for(size_t count = 0; count <= 37; count++)
+		{
+			octo_hash_many(keys, count, keylen, many, master_key);
+			for(size_t i = 0; i < count; i++)
+			{
+				octo_hash(keys + (i * keylen), keylen, out, master_key);
+				if(memcmp(out, many + (8 * i), 8) != 0)
+				{
+					printf("test_hash: FAILED: octo_hash_many disagrees with octo_hash (keylen %zu, key %zu of %zu)\n", keylen, i, count);
+					return 1;
+				}
+			}
+		}
+	}
+	DEBUG_MSG("test_hash: Comparing octo_hash_fixed variants with octo_hash...");
+	for(size_t keylen = 1; keylen <= 67; keylen++)
+	{
+		octo_hash_fn_t fixed = octo_hash_fixed(keylen);
+		octo_hash(keys, keylen, out, master_key);
+		fixed(keys, keylen, many, master_key);
+		if(memcmp(out, many, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_fixed variant disagrees with octo_hash (keylen %zu)\n", keylen);
+			return 1;
+		}
+	}
+	DEBUG_MSG("test_hash: Checking octo_hash_select...");
+	for(size_t keylen = 1; keylen <= 67; keylen++)
+	{
+		octo_hash13(keys, keylen, out, master_key);
+		octo_hash_select(octo_hash13, keylen)(keys, keylen, many, master_key);
+		if(memcmp(out, many, 8) != 0)
+		{
+			printf("test_hash: FAILED: selected octo_hash13 variant disagrees with octo_hash13 (keylen %zu)\n", keylen);
+			return 1;
+		}
+		octo_hash(keys, keylen, many, master_key);
+		if(memcmp(out, many, 8) == 0)
+		{
+			printf("test_hash: FAILED: octo_hash13 and octo_hash agree (keylen %zu)\n", keylen);
+			return 1;
+		}
+	}
+	if(octo_hash_select(NULL, 8) != octo_hash_fixed(8) || octo_hash_select(octo_hash13, 3) != octo_hash13 || octo_hash_select(user_hash, 8) != user_hash
+		|| octo_hash_select(octo_hash_long, 8) != octo_hash_fixed(8) || octo_hash_select(octo_hash_long, 512) != octo_hash_long)
+	{
+		printf("test_hash: FAILED: octo_hash_select picked the wrong function\n");
+		return 1;
+	}
+	DEBUG_MSG("test_hash: Comparing incremental hashing with octo_hash...");
+	for(size_t keylen = 0; keylen <= 67; keylen++)
+	{
+		for(size_t split = 0; split <= keylen; split += 3)
+		{
+			octo_hash_ctx_t ctx;
+			octo_hash_init(&ctx, master_key);
+			octo_hash_update(&ctx, keys, split / 2);
+			octo_hash_update(&ctx, keys + (split / 2), split - (split / 2));
+			octo_hash_update(&ctx, keys + split, keylen - split);
+			octo_hash_final(&ctx, many);
+			octo_hash(keys, keylen, out, master_key);
+			if(memcmp(out, many, 8) != 0)
+			{
+				printf("test_hash: FAILED: incremental hash disagrees with octo_hash (keylen %zu, split %zu)\n", keylen, split);
+				return 1;
+			}
+			octo_hash13_init(&ctx, master_key);
+			octo_hash_update(&ctx, keys, split);
+			octo_hash_update(&ctx, keys + split, keylen - split);
+			octo_hash_final(&ctx, many);
+			octo_hash13(keys, keylen, out, master_key);
+			if(memcmp(out, many, 8) != 0)
+			{
+				printf("test_hash: FAILED: incremental hash disagrees with octo_hash13 (keylen %zu, split %zu)\n", keylen, split);
+				return 1;
+			}
+			const octo_iov_t parts[2] = {{keys, split}, {keys + split, keylen - split}};
+			octo_hash_iov(user_hash, parts, 2, many, master_key);
+			user_hash(keys, keylen, out, master_key);
+			if(memcmp(out, many, 8) != 0)
+			{
+				printf("test_hash: FAILED: octo_hash_iov disagrees with user hash (keylen %zu, split %zu)\n", keylen, split);
+				return 1;
+			}
+		}
+	}
+	DEBUG_MSG("test_hash: Checking octo_hash_hw...");
+	uint8_t other_key[16];
+	memcpy(other_key, master_key, 16);
+	other_key[15] ^= 0x80;
+	for(size_t keylen = 0; keylen <= 67; keylen++)
+	{
+		uint8_t again[8];
+		octo_hash_hw(keys, keylen, out, master_key);
+		octo_hash_hw(keys, keylen, again, master_key);
+		if(memcmp(out, again, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_hw isn't deterministic (keylen %zu)\n", keylen);
+			return 1;
+		}
+		octo_hash_hw(keys, keylen, again, other_key);
+		if(memcmp(out, again, 8) == 0)
+		{
+			printf("test_hash: FAILED: octo_hash_hw ignores the master key (keylen %zu)\n", keylen);
+			return 1;
+		}
+		// Zero padding must not collide with a shorter key:
+		memset(many, 0, 68);
+		memcpy(many, keys, keylen);
+		octo_hash_hw(many, keylen + 1, again, master_key);
+		if(memcmp(out, again, 8) == 0)
+		{
+			printf("test_hash: FAILED: octo_hash_hw ignores the key length (keylen %zu)\n", keylen);
+			return 1;
+		}
+	}
+	uint8_t selected[8];
+	octo_hash_select(octo_hash_hw, 8)(keys, 8, selected, master_key);
+	octo_hash_hw(keys, 8, out, master_key);
+	if(memcmp(out, selected, 8) != 0)
+	{
+		printf("test_hash: FAILED: octo_hash_select resolved octo_hash_hw to a different hash\n");
+		return 1;
+	}
+	DEBUG_MSG("test_hash: Comparing octo_hash_long with striped octo_hash...");
+	uint8_t *long_key = malloc(1100);
+	uint8_t *stripe = malloc(1100 / 4);
+	if(long_key == NULL || stripe == NULL)
+	{
+		printf("test_hash: FAILED: malloc failed\n");
+		return 1;
+	}
+	for(unsigned int i = 0; i < 1100; i++)
+	{
+		long_key[i] = (uint8_t)(i * 167 + 13);
+	}
+	for(size_t keylen = 0; keylen <= 1100; keylen += (keylen < 160 ? 1 : 37))
+	{
+		octo_hash_long(long_key, keylen, out, master_key);
+		if(keylen < 128)
+		{
+			octo_hash(long_key, keylen, many, master_key);
+		}
+		else
+		{
+			// Stripe j is every fourth 8-byte word of the whole 32-byte blocks, starting at word j:
+			const size_t blocks = keylen / 32;
+			uint8_t combined[63];
+			for(size_t j = 0; j < 4; j++)
+			{
+				for(size_t b = 0; b < blocks; b++)
+				{
+					memcpy(stripe + (8 * b), long_key + (32 * b) + (8 * j), 8);
+				}
+				octo_hash(stripe, 8 * blocks, combined + (8 * j), master_key);
+			}
+			memcpy(combined + 32, long_key + (32 * blocks), keylen % 32);
+			octo_hash(combined, 32 + (keylen % 32), many, master_key);
+		}
+		if(memcmp(out, many, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_long disagrees with striped octo_hash (keylen %zu)\n", keylen);
+			return 1;
+		}
+		const octo_iov_t parts[3] = {{long_key, keylen / 3}, {long_key + (keylen / 3), keylen / 3}, {long_key + (2 * (keylen / 3)), keylen - (2 * (keylen / 3))}};
+		if(octo_hash_iov(octo_hash_long, parts, 3, many, master_key) != 0 || memcmp(out, many, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_iov disagrees with octo_hash_long (keylen %zu)\n", keylen);
+			return 1;
+		}
+	}
+	DEBUG_MSG("test_hash: Checking every kernel level...");
+	uint8_t long_ref[8];
+	uint8_t hw_ref[8];
+	uint8_t resolved_ref[8];
+	octo_hash_long(long_key, 1100, long_ref, master_key);
+	const octo_hash_fn_t resolved = octo_hash_select(octo_hash_hw, 67);
+	resolved(keys, 67, resolved_ref, master_key);
+	for(int isa = OCTO_ISA_BASELINE; isa <= OCTO_ISA_AVX512; isa++)
+	{
+		const octo_isa_t used = octo_hash_dispatch((octo_isa_t)isa);
+		if(used > (octo_isa_t)isa)
+		{
+			printf("test_hash: FAILED: octo_hash_dispatch went past level %d\n", isa);
+			return 1;
+		}
+		octo_hash_many(keys, 37, 67, many, master_key);
+		for(size_t i = 0; i < 37; i++)
+		{
+			octo_hash(keys + (i * 67), 67, out, master_key);
+			if(memcmp(out, many + (8 * i), 8) != 0)
+			{
+				printf("test_hash: FAILED: octo_hash_many disagrees with octo_hash (level %d, key %zu)\n", isa, i);
+				return 1;
+			}
+		}
+		octo_hash_long(long_key, 1100, out, master_key);
+		if(memcmp(out, long_ref, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_long depends on the kernel level (level %d)\n", isa);
+			return 1;
+		}
+		octo_hash_hw(keys, 67, out, master_key);
+		octo_hash_hw(keys, 67, hw_ref, master_key);
+		if(memcmp(out, hw_ref, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_hw isn't deterministic (level %d)\n", isa);
+			return 1;
+		}
+		octo_hash_hw(keys, 67, hw_ref, other_key);
+		if(memcmp(out, hw_ref, 8) == 0)
+		{
+			printf("test_hash: FAILED: octo_hash_hw ignores the master key (level %d)\n", isa);
+			return 1;
+		}
+		resolved(keys, 67, out, master_key);
+		if(memcmp(out, resolved_ref, 8) != 0)
+		{
+			printf("test_hash: FAILED: octo_hash_dispatch changed a resolved octo_hash_hw kernel (level %d)\n", isa);
+			return 1;
+		}
+	}
+	octo_hash_dispatch(OCTO_ISA_AVX512);
+	free(long_key);
+	free(stripe);
+	free(keys);
+	free(many);
+	free(master_key);
+	printf("test_hash: SUCCESS!\n");
+	return 0;
+}
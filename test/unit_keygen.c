@@ -21,6 +21,14 @@ int main()
 		snprintf(buf, 4, "%.2x", test_key[i]);
 		DEBUG_MSG(buf);
 	}
+	DEBUG_MSG("test_keygen: Generating another key...\n");
+	uint8_t *other_key = octo_keygen();
+	if(test_key == NULL || other_key == NULL || memcmp(test_key, other_key, 16) == 0)
+	{
+		printf("test_keygen: FAILED: octo_keygen repeated a key\n");
+		return 1;
+	}
+	free(other_key);
 	free(test_key);
 	printf("test_keygen: SUCCESS!\n");
 	return 0;
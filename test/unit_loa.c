@@ -389,6 +389,41 @@ int main()
 		printf("test_loa: FAILED: octo_loa_insert failed to re-insert deleted record\n");
 		return 1;
 	}
+	DEBUG_MSG("test_loa: Using keys given in parts...\n");
+	const octo_iov_t key2_parts[3] = {{key2, 3}, {key2 + 3, 1}, {key2 + 4, 4}};
+	if(octo_loa_delete_iov(key2_parts, 3, (const octo_dict_loa_t *)test_loa_safe) != 1)
+	{
+		printf("test_loa: FAILED: octo_loa_delete_iov couldn't delete key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(octo_loa_poke(key2, (const octo_dict_loa_t *)test_loa_safe) || octo_loa_poke_iov(key2_parts, 3, (const octo_dict_loa_t *)test_loa_safe))
+	{
+		printf("test_loa: FAILED: deleted key \"bcdefgh\\0\" still present\n");
+		return 1;
+	}
+	if(octo_loa_insert_iov(key2_parts, 3, val2, (const octo_dict_loa_t *)test_loa_safe) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_insert_iov failed inserting key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	output2 = octo_loa_fetch(key2, (const octo_dict_loa_t *)test_loa_safe);
+	if(output2 == (void *)test_loa_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch couldn't find key inserted in parts\n");
+		return 1;
+	}
+	output2 = octo_loa_fetch_safe_iov(key2_parts, 3, (const octo_dict_loa_t *)test_loa_safe);
+	if(output2 == NULL || output2 == (void *)test_loa_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch_safe_iov couldn't find key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	free(output2);
+	if(octo_loa_fetch_iov(key2_parts, 2, (const octo_dict_loa_t *)test_loa_safe) != NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch_iov accepted a key of the wrong length\n");
+		return 1;
+	}
 	DEBUG_MSG("test_loa: Cloning loa_dict...\n");
 	octo_dict_loa_t *test_loa_clone = octo_loa_clone(test_loa_safe);
 	if(test_loa_clone == NULL)
@@ -426,6 +461,429 @@ int main()
 		printf("test_loa: FAILED: octo_loa_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
 		return 1;
 	}
+	DEBUG_MSG("test_loa: Creating SipHash-1-3 loa_dict...\n");
+	octo_opt_t test_opt = {0};
+	test_opt.hash = octo_hash13;
+	octo_dict_loa_t *test_loa_opt = octo_loa_init_opt(8, 64, 128, init_master_key, &test_opt);
+	if(test_loa_opt == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_init_opt returned NULL\n");
+		return 1;
+	}
+	if(octo_loa_insert(key1, val1, (const octo_dict_loa_t *)test_loa_opt) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_insert failed on SipHash-1-3 dict\n");
+		return 1;
+	}
+	DEBUG_MSG("test_loa: Rehashing and cloning SipHash-1-3 loa_dict...\n");
+	test_loa_opt = octo_loa_rehash(test_loa_opt, 8, 64, 16, new_master_key);
+	if(test_loa_opt == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_rehash returned NULL on SipHash-1-3 dict\n");
+		return 1;
+	}
+	octo_dict_loa_t *test_loa_opt_clone = octo_loa_clone(test_loa_opt);
+	if(test_loa_opt_clone == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_clone returned NULL on SipHash-1-3 dict\n");
+		return 1;
+	}
+	if(test_loa_opt_clone->opt.hash != octo_hash13 || test_loa_opt_clone->hash != octo_hash_select(octo_hash13, 8))
+	{
+		printf("test_loa: FAILED: hash selection not preserved by rehash and clone\n");
+		return 1;
+	}
+	output1 = octo_loa_fetch(key1, (const octo_dict_loa_t *)test_loa_opt_clone);
+	if(output1 == (void *)test_loa_opt_clone || memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch couldn't find test value in SipHash-1-3 dict\n");
+		return 1;
+	}
+	octo_loa_free(test_loa_opt);
+	octo_loa_free(test_loa_opt_clone);
+	DEBUG_MSG("test_loa: Creating loa_dict with cached hashes...");
+	octo_opt_t test_cache_opt = {0};
+	test_cache_opt.cache_hash = 1;
+	octo_dict_loa_t *test_loa_cache = octo_loa_init_opt(8, 8, 256, init_master_key, &test_cache_opt);
+	if(test_loa_cache == NULL || test_loa_cache->hashlen != sizeof(uint64_t))
+	{
+		printf("test_loa: FAILED: octo_loa_init_opt didn't set up hash caching\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		if(octo_loa_insert(&i, &val, (const octo_dict_loa_t *)test_loa_cache) != 0)
+		{
+			printf("test_loa: FAILED: octo_loa_insert failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	for(uint64_t i = 0; i < 200; i += 2)
+	{
+		if(octo_loa_delete(&i, (const octo_dict_loa_t *)test_loa_cache) != 1)
+		{
+			printf("test_loa: FAILED: octo_loa_delete failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	DEBUG_MSG("test_loa: Rehashing and cloning loa_dict with cached hashes...");
+	test_loa_cache = octo_loa_rehash(test_loa_cache, 8, 8, 512, init_master_key);
+	if(test_loa_cache == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_rehash returned NULL on cached hash dict\n");
+		return 1;
+	}
+	test_loa_cache = octo_loa_rehash(test_loa_cache, 8, 8, 384, new_master_key);
+	if(test_loa_cache == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_rehash returned NULL on cached hash dict with new master key\n");
+		return 1;
+	}
+	octo_dict_loa_t *test_loa_cache_clone = octo_loa_clone(test_loa_cache);
+	if(test_loa_cache_clone == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_clone returned NULL on cached hash dict\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		void *found = octo_loa_fetch(&i, (const octo_dict_loa_t *)test_loa_cache_clone);
+		if((i % 2 == 0) != (found == (void *)test_loa_cache_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0))
+		{
+			printf("test_loa: FAILED: cached hash dict has the wrong records after rehash and clone\n");
+			return 1;
+		}
+	}
+	octo_loa_free(test_loa_cache);
+	octo_loa_free(test_loa_cache_clone);
+	DEBUG_MSG("test_loa: Checking loa_dict index modes...");
+	const octo_index_t test_modes[2] = {OCTO_INDEX_POW2, OCTO_INDEX_FASTRANGE};
+	for(int m = 0; m < 2; m++)
+	{
+		octo_opt_t test_index_opt = {0};
+		test_index_opt.index_mode = test_modes[m];
+		octo_dict_loa_t *test_loa_index = octo_loa_init_opt(8, 8, 100, init_master_key, &test_index_opt);
+		if(test_loa_index == NULL || test_loa_index->bucket_count != (test_modes[m] == OCTO_INDEX_POW2 ? 128 : 100))
+		{
+			printf("test_loa: FAILED: octo_loa_init_opt didn't set up index mode %d\n", m);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			const uint64_t val = i * 5;
+			if(octo_loa_insert(&i, &val, (const octo_dict_loa_t *)test_loa_index) != 0)
+			{
+				printf("test_loa: FAILED: octo_loa_insert failed with index mode %d\n", m);
+				return 1;
+			}
+		}
+		for(uint64_t i = 0; i < 64; i += 2)
+		{
+			if(octo_loa_delete(&i, (const octo_dict_loa_t *)test_loa_index) != 1)
+			{
+				printf("test_loa: FAILED: octo_loa_delete failed with index mode %d\n", m);
+				return 1;
+			}
+		}
+		test_loa_index = octo_loa_rehash(test_loa_index, 8, 8, 50, new_master_key);
+		if(test_loa_index == NULL || test_loa_index->bucket_count != (test_modes[m] == OCTO_INDEX_POW2 ? 64 : 50))
+		{
+			printf("test_loa: FAILED: octo_loa_rehash didn't keep index mode %d\n", m);
+			return 1;
+		}
+		octo_dict_loa_t *test_loa_index_clone = octo_loa_clone(test_loa_index);
+		if(test_loa_index_clone == NULL || test_loa_index_clone->opt.index_mode != test_modes[m])
+		{
+			printf("test_loa: FAILED: octo_loa_clone didn't keep index mode %d\n", m);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			const uint64_t val = i * 5;
+			void *found = octo_loa_fetch(&i, (const octo_dict_loa_t *)test_loa_index_clone);
+			if((i % 2 == 0) != (found == (void *)test_loa_index_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0)
+				|| octo_loa_poke(&i, (const octo_dict_loa_t *)test_loa_index) != (int)(i % 2))
+			{
+				printf("test_loa: FAILED: wrong records after rehash and clone with index mode %d\n", m);
+				return 1;
+			}
+		}
+		octo_loa_free(test_loa_index);
+		octo_loa_free(test_loa_index_clone);
+	}
+	octo_opt_t test_bad_opt = {0};
+	test_bad_opt.index_mode = (octo_index_t)7;
+	if(octo_loa_init_opt(8, 8, 100, init_master_key, &test_bad_opt) != NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_init_opt accepted an unknown index mode\n");
+		return 1;
+	}
+	DEBUG_MSG("test_loa: Checking octo_hash_hw fallback...");
+	octo_opt_t test_hw_opt = {0};
+	test_hw_opt.hash = octo_hash_hw;
+	test_hw_opt.fallback_len = 2;
+	octo_dict_loa_t *test_loa_hw = octo_loa_init_opt(8, 8, 64, init_master_key, &test_hw_opt);
+	if(test_loa_hw == NULL || test_loa_hw->hash != octo_hash_select(octo_hash_hw, 8))
+	{
+		printf("test_loa: FAILED: octo_loa_init_opt didn't select octo_hash_hw\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 48; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_loa_insert(&i, &val, (const octo_dict_loa_t *)test_loa_hw) != 0)
+		{
+			printf("test_loa: FAILED: octo_loa_insert failed on octo_hash_hw dict\n");
+			return 1;
+		}
+	}
+	if(test_loa_hw->opt.hash != octo_hash || test_loa_hw->hash != octo_hash_select(octo_hash, 8))
+	{
+		printf("test_loa: FAILED: flooded octo_hash_hw dict didn't fall back to octo_hash\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 48; i++)
+	{
+		const uint64_t val = i + 1;
+		void *found = octo_loa_fetch(&i, (const octo_dict_loa_t *)test_loa_hw);
+		if(found == (void *)test_loa_hw || memcmp(found, &val, 8) != 0)
+		{
+			printf("test_loa: FAILED: records lost in octo_hash_hw fallback\n");
+			return 1;
+		}
+	}
+	if(octo_loa_migrate(test_loa_hw, UINT64_MAX) != 0 || test_loa_hw->old != NULL)
+	{
+		printf("test_loa: FAILED: octo_hash_hw fallback didn't finish migrating\n");
+		return 1;
+	}
+	octo_loa_free(test_loa_hw);
+	DEBUG_MSG("test_loa: Checking key handles...");
+	octo_dict_loa_t *test_loa_shard1 = octo_loa_init(8, 8, 64, init_master_key);
+	octo_dict_loa_t *test_loa_shard2 = octo_loa_init(8, 8, 64, init_master_key);
+	if(test_loa_shard1 == NULL || test_loa_shard2 == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_init returned NULL\n");
+		return 1;
+	}
+	const uint64_t test_h_key = 0x0123456789abcdefULL;
+	const uint64_t test_h_val = 42;
+	octo_key_t test_handle;
+	octo_loa_key(&test_handle, &test_h_key, test_loa_shard1);
+	if(octo_loa_poke_h(&test_handle, test_loa_shard1) != 0
+		|| octo_loa_insert_h(&test_handle, &test_h_val, test_loa_shard1) != 0
+		|| octo_loa_insert_h(&test_handle, &test_h_val, test_loa_shard2) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_insert_h failed\n");
+		return 1;
+	}
+	if(octo_loa_poke(&test_h_key, test_loa_shard2) != 1 || octo_loa_poke_h(&test_handle, test_loa_shard1) != 1)
+	{
+		printf("test_loa: FAILED: record inserted by handle not found\n");
+		return 1;
+	}
+	void *test_h_found = octo_loa_fetch_h(&test_handle, test_loa_shard2);
+	if(test_h_found == (void *)test_loa_shard2 || memcmp(test_h_found, &test_h_val, 8) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch_h returned the wrong value\n");
+		return 1;
+	}
+	test_h_found = octo_loa_fetch_safe_h(&test_handle, test_loa_shard1);
+	if(test_h_found == (void *)test_loa_shard1 || memcmp(test_h_found, &test_h_val, 8) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch_safe_h returned the wrong value\n");
+		return 1;
+	}
+	free(test_h_found);
+	// A handle made for another master key is hashed again:
+	uint8_t test_h_master_key[16];
+	memcpy(test_h_master_key, init_master_key, 16);
+	test_h_master_key[0] ^= 1;
+	test_loa_shard2 = octo_loa_rehash(test_loa_shard2, 8, 8, 64, test_h_master_key);
+	if(test_loa_shard2 == NULL || octo_loa_poke_h(&test_handle, test_loa_shard2) != 1 || octo_loa_delete_h(&test_handle, test_loa_shard2) != 1
+		|| octo_loa_poke(&test_h_key, test_loa_shard2) != 0)
+	{
+		printf("test_loa: FAILED: key handle not usable after a rehash with a new master key\n");
+		return 1;
+	}
+	test_handle.keylen = 4;
+	if(octo_loa_fetch_h(&test_handle, test_loa_shard1) != NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_fetch_h accepted a handle with the wrong key length\n");
+		return 1;
+	}
+	octo_loa_free(test_loa_shard1);
+	octo_loa_free(test_loa_shard2);
+	DEBUG_MSG("test_loa: Checking loa_dict with octo_hash_long...");
+	octo_opt_t test_long_opt = {0};
+	test_long_opt.hash = octo_hash_long;
+	octo_dict_loa_t *test_loa_long = octo_loa_init_opt(512, 8, 64, init_master_key, &test_long_opt);
+	uint8_t *test_long_key = calloc(1, 512);
+	if(test_loa_long == NULL || test_long_key == NULL || test_loa_long->hash != octo_hash_long)
+	{
+		printf("test_loa: FAILED: couldn't create loa_dict with octo_hash_long\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 32; i++)
+	{
+		memcpy(test_long_key + 300, &i, 8);
+		if(octo_loa_insert(test_long_key, &i, test_loa_long) != 0)
+		{
+			printf("test_loa: FAILED: octo_loa_insert failed with octo_hash_long\n");
+			return 1;
+		}
+	}
+	for(uint64_t i = 0; i < 32; i++)
+	{
+		memcpy(test_long_key + 300, &i, 8);
+		const octo_iov_t test_long_parts[2] = {{test_long_key, 100}, {test_long_key + 100, 412}};
+		void *found = octo_loa_fetch_iov(test_long_parts, 2, test_loa_long);
+		if(found == (void *)test_loa_long || memcmp(found, &i, 8) != 0)
+		{
+			printf("test_loa: FAILED: octo_loa_fetch_iov couldn't find a long key\n");
+			return 1;
+		}
+	}
+	free(test_long_key);
+	octo_loa_free(test_loa_long);
+	DEBUG_MSG("test_loa: Checking automatic rekeying...");
+	octo_opt_t test_rekey_opt = {0};
+	test_rekey_opt.cache_hash = 1;
+	test_rekey_opt.rekey_len = 4;
+	test_rekey_opt.rekey_step = 1;
+	octo_dict_loa_t *test_loa_rekey = octo_loa_init_opt(8, 8, 128, init_master_key, &test_rekey_opt);
+	if(test_loa_rekey == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 96; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_loa_insert(&i, &val, test_loa_rekey) != 0)
+		{
+			printf("test_loa: FAILED: octo_loa_insert failed on rekeying dict\n");
+			return 1;
+		}
+	}
+	if(test_loa_rekey->flood_events == 0 || memcmp(test_loa_rekey->master_key, init_master_key, 16) == 0)
+	{
+		printf("test_loa: FAILED: flooded dict didn't rekey itself\n");
+		return 1;
+	}
+	uint8_t test_rekey_key[16];
+	memcpy(test_rekey_key, init_master_key, 16);
+	test_rekey_key[3] ^= 0x10;
+	if(octo_loa_rekey(test_loa_rekey, test_rekey_key) != 0 || test_loa_rekey->old == NULL
+		|| memcmp(test_loa_rekey->master_key, test_rekey_key, 16) != 0)
+	{
+		printf("test_loa: FAILED: octo_loa_rekey didn't start a rekey\n");
+		return 1;
+	}
+	// Records must stay reachable while they're spread over both tables:
+	const uint64_t test_rekey_five = 5;
+	const uint64_t test_rekey_seven = 7;
+	const uint64_t test_rekey_new = 100;
+	if(octo_loa_insert(&test_rekey_five, &test_rekey_new, test_loa_rekey) != 0 || octo_loa_delete(&test_rekey_seven, test_loa_rekey) != 1
+		|| octo_loa_poke(&test_rekey_seven, test_loa_rekey) != 0 || test_loa_rekey->old == NULL)
+	{
+		printf("test_loa: FAILED: update or delete failed during rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 96; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		const octo_iov_t parts[2] = {{&i, 3}, {(uint8_t *)&i + 3, 5}};
+		void *found = octo_loa_fetch_iov(parts, 2, test_loa_rekey);
+		if(i != 7 && (found == (void *)test_loa_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_loa: FAILED: record %llu lost during rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	if(octo_loa_migrate(test_loa_rekey, UINT64_MAX) != 0 || test_loa_rekey->old != NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_migrate didn't finish the rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 96; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		void *found = octo_loa_fetch(&i, test_loa_rekey);
+		if(i == 7 ? found != (void *)test_loa_rekey : (found == (void *)test_loa_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_loa: FAILED: record %llu wrong after rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_stat_loa_t *test_rekey_stats = octo_loa_stats(test_loa_rekey);
+	if(test_rekey_stats == NULL || test_rekey_stats->total_entries != 95 || test_rekey_stats->flood_events != test_loa_rekey->flood_events)
+	{
+		printf("test_loa: FAILED: octo_loa_stats wrong after rekey\n");
+		return 1;
+	}
+	free(test_rekey_stats);
+	octo_loa_free(test_loa_rekey);
+	DEBUG_MSG("test_loa: Checking full loa_dict with rekeying...");
+	octo_opt_t test_full_opt = {0};
+	test_full_opt.rekey_len = 4;
+	octo_dict_loa_t *test_loa_full = octo_loa_init_opt(8, 8, 16, init_master_key, &test_full_opt);
+	if(test_loa_full == NULL)
+	{
+		printf("test_loa: FAILED: octo_loa_init_opt returned NULL\n");
+		return 1;
+	}
+	uint64_t test_full_stored = 0;
+	for(uint64_t i = 0; i < 40; i++)
+	{
+		test_full_stored += octo_loa_insert(&i, &i, test_loa_full) == 0;
+	}
+	if(test_full_stored != 16 || test_loa_full->records + (test_loa_full->old != NULL ? test_loa_full->old->records : 0) != 16)
+	{
+		printf("test_loa: FAILED: full dict stored %llu records\n", (unsigned long long)test_full_stored);
+		return 1;
+	}
+	// Start a rekey by hand and rehash before it's drained; both tables are read:
+	if(octo_loa_migrate(test_loa_full, UINT64_MAX) != 0 || octo_loa_rekey(test_loa_full, new_master_key) != 0
+		|| octo_loa_migrate(test_loa_full, 5) != 0 || test_loa_full->old == NULL)
+	{
+		printf("test_loa: FAILED: full dict couldn't be rekeyed\n");
+		return 1;
+	}
+	const uint64_t test_full_key = 1000;
+	if(octo_loa_insert(&test_full_key, &test_full_key, test_loa_full) == 0)
+	{
+		printf("test_loa: FAILED: full dict accepted a new key during a rekey\n");
+		return 1;
+	}
+	test_loa_full = octo_loa_rehash(test_loa_full, 8, 8, 64, init_master_key);
+	if(test_loa_full == NULL || test_loa_full->old != NULL || test_loa_full->records != 16)
+	{
+		printf("test_loa: FAILED: octo_loa_rehash failed on a full rekeying dict\n");
+		return 1;
+	}
+	test_full_stored = 0;
+	for(uint64_t i = 0; i < 40; i++)
+	{
+		void *found = octo_loa_fetch(&i, test_loa_full);
+		if(found != (void *)test_loa_full)
+		{
+			if(memcmp(found, &i, 8) != 0)
+			{
+				printf("test_loa: FAILED: record %llu wrong after rehashing a full dict\n", (unsigned long long)i);
+				return 1;
+			}
+			test_full_stored++;
+		}
+	}
+	if(test_full_stored != 16 || octo_loa_insert(&test_full_key, &test_full_key, test_loa_full) != 0)
+	{
+		printf("test_loa: FAILED: rehashed full dict lost records or isn't usable\n");
+		return 1;
+	}
+	octo_loa_free(test_loa_full);
 	DEBUG_MSG("test_loa: Deleting loa_dict...\n");
 	octo_loa_free(test_loa_safe);
 	octo_loa_free(test_loa_clone);
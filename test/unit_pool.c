@@ -0,0 +1,228 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include <octo/types.h>
+#include <octo/keygen.h>
+#include <octo/carry.h>
+#include <octo/cll.h>
+#include <octo/loa.h>
+#include <octo/ucll.h>
+#include <octo/pool.h>
+#include <octo/debug.h>
+
+static const char *test_names[] = {"carry", "cll", "loa", "ucll"};
+
+static int test_insert(const octo_strategy_t strategy, const uint64_t key, void *dict)
+{
+	const uint64_t val = key + 1;
+	switch(strategy)
+	{
+	case OCTO_POOL_CARRY:
+		return octo_carry_insert(&key, &val, dict);
+	case OCTO_POOL_CLL:
+		return octo_cll_insert(&key, &val, dict);
+	case OCTO_POOL_UCLL:
+		return octo_ucll_insert(&key, &val, dict);
+	default:
+		return octo_loa_insert(&key, &val, dict);
+	}
+}
+
+static int test_poke(const octo_strategy_t strategy, const uint64_t key, void *dict)
+{
+	switch(strategy)
+	{
+	case OCTO_POOL_CARRY:
+		return octo_carry_poke(&key, dict);
+	case OCTO_POOL_CLL:
+		return octo_cll_poke(&key, dict);
+	case OCTO_POOL_UCLL:
+		return octo_ucll_poke(&key, dict);
+	default:
+		return octo_loa_poke(&key, dict);
+	}
+}
+
+static const uint8_t *test_master_key(const octo_strategy_t strategy, void *dict)
+{
+	switch(strategy)
+	{
+	case OCTO_POOL_CARRY:
+		return ((octo_dict_carry_t *)dict)->master_key;
+	case OCTO_POOL_CLL:
+		return ((octo_dict_cll_t *)dict)->master_key;
+	case OCTO_POOL_UCLL:
+		return ((octo_dict_ucll_t *)dict)->master_key;
+	default:
+		return ((octo_dict_loa_t *)dict)->master_key;
+	}
+}
+
+// Rekey a pooled dict and finish migrating it. Return the number of buckets in
+// its log of used buckets, or 0 if it lost the log or the rekey failed:
+static uint64_t test_rekey(const octo_strategy_t strategy, void *dict, const uint8_t *new_key)
+{
+	switch(strategy)
+	{
+	case OCTO_POOL_CARRY:
+		if(octo_carry_rekey(dict, new_key) != 0 || octo_carry_migrate(dict, UINT64_MAX) != 0 || ((octo_dict_carry_t *)dict)->touched == NULL)
+		{
+			return 0;
+		}
+		return ((octo_dict_carry_t *)dict)->touched_count;
+	case OCTO_POOL_CLL:
+		if(octo_cll_rekey(dict, new_key) != 0 || octo_cll_migrate(dict, UINT64_MAX) != 0 || ((octo_dict_cll_t *)dict)->touched == NULL)
+		{
+			return 0;
+		}
+		return ((octo_dict_cll_t *)dict)->touched_count;
+	case OCTO_POOL_UCLL:
+		if(octo_ucll_rekey(dict, new_key) != 0 || octo_ucll_migrate(dict, UINT64_MAX) != 0 || ((octo_dict_ucll_t *)dict)->touched == NULL)
+		{
+			return 0;
+		}
+		return ((octo_dict_ucll_t *)dict)->touched_count;
+	default:
+		if(octo_loa_rekey(dict, new_key) != 0 || octo_loa_migrate(dict, UINT64_MAX) != 0 || ((octo_dict_loa_t *)dict)->touched == NULL)
+		{
+			return 0;
+		}
+		return ((octo_dict_loa_t *)dict)->touched_count;
+	}
+}
+
+int main()
+{
+	DEBUG_MSG("test_pool: Checking octo_keygen_fast...");
+	uint8_t key_a[16];
+	uint8_t key_b[16];
+	octo_keygen_fast(key_a);
+	octo_keygen_fast(key_b);
+	if(memcmp(key_a, key_b, 16) == 0)
+	{
+		printf("test_pool: FAILED: octo_keygen_fast repeated a key\n");
+		return 1;
+	}
+	if(octo_pool_init(OCTO_POOL_LOA, 8, 8, 64, 1, 0, NULL) != NULL)
+	{
+		printf("test_pool: FAILED: octo_pool_init accepted a zero capacity\n");
+		return 1;
+	}
+	for(int s = OCTO_POOL_CARRY; s <= OCTO_POOL_UCLL; s++)
+	{
+		const octo_strategy_t strategy = (octo_strategy_t)s;
+		DEBUG_MSG("test_pool: Creating pool...");
+		octo_pool_t *pool = octo_pool_init(strategy, 8, 8, 64, 1, 2, NULL);
+		if(pool == NULL || octo_pool_fill(pool, 5) != 0 || pool->count != 2)
+		{
+			printf("test_pool: FAILED: couldn't create and fill %s pool\n", test_names[s]);
+			return 1;
+		}
+		DEBUG_MSG("test_pool: Getting dicts...");
+		void *first = octo_pool_get(pool);
+		void *second = octo_pool_get(pool);
+		void *third = octo_pool_get(pool);
+		if(first == NULL || second == NULL || third == NULL || pool->count != 0)
+		{
+			printf("test_pool: FAILED: octo_pool_get failed for %s pool\n", test_names[s]);
+			return 1;
+		}
+		if(memcmp(test_master_key(strategy, first), test_master_key(strategy, second), 16) == 0)
+		{
+			printf("test_pool: FAILED: %s pool handed out the same master key twice\n", test_names[s]);
+			return 1;
+		}
+		// A few records touch a few buckets; enough records fill the bucket log:
+		for(uint64_t i = 0; i < 5; i++)
+		{
+			if(test_insert(strategy, i, first) != 0)
+			{
+				printf("test_pool: FAILED: insert into pooled %s dict failed\n", test_names[s]);
+				return 1;
+			}
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			if(test_insert(strategy, i, second) != 0)
+			{
+				printf("test_pool: FAILED: insert into pooled %s dict failed\n", test_names[s]);
+				return 1;
+			}
+		}
+		DEBUG_MSG("test_pool: Returning dicts...");
+		uint8_t old_key[16];
+		memcpy(old_key, test_master_key(strategy, first), 16);
+		octo_pool_put(pool, first);
+		octo_pool_put(pool, second);
+		// The pool is full, so this one is freed:
+		octo_pool_put(pool, third);
+		if(pool->count != 2)
+		{
+			printf("test_pool: FAILED: %s pool holds %zu dicts, expected 2\n", test_names[s], pool->count);
+			return 1;
+		}
+		void *again = octo_pool_get(pool);
+		void *again_first = octo_pool_get(pool);
+		if(again != second || again_first != first || memcmp(test_master_key(strategy, again_first), old_key, 16) == 0)
+		{
+			printf("test_pool: FAILED: %s pool didn't recycle its dicts with new keys\n", test_names[s]);
+			return 1;
+		}
+		for(uint64_t i = 0; i < 64; i++)
+		{
+			if(test_poke(strategy, i, again) != 0 || test_poke(strategy, i, again_first) != 0)
+			{
+				printf("test_pool: FAILED: recycled %s dict still holds record %llu\n", test_names[s], (unsigned long long)i);
+				return 1;
+			}
+		}
+		if(test_insert(strategy, 3, again_first) != 0 || test_poke(strategy, 3, again_first) != 1)
+		{
+			printf("test_pool: FAILED: recycled %s dict isn't usable\n", test_names[s]);
+			return 1;
+		}
+		// The one record left lands in one bucket of the rekeyed table:
+		if(test_rekey(strategy, again_first, key_a) != 1 || test_poke(strategy, 3, again_first) != 1)
+		{
+			printf("test_pool: FAILED: rekeyed %s dict lost its bucket log\n", test_names[s]);
+			return 1;
+		}
+		DEBUG_MSG("test_pool: Returning a rehashed dict...");
+		void *resized;
+		switch(strategy)
+		{
+		case OCTO_POOL_CARRY:
+			resized = octo_carry_rehash(again, 8, 8, 128, 1, test_master_key(strategy, again));
+			break;
+		case OCTO_POOL_CLL:
+			resized = octo_cll_rehash(again, 8, 8, 128, test_master_key(strategy, again));
+			break;
+		case OCTO_POOL_UCLL:
+			resized = octo_ucll_rehash(again, 8, 8, 128, 1, test_master_key(strategy, again));
+			break;
+		default:
+			resized = octo_loa_rehash(again, 8, 8, 128, test_master_key(strategy, again));
+			break;
+		}
+		if(resized == NULL)
+		{
+			printf("test_pool: FAILED: rehashing pooled %s dict failed\n", test_names[s]);
+			return 1;
+		}
+		octo_pool_put(pool, resized);
+		octo_pool_put(pool, again_first);
+		if(pool->count != 1)
+		{
+			printf("test_pool: FAILED: %s pool kept a dict of the wrong shape\n", test_names[s]);
+			return 1;
+		}
+		octo_pool_free(pool);
+	}
+	printf("test_pool: SUCCESS!\n");
+	return 0;
+}
@@ -0,0 +1,729 @@
+// libocto Copyright (C) Travis Whitaker 2013-2014
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include <octo/types.h>
+#include <octo/keygen.h>
+#include <octo/ucll.h>
+#include <octo/debug.h>
+
+char key1[8] = "abcdefg\0";
+char key2[8] = "bcdefgh\0";
+char key3[8] = "cdefghi\0";
+char val1[64] = "123456781234567812345678123456781234567812345678123456781234567\0";
+char val2[64] = "234567892345678923456789234567892345678923456789234567892345678\0";
+char val3[64] = "345678934567893456789345678934567893456789345678934567893456789\0";
+
+int main()
+{
+	DEBUG_MSG("test_ucll: Generating keys...");
+	uint8_t *init_master_key = octo_keygen();
+	uint8_t *new_master_key = octo_keygen();
+	DEBUG_MSG("test_ucll: Creating test ucll_dict...");
+	octo_dict_ucll_t *test_ucll = octo_ucll_init(8, 64, 128, 4, init_master_key);
+	if(test_ucll == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_init returned NULL\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Doing test inserts...");
+	if(octo_ucll_insert(key1, val1, (const octo_dict_ucll_t *)test_ucll) > 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert returned error code inserting key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(octo_ucll_insert(key2, val2, (const octo_dict_ucll_t *)test_ucll) > 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert returned error code inserting key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(octo_ucll_insert(key3, val3, (const octo_dict_ucll_t *)test_ucll) > 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert returned error code inserting key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Poking inserted records...");
+	if(!(octo_ucll_poke(key1, (const octo_dict_ucll_t *)test_ucll)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(!(octo_ucll_poke(key2, (const octo_dict_ucll_t *)test_ucll)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(!(octo_ucll_poke(key3, (const octo_dict_ucll_t *)test_ucll)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Poking non-existent record...");
+	if(octo_ucll_poke("zfeuids\n", (const octo_dict_ucll_t *)test_ucll))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke found non-existent key\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Fetching inserted records \"safely\"...");
+	void *output1 = octo_ucll_fetch_safe(key1, (const octo_dict_ucll_t *)test_ucll);
+	void *output2 = octo_ucll_fetch_safe(key2, (const octo_dict_ucll_t *)test_ucll);
+	void *output3 = octo_ucll_fetch_safe(key3, (const octo_dict_ucll_t *)test_ucll);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll || output2 == (void *)test_ucll || output3 == (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	free(output1);
+	free(output2);
+	free(output3);
+	DEBUG_MSG("test_ucll: Fetching inserted records \"unsafely\"...");
+	output1 = octo_ucll_fetch(key1, (const octo_dict_ucll_t *)test_ucll);
+	output2 = octo_ucll_fetch(key2, (const octo_dict_ucll_t *)test_ucll);
+	output3 = octo_ucll_fetch(key3, (const octo_dict_ucll_t *)test_ucll);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll || output2 == (void *)test_ucll || output3 == (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Deleting record...");
+	if(octo_ucll_delete(key1, (const octo_dict_ucll_t *)test_ucll) == 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_delete returned 0, deletion failed\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Looking up deleted key...");
+	void *error_output = octo_ucll_fetch(key1, (const octo_dict_ucll_t *)test_ucll);
+	if(error_output == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(error_output != (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch reported hit for non-existent key\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Re-inserting deleted key...");
+	if(octo_ucll_insert(key1, val1, (const octo_dict_ucll_t *)test_ucll) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert failed to re-insert deleted record\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Rehashing dict...");
+	test_ucll = octo_ucll_rehash(test_ucll, test_ucll->keylen, test_ucll->vallen, 1, 2, new_master_key);
+	if(test_ucll == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_rehash returned null\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Poking inserted records...");
+	if(!(octo_ucll_poke(key1, (const octo_dict_ucll_t *)test_ucll)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test value\n");
+		return 1;
+	}
+	if(!(octo_ucll_poke(key2, (const octo_dict_ucll_t *)test_ucll)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test value\n");
+		return 1;
+	}
+	if(!(octo_ucll_poke(key3, (const octo_dict_ucll_t *)test_ucll)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Poking non-existent record...");
+	if(octo_ucll_poke("zfeuids\n", (const octo_dict_ucll_t *)test_ucll))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke found non-existent key\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Fetching inserted records \"safely\"...");
+	output1 = octo_ucll_fetch_safe(key1, (const octo_dict_ucll_t *)test_ucll);
+	output2 = octo_ucll_fetch_safe(key2, (const octo_dict_ucll_t *)test_ucll);
+	output3 = octo_ucll_fetch_safe(key3, (const octo_dict_ucll_t *)test_ucll);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll || output2 == (void *)test_ucll || output3 == (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	free(output1);
+	free(output2);
+	free(output3);
+	DEBUG_MSG("test_ucll: Fetching inserted records \"unsafely\"...");
+	output1 = octo_ucll_fetch(key1, (const octo_dict_ucll_t *)test_ucll);
+	output2 = octo_ucll_fetch(key2, (const octo_dict_ucll_t *)test_ucll);
+	output3 = octo_ucll_fetch(key3, (const octo_dict_ucll_t *)test_ucll);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll || output2 == (void *)test_ucll || output3 == (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Deleting record...");
+	if(octo_ucll_delete(key2, (const octo_dict_ucll_t *)test_ucll) == 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_delete returned 0, deletion failed\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Looking up deleted key...");
+	error_output = octo_ucll_fetch(key2, (const octo_dict_ucll_t *)test_ucll);
+	if(error_output == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(error_output != (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch reported hit for non-existent key\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Re-inserting deleted key...");
+	if(octo_ucll_insert(key2, val2, (const octo_dict_ucll_t *)test_ucll) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert failed to re-insert deleted record\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: \"Safely\" rehashing dict...");
+	octo_dict_ucll_t *test_ucll_safe = octo_ucll_rehash_safe(test_ucll, test_ucll->keylen, test_ucll->vallen, 4096, 4, new_master_key);
+	if(test_ucll_safe == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_rehash_safe returned null\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Deleting old dict...");
+	octo_ucll_free(test_ucll);
+	DEBUG_MSG("test_ucll: Poking inserted records...");
+	if(!(octo_ucll_poke(key1, (const octo_dict_ucll_t *)test_ucll_safe)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test value\n");
+		return 1;
+	}
+	if(!(octo_ucll_poke(key2, (const octo_dict_ucll_t *)test_ucll_safe)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test value\n");
+		return 1;
+	}
+	if(!(octo_ucll_poke(key3, (const octo_dict_ucll_t *)test_ucll_safe)))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Poking non-existent record...");
+	if(octo_ucll_poke("zfeuids\n", (const octo_dict_ucll_t *)test_ucll_safe))
+	{
+		printf("test_ucll: FAILED: octo_ucll_poke found non-existent key\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Fetching inserted records \"safely\"...");
+	output1 = octo_ucll_fetch_safe(key1, (const octo_dict_ucll_t *)test_ucll_safe);
+	output2 = octo_ucll_fetch_safe(key2, (const octo_dict_ucll_t *)test_ucll_safe);
+	output3 = octo_ucll_fetch_safe(key3, (const octo_dict_ucll_t *)test_ucll_safe);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll_safe || output2 == (void *)test_ucll_safe || output3 == (void *)test_ucll_safe)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	free(output1);
+	free(output2);
+	free(output3);
+	DEBUG_MSG("test_ucll: Fetching inserted records \"unsafely\"...");
+	output1 = octo_ucll_fetch(key1, (const octo_dict_ucll_t *)test_ucll_safe);
+	output2 = octo_ucll_fetch(key2, (const octo_dict_ucll_t *)test_ucll_safe);
+	output3 = octo_ucll_fetch(key3, (const octo_dict_ucll_t *)test_ucll_safe);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll_safe || output2 == (void *)test_ucll_safe || output3 == (void *)test_ucll_safe)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Deleting record...");
+	if(octo_ucll_delete(key3, (const octo_dict_ucll_t *)test_ucll_safe) == 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_delete returned 0, deletion failed\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Looking up deleted key...");
+	error_output = octo_ucll_fetch(key3, (const octo_dict_ucll_t *)test_ucll_safe);
+	if(error_output == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(error_output != (void *)test_ucll_safe)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch reported hit for non-existent key\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Re-inserting deleted key...");
+	if(octo_ucll_insert(key3, val3, (const octo_dict_ucll_t *)test_ucll_safe) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert failed to re-insert deleted record\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Using keys given in parts...");
+	const octo_iov_t key2_parts[3] = {{key2, 3}, {key2 + 3, 1}, {key2 + 4, 4}};
+	if(octo_ucll_delete_iov(key2_parts, 3, (const octo_dict_ucll_t *)test_ucll_safe) != 1)
+	{
+		printf("test_ucll: FAILED: octo_ucll_delete_iov couldn't delete key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(octo_ucll_poke(key2, (const octo_dict_ucll_t *)test_ucll_safe) || octo_ucll_poke_iov(key2_parts, 3, (const octo_dict_ucll_t *)test_ucll_safe))
+	{
+		printf("test_ucll: FAILED: deleted key \"bcdefgh\\0\" still present\n");
+		return 1;
+	}
+	if(octo_ucll_insert_iov(key2_parts, 3, val2, (const octo_dict_ucll_t *)test_ucll_safe) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert_iov failed inserting key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	output2 = octo_ucll_fetch(key2, (const octo_dict_ucll_t *)test_ucll_safe);
+	if(output2 == (void *)test_ucll_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch couldn't find key inserted in parts\n");
+		return 1;
+	}
+	output2 = octo_ucll_fetch_safe_iov(key2_parts, 3, (const octo_dict_ucll_t *)test_ucll_safe);
+	if(output2 == NULL || output2 == (void *)test_ucll_safe || memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe_iov couldn't find key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	free(output2);
+	if(octo_ucll_fetch_iov(key2_parts, 2, (const octo_dict_ucll_t *)test_ucll_safe) != NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_iov accepted a key of the wrong length\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Cloning ucll_dict...");
+	octo_dict_ucll_t *test_ucll_clone = octo_ucll_clone(test_ucll_safe);
+	if(test_ucll_clone == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_clone returned NULL\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Fetching inserted records from clone...");
+	output1 = octo_ucll_fetch(key1, (const octo_dict_ucll_t *)test_ucll_clone);
+	output2 = octo_ucll_fetch(key2, (const octo_dict_ucll_t *)test_ucll_clone);
+	output3 = octo_ucll_fetch(key3, (const octo_dict_ucll_t *)test_ucll_clone);
+	if(output1 == NULL || output2 == NULL || output3 == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned NULL\n");
+		return 1;
+	}
+	if(output1 == (void *)test_ucll || output2 == (void *)test_ucll || output3 == (void *)test_ucll)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch couldn't find test value\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking for correct values...");
+	if(memcmp(val1, output1, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"abcdefg\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val2, output2, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"bcdefgh\\0\"\n");
+		return 1;
+	}
+	if(memcmp(val3, output3, 64) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch returned pointer to incorrect value for key \"cdefghi\\0\"\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Checking unrolled nodes...");
+	octo_opt_t test_node_opt = {0};
+	test_node_opt.count_hits = 1;
+	octo_dict_ucll_t *test_ucll_node = octo_ucll_init_opt(8, 8, 1, 4, init_master_key, &test_node_opt);
+	if(test_ucll_node == NULL || test_ucll_node->tolerance != 4)
+	{
+		printf("test_ucll: FAILED: octo_ucll_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 10; i++)
+	{
+		if(octo_ucll_insert(&i, &i, test_ucll_node) != 0)
+		{
+			printf("test_ucll: FAILED: octo_ucll_insert failed on single bucket dict\n");
+			return 1;
+		}
+	}
+	octo_stat_ucll_t *test_node_stats = octo_ucll_stats(test_ucll_node);
+	if(test_node_stats == NULL || test_node_stats->total_entries != 10 || test_node_stats->total_nodes != 3
+		|| test_node_stats->max_chain_len != 10 || test_node_stats->chained_buckets != 1)
+	{
+		printf("test_ucll: FAILED: 10 records weren't packed into 3 nodes\n");
+		return 1;
+	}
+	free(test_node_stats);
+	// The newest node is at the head of the chain, and filled in order:
+	const uint64_t test_node_key = 9;
+	const uint64_t test_node_first = 0;
+	if(octo_ucll_poke(&test_node_key, test_ucll_node) != 1 || octo_ucll_poke(&test_node_first, test_ucll_node) != 1
+		|| test_ucll_node->hits != 2 || test_ucll_node->hit_depth != 1 + 6)
+	{
+		printf("test_ucll: FAILED: %llu hits at depth %llu\n", (unsigned long long)test_ucll_node->hits, (unsigned long long)test_ucll_node->hit_depth);
+		return 1;
+	}
+	// Emptying the head node frees it, and the space left in the others is reused:
+	for(uint64_t i = 8; i < 10; i++)
+	{
+		if(octo_ucll_delete(&i, test_ucll_node) != 1 || octo_ucll_delete(&i, test_ucll_node) != 0)
+		{
+			printf("test_ucll: FAILED: octo_ucll_delete failed on single bucket dict\n");
+			return 1;
+		}
+	}
+	const uint64_t test_node_mid = 5;
+	if(octo_ucll_delete(&test_node_mid, test_ucll_node) != 1 || octo_ucll_insert(&test_node_key, &test_node_key, test_ucll_node) != 0)
+	{
+		printf("test_ucll: FAILED: couldn't refill single bucket dict\n");
+		return 1;
+	}
+	test_node_stats = octo_ucll_stats(test_ucll_node);
+	if(test_node_stats == NULL || test_node_stats->total_entries != 8 || test_node_stats->total_nodes != 2)
+	{
+		printf("test_ucll: FAILED: nodes not freed or reused after deletions\n");
+		return 1;
+	}
+	free(test_node_stats);
+	octo_dict_ucll_t *test_ucll_node_clone = octo_ucll_clone(test_ucll_node);
+	if(test_ucll_node_clone == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_clone returned NULL on single bucket dict\n");
+		return 1;
+	}
+	test_ucll_node = octo_ucll_rehash(test_ucll_node, 8, 8, 1, 1, new_master_key);
+	if(test_ucll_node == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_rehash couldn't change the tolerance\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 10; i++)
+	{
+		void *found = octo_ucll_fetch(&i, test_ucll_node);
+		void *copy = octo_ucll_fetch(&i, test_ucll_node_clone);
+		if(i == 5 || i == 8 ? (found != (void *)test_ucll_node || copy != (void *)test_ucll_node_clone)
+			: (found == (void *)test_ucll_node || memcmp(found, &i, 8) != 0 || copy == (void *)test_ucll_node_clone || memcmp(copy, &i, 8) != 0))
+		{
+			printf("test_ucll: FAILED: record %llu wrong after rehash and clone\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	test_node_stats = octo_ucll_stats(test_ucll_node);
+	if(test_node_stats == NULL || test_node_stats->total_nodes != 8)
+	{
+		printf("test_ucll: FAILED: rehashed dict doesn't hold a record per node\n");
+		return 1;
+	}
+	free(test_node_stats);
+	octo_ucll_free(test_ucll_node);
+	octo_ucll_free(test_ucll_node_clone);
+	if(octo_ucll_init(8, 8, 1, 0, init_master_key) != NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_init accepted a zero tolerance\n");
+		return 1;
+	}
+	DEBUG_MSG("test_ucll: Creating ucll_dict with cached hashes...");
+	octo_opt_t test_cache_opt = {0};
+	test_cache_opt.cache_hash = 1;
+	test_cache_opt.index_mode = OCTO_INDEX_POW2;
+	octo_dict_ucll_t *test_ucll_cache = octo_ucll_init_opt(8, 8, 16, 3, init_master_key, &test_cache_opt);
+	if(test_ucll_cache == NULL || test_ucll_cache->hashlen != sizeof(uint64_t))
+	{
+		printf("test_ucll: FAILED: octo_ucll_init_opt didn't set up hash caching\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		if(octo_ucll_insert(&i, &val, (const octo_dict_ucll_t *)test_ucll_cache) != 0)
+		{
+			printf("test_ucll: FAILED: octo_ucll_insert failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	for(uint64_t i = 0; i < 200; i += 2)
+	{
+		if(octo_ucll_delete(&i, (const octo_dict_ucll_t *)test_ucll_cache) != 1)
+		{
+			printf("test_ucll: FAILED: octo_ucll_delete failed on cached hash dict\n");
+			return 1;
+		}
+	}
+	DEBUG_MSG("test_ucll: Rehashing and cloning ucll_dict with cached hashes...");
+	test_ucll_cache = octo_ucll_rehash(test_ucll_cache, 8, 8, 32, 3, init_master_key);
+	if(test_ucll_cache == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_rehash returned NULL on cached hash dict\n");
+		return 1;
+	}
+	test_ucll_cache = octo_ucll_rehash(test_ucll_cache, 8, 8, 64, 3, new_master_key);
+	if(test_ucll_cache == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_rehash returned NULL on cached hash dict with new master key\n");
+		return 1;
+	}
+	octo_dict_ucll_t *test_ucll_cache_clone = octo_ucll_clone(test_ucll_cache);
+	if(test_ucll_cache_clone == NULL || test_ucll_cache_clone->bucket_count != 64)
+	{
+		printf("test_ucll: FAILED: octo_ucll_clone returned NULL on cached hash dict\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		const uint64_t val = i * 3;
+		void *found = octo_ucll_fetch(&i, (const octo_dict_ucll_t *)test_ucll_cache_clone);
+		if((i % 2 == 0) != (found == (void *)test_ucll_cache_clone) || (i % 2 == 1 && memcmp(found, &val, 8) != 0))
+		{
+			printf("test_ucll: FAILED: cached hash dict has the wrong records after rehash and clone\n");
+			return 1;
+		}
+	}
+	octo_ucll_clear(test_ucll_cache);
+	for(uint64_t i = 0; i < 200; i++)
+	{
+		if(octo_ucll_poke(&i, test_ucll_cache) != 0)
+		{
+			printf("test_ucll: FAILED: record %llu left after clearing\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	octo_ucll_free(test_ucll_cache);
+	octo_ucll_free(test_ucll_cache_clone);
+	DEBUG_MSG("test_ucll: Checking key handles...");
+	octo_dict_ucll_t *test_ucll_shard = octo_ucll_init(8, 8, 16, 4, init_master_key);
+	if(test_ucll_shard == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_init returned NULL\n");
+		return 1;
+	}
+	const uint64_t test_h_key = 0x0123456789abcdefULL;
+	const uint64_t test_h_val = 42;
+	octo_key_t test_handle;
+	octo_ucll_key(&test_handle, &test_h_key, test_ucll_shard);
+	if(octo_ucll_poke_h(&test_handle, test_ucll_shard) != 0 || octo_ucll_insert_h(&test_handle, &test_h_val, test_ucll_shard) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_insert_h failed\n");
+		return 1;
+	}
+	void *test_h_found = octo_ucll_fetch_safe_h(&test_handle, test_ucll_shard);
+	if(test_h_found == NULL || test_h_found == (void *)test_ucll_shard || memcmp(test_h_found, &test_h_val, 8) != 0
+		|| octo_ucll_poke(&test_h_key, test_ucll_shard) != 1)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_safe_h returned the wrong value\n");
+		return 1;
+	}
+	free(test_h_found);
+	test_h_found = octo_ucll_fetch_h(&test_handle, test_ucll_shard);
+	if(test_h_found == (void *)test_ucll_shard || memcmp(test_h_found, &test_h_val, 8) != 0 || octo_ucll_delete_h(&test_handle, test_ucll_shard) != 1)
+	{
+		printf("test_ucll: FAILED: octo_ucll_fetch_h returned the wrong value\n");
+		return 1;
+	}
+	octo_ucll_free(test_ucll_shard);
+	DEBUG_MSG("test_ucll: Checking automatic rekeying...");
+	octo_opt_t test_rekey_opt = {0};
+	test_rekey_opt.cache_hash = 1;
+	test_rekey_opt.rekey_len = 6;
+	test_rekey_opt.rekey_step = 1;
+	octo_dict_ucll_t *test_ucll_rekey = octo_ucll_init_opt(8, 8, 8, 2, init_master_key, &test_rekey_opt);
+	if(test_ucll_rekey == NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_init_opt returned NULL\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i + 1;
+		if(octo_ucll_insert(&i, &val, test_ucll_rekey) != 0)
+		{
+			printf("test_ucll: FAILED: octo_ucll_insert failed on rekeying dict\n");
+			return 1;
+		}
+	}
+	if(test_ucll_rekey->flood_events == 0 || memcmp(test_ucll_rekey->master_key, init_master_key, 16) == 0)
+	{
+		printf("test_ucll: FAILED: flooded dict didn't rekey itself\n");
+		return 1;
+	}
+	uint8_t test_rekey_key[16];
+	memcpy(test_rekey_key, init_master_key, 16);
+	test_rekey_key[3] ^= 0x10;
+	if(octo_ucll_rekey(test_ucll_rekey, test_rekey_key) != 0 || test_ucll_rekey->old == NULL
+		|| memcmp(test_ucll_rekey->master_key, test_rekey_key, 16) != 0)
+	{
+		printf("test_ucll: FAILED: octo_ucll_rekey didn't start a rekey\n");
+		return 1;
+	}
+	// Records must stay reachable while they're spread over both tables:
+	const uint64_t test_rekey_five = 5;
+	const uint64_t test_rekey_seven = 7;
+	const uint64_t test_rekey_new = 100;
+	if(octo_ucll_insert(&test_rekey_five, &test_rekey_new, test_ucll_rekey) != 0 || octo_ucll_delete(&test_rekey_seven, test_ucll_rekey) != 1
+		|| octo_ucll_poke(&test_rekey_seven, test_ucll_rekey) != 0 || test_ucll_rekey->old == NULL)
+	{
+		printf("test_ucll: FAILED: update or delete failed during rekey\n");
+		return 1;
+	}
+	for(uint64_t i = 0; i < 64; i++)
+	{
+		const uint64_t val = i == 5 ? 100 : i + 1;
+		void *found = octo_ucll_fetch(&i, test_ucll_rekey);
+		if(i != 7 && (found == (void *)test_ucll_rekey || memcmp(found, &val, 8) != 0))
+		{
+			printf("test_ucll: FAILED: record %llu lost during rekey\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	if(octo_ucll_migrate(test_ucll_rekey, UINT64_MAX) != 0 || test_ucll_rekey->old != NULL)
+	{
+		printf("test_ucll: FAILED: octo_ucll_migrate didn't finish the rekey\n");
+		return 1;
+	}
+	octo_stat_ucll_t *test_rekey_stats = octo_ucll_stats(test_ucll_rekey);
+	if(test_rekey_stats == NULL || test_rekey_stats->total_entries != 63 || test_rekey_stats->flood_events != test_ucll_rekey->flood_events)
+	{
+		printf("test_ucll: FAILED: octo_ucll_stats wrong after rekey\n");
+		return 1;
+	}
+	free(test_rekey_stats);
+	octo_ucll_free(test_ucll_rekey);
+	DEBUG_MSG("test_ucll: Deleting ucll_dict...");
+	octo_ucll_free(test_ucll_safe);
+	octo_ucll_free(test_ucll_clone);
+	free(init_master_key);
+	free(new_master_key);
+	printf("test_ucll: SUCCESS!\n");
+	return 0;
+}